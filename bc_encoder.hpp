@@ -0,0 +1,470 @@
+#ifndef BC_ENCODER_HPP
+#define BC_ENCODER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "compressed_texture.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BC_ENCODER_SSE2
+#include <emmintrin.h>
+#endif
+
+/* CPU encoder for BC1, BC3 and BC7 blocks, used offline by the texture compressor tool.
+ * Endpoints are fitted to the principal axis of the block's colors and then refined by least squares against the
+ * chosen indices. BC7 only uses mode 6 (one endpoint pair with 4-bit indices for RGBA), which handles both opaque
+ * and transparent blocks well and keeps the encoder small; multi-partition modes would improve blocks that mix very
+ * different colors. The index searches of BC1 (which every block of BC1 and BC3 goes through) and of BC7 mode 6 run
+ * four texels at a time with SSE2 when available. */
+
+// A 4x4 block of RGBA8 texels, row by row.
+struct TexelBlock {
+  uint8_t rgba[16][4];
+};
+
+namespace bc_encoder_detail {
+
+// Distances in the index searches are integer sums of squared channel differences.
+inline int squaredDistance(const uint8_t *a, const int *b, int channels) {
+  int sum = 0;
+  for (int c = 0; c < channels; c++)
+    sum += (a[c] - b[c]) * (a[c] - b[c]);
+  return sum;
+}
+
+/* Line through the block's texels in the first `N` channels: `start` and `end` are the extreme projections of the
+ * texels onto the principal axis of their covariance (found by power iteration). */
+template <int N> void fitLine(const TexelBlock &block, float start[4], float end[4]) {
+  float mean[N] = {};
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < N; c++)
+      mean[c] += block.rgba[i][c] / 16.0f;
+
+  float covariance[N][N] = {};
+  for (int i = 0; i < 16; i++)
+    for (int a = 0; a < N; a++)
+      for (int b = 0; b < N; b++)
+        covariance[a][b] += (block.rgba[i][a] - mean[a]) * (block.rgba[i][b] - mean[b]);
+
+  float axis[N];
+  for (int c = 0; c < N; c++)
+    axis[c] = 1.0f;
+  for (int iteration = 0; iteration < 8; iteration++) {
+    float next[N] = {}, length = 0;
+    for (int a = 0; a < N; a++) {
+      for (int b = 0; b < N; b++)
+        next[a] += covariance[a][b] * axis[b];
+      length = std::max(length, std::fabs(next[a]));
+    }
+    // All texels are the same color.
+    if (length == 0)
+      break;
+    for (int c = 0; c < N; c++)
+      axis[c] = next[c] / length;
+  }
+  float lengthSquared = 0;
+  for (int c = 0; c < N; c++)
+    lengthSquared += axis[c] * axis[c];
+
+  float minimum = 0, maximum = 0;
+  for (int i = 0; i < 16; i++) {
+    float t = 0;
+    for (int c = 0; c < N; c++)
+      t += (block.rgba[i][c] - mean[c]) * axis[c];
+    minimum = std::min(minimum, t / lengthSquared);
+    maximum = std::max(maximum, t / lengthSquared);
+  }
+  for (int c = 0; c < N; c++) {
+    start[c] = std::min(std::max(mean[c] + minimum * axis[c], 0.0f), 255.0f);
+    end[c] = std::min(std::max(mean[c] + maximum * axis[c], 0.0f), 255.0f);
+  }
+}
+
+/* Endpoints that minimize the squared error of `texel ~ (1 - weight) * start + weight * end` for fixed weights.
+ * Returns false when the weights do not determine both endpoints (all texels use the same index). */
+template <int N> bool refineEndpoints(const TexelBlock &block, const float weights[16], float start[4], float end[4]) {
+  float aa = 0, bb = 0, ab = 0, ax[N] = {}, bx[N] = {};
+  for (int i = 0; i < 16; i++) {
+    float b = weights[i], a = 1.0f - b;
+    aa += a * a, bb += b * b, ab += a * b;
+    for (int c = 0; c < N; c++) {
+      ax[c] += a * block.rgba[i][c];
+      bx[c] += b * block.rgba[i][c];
+    }
+  }
+  float determinant = aa * bb - ab * ab;
+  if (std::fabs(determinant) < 1e-6f)
+    return false;
+  for (int c = 0; c < N; c++) {
+    start[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+    end[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+  }
+  return true;
+}
+
+#pragma region BC1
+inline uint16_t packRGB565(const float color[3]) {
+  int r = static_cast<int>(color[0] * 31.0f / 255.0f + 0.5f);
+  int g = static_cast<int>(color[1] * 63.0f / 255.0f + 0.5f);
+  int b = static_cast<int>(color[2] * 31.0f / 255.0f + 0.5f);
+  return static_cast<uint16_t>(r << 11 | g << 5 | b);
+}
+
+// Expanded the way the hardware does it, by replicating the high bits.
+inline void unpackRGB565(uint16_t packed, int color[3]) {
+  int r = packed >> 11 & 31, g = packed >> 5 & 63, b = packed & 31;
+  color[0] = r << 3 | r >> 2;
+  color[1] = g << 2 | g >> 4;
+  color[2] = b << 3 | b >> 2;
+}
+
+// Four color mode palette: both endpoints and the two colors at 1/3 and 2/3 between them.
+inline void bc1Palette(uint16_t color0, uint16_t color1, int palette[4][3]) {
+  unpackRGB565(color0, palette[0]);
+  unpackRGB565(color1, palette[1]);
+  for (int c = 0; c < 3; c++) {
+    palette[2][c] = (2 * palette[0][c] + palette[1][c] + 1) / 3;
+    palette[3][c] = (palette[0][c] + 2 * palette[1][c] + 1) / 3;
+  }
+}
+
+// Closest palette entry for every texel, alpha is ignored. Returns the total squared error.
+inline int selectBC1Indices(const TexelBlock &block, const int palette[4][3], uint8_t indices[16]) {
+#ifdef BC_ENCODER_SSE2
+  const __m128i zero = _mm_setzero_si128(), rgbMask = _mm_set1_epi32(0x00FFFFFF);
+  __m128i colors[4];
+  for (int i = 0; i < 4; i++) {
+    const int *p = palette[i];
+    colors[i] = _mm_setr_epi16(p[0], p[1], p[2], 0, p[0], p[1], p[2], 0);
+  }
+  int total = 0;
+  for (int group = 0; group < 16; group += 4) {
+    // Four texels widened to 16 bits, two per register.
+    __m128i texels = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i *>(block.rgba[group])), rgbMask);
+    __m128i low = _mm_unpacklo_epi8(texels, zero), high = _mm_unpackhi_epi8(texels, zero);
+    __m128i best = _mm_set1_epi32(INT_MAX), bestIndex = zero;
+    for (int i = 0; i < 4; i++) {
+      __m128i differenceLow = _mm_sub_epi16(low, colors[i]), differenceHigh = _mm_sub_epi16(high, colors[i]);
+      // r*r + g*g and b*b + 0 per texel, the shuffles add the two halves of each texel.
+      __m128 squaresLow = _mm_castsi128_ps(_mm_madd_epi16(differenceLow, differenceLow));
+      __m128 squaresHigh = _mm_castsi128_ps(_mm_madd_epi16(differenceHigh, differenceHigh));
+      __m128i distance =
+          _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(squaresLow, squaresHigh, _MM_SHUFFLE(2, 0, 2, 0))),
+                        _mm_castps_si128(_mm_shuffle_ps(squaresLow, squaresHigh, _MM_SHUFFLE(3, 1, 3, 1))));
+      __m128i closer = _mm_cmplt_epi32(distance, best);
+      best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, bestIndex));
+    }
+    alignas(16) int distances[4], bestIndices[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(distances), best);
+    _mm_store_si128(reinterpret_cast<__m128i *>(bestIndices), bestIndex);
+    for (int i = 0; i < 4; i++) {
+      indices[group + i] = static_cast<uint8_t>(bestIndices[i]);
+      total += distances[i];
+    }
+  }
+  return total;
+#else
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = INT_MAX;
+    for (int entry = 0; entry < 4; entry++) {
+      int distance = squaredDistance(block.rgba[i], palette[entry], 3);
+      if (distance < best) {
+        best = distance;
+        indices[i] = static_cast<uint8_t>(entry);
+      }
+    }
+    total += best;
+  }
+  return total;
+#endif
+}
+
+// Quantize the endpoints, pick indices and return the error. `color0 > color1` selects the four color mode.
+inline int tryBC1Endpoints(const TexelBlock &block, const float start[3], const float end[3], uint16_t &color0,
+                           uint16_t &color1, uint8_t indices[16]) {
+  color0 = packRGB565(end);
+  color1 = packRGB565(start);
+  if (color0 < color1)
+    std::swap(color0, color1);
+  int palette[4][3];
+  bc1Palette(color0, color1, palette);
+  return selectBC1Indices(block, palette, indices);
+}
+
+// The 8 byte color block of BC1 and BC3, always in four color mode (BC3 ignores the endpoint order anyway).
+inline void encodeBC1Color(const TexelBlock &block, uint8_t out[8]) {
+  float start[4], end[4];
+  fitLine<3>(block, start, end);
+
+  uint16_t color0, color1;
+  uint8_t indices[16];
+  int error = tryBC1Endpoints(block, start, end, color0, color1, indices);
+
+  // Weight of color0 for each index: color0 is fitted as `end` and color1 as `start` by the refinement.
+  const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+  float texelWeights[16];
+  for (int i = 0; i < 16; i++)
+    texelWeights[i] = weights[indices[i]];
+  if (color0 != color1 && refineEndpoints<3>(block, texelWeights, start, end)) {
+    uint16_t refined0, refined1;
+    uint8_t refinedIndices[16];
+    int refinedError = tryBC1Endpoints(block, start, end, refined0, refined1, refinedIndices);
+    if (refinedError < error) {
+      color0 = refined0, color1 = refined1;
+      memcpy(indices, refinedIndices, sizeof(indices));
+    }
+  }
+
+  // Equal endpoints would switch to the three color mode, index 0 is the right color in both modes.
+  uint32_t packedIndices = 0;
+  if (color0 != color1)
+    for (int i = 0; i < 16; i++)
+      packedIndices |= uint32_t(indices[i]) << (2 * i);
+  out[0] = color0 & 0xFF, out[1] = color0 >> 8;
+  out[2] = color1 & 0xFF, out[3] = color1 >> 8;
+  for (int i = 0; i < 4; i++)
+    out[4 + i] = static_cast<uint8_t>(packedIndices >> (8 * i));
+}
+#pragma endregion
+
+#pragma region BC3
+// The alpha half of BC3: two 8-bit endpoints and 3-bit indices into the 8 values between them.
+inline void encodeBC3Alpha(const TexelBlock &block, uint8_t out[8]) {
+  int maximum = 0, minimum = 255;
+  for (int i = 0; i < 16; i++) {
+    maximum = std::max<int>(maximum, block.rgba[i][3]);
+    minimum = std::min<int>(minimum, block.rgba[i][3]);
+  }
+  memset(out, 0, 8);
+  out[0] = static_cast<uint8_t>(maximum);
+  out[1] = static_cast<uint8_t>(minimum);
+  if (maximum == minimum)
+    return;
+
+  // alpha0 > alpha1 selects the eight value mode: index 0 and 1 are the endpoints, 2-7 are evenly spaced between.
+  int values[8] = {maximum, minimum};
+  for (int i = 1; i < 7; i++)
+    values[i + 1] = ((7 - i) * maximum + i * minimum + 3) / 7;
+
+  uint64_t packedIndices = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = INT_MAX, bestIndex = 0;
+    for (int entry = 0; entry < 8; entry++) {
+      int distance = std::abs(block.rgba[i][3] - values[entry]);
+      if (distance < best)
+        best = distance, bestIndex = entry;
+    }
+    packedIndices |= uint64_t(bestIndex) << (3 * i);
+  }
+  for (int i = 0; i < 6; i++)
+    out[2 + i] = static_cast<uint8_t>(packedIndices >> (8 * i));
+}
+#pragma endregion
+
+#pragma region BC7
+const int BC7_WEIGHTS4[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+// Writes fields least significant bit first, the way BC7 blocks are laid out.
+struct BitWriter {
+  uint8_t *out;
+  int position = 0;
+
+  void write(uint32_t value, int bits) {
+    for (int i = 0; i < bits; i++, position++)
+      out[position >> 3] |= static_cast<uint8_t>((value >> i & 1) << (position & 7));
+  }
+};
+
+struct BC7Mode6 {
+  int endpoints[2][4]; // 7 bit per channel
+  int pBits[2];        // shared lowest bit of each endpoint
+  uint8_t indices[16];
+};
+
+// Quantize both endpoints for the given p-bits, pick the closest of the 16 interpolated colors for every texel.
+inline int tryBC7Mode6(const TexelBlock &block, const float start[4], const float end[4], int pBit0, int pBit1,
+                       BC7Mode6 &mode) {
+  int colors[2][4];
+  for (int c = 0; c < 4; c++) {
+    mode.endpoints[0][c] = std::min(std::max(static_cast<int>((start[c] - pBit0) / 2.0f + 0.5f), 0), 127);
+    mode.endpoints[1][c] = std::min(std::max(static_cast<int>((end[c] - pBit1) / 2.0f + 0.5f), 0), 127);
+    colors[0][c] = mode.endpoints[0][c] << 1 | pBit0;
+    colors[1][c] = mode.endpoints[1][c] << 1 | pBit1;
+  }
+  mode.pBits[0] = pBit0, mode.pBits[1] = pBit1;
+
+  int palette[16][4];
+  for (int i = 0; i < 16; i++)
+    for (int c = 0; c < 4; c++)
+      palette[i][c] = ((64 - BC7_WEIGHTS4[i]) * colors[0][c] + BC7_WEIGHTS4[i] * colors[1][c] + 32) >> 6;
+
+#ifdef BC_ENCODER_SSE2
+  // Same search as `selectBC1Indices`, four texels at a time, with alpha and 16 entries.
+  const __m128i zero = _mm_setzero_si128();
+  __m128i entries[16];
+  for (int i = 0; i < 16; i++) {
+    const int *p = palette[i];
+    entries[i] = _mm_setr_epi16(p[0], p[1], p[2], p[3], p[0], p[1], p[2], p[3]);
+  }
+  int total = 0;
+  for (int group = 0; group < 16; group += 4) {
+    __m128i texels = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block.rgba[group]));
+    __m128i low = _mm_unpacklo_epi8(texels, zero), high = _mm_unpackhi_epi8(texels, zero);
+    __m128i best = _mm_set1_epi32(INT_MAX), bestIndex = zero;
+    for (int i = 0; i < 16; i++) {
+      __m128i differenceLow = _mm_sub_epi16(low, entries[i]), differenceHigh = _mm_sub_epi16(high, entries[i]);
+      // r*r + g*g and b*b + a*a per texel.
+      __m128 squaresLow = _mm_castsi128_ps(_mm_madd_epi16(differenceLow, differenceLow));
+      __m128 squaresHigh = _mm_castsi128_ps(_mm_madd_epi16(differenceHigh, differenceHigh));
+      __m128i distance =
+          _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(squaresLow, squaresHigh, _MM_SHUFFLE(2, 0, 2, 0))),
+                        _mm_castps_si128(_mm_shuffle_ps(squaresLow, squaresHigh, _MM_SHUFFLE(3, 1, 3, 1))));
+      __m128i closer = _mm_cmplt_epi32(distance, best);
+      best = _mm_or_si128(_mm_and_si128(closer, distance), _mm_andnot_si128(closer, best));
+      bestIndex = _mm_or_si128(_mm_and_si128(closer, _mm_set1_epi32(i)), _mm_andnot_si128(closer, bestIndex));
+    }
+    alignas(16) int distances[4], bestIndices[4];
+    _mm_store_si128(reinterpret_cast<__m128i *>(distances), best);
+    _mm_store_si128(reinterpret_cast<__m128i *>(bestIndices), bestIndex);
+    for (int i = 0; i < 4; i++) {
+      mode.indices[group + i] = static_cast<uint8_t>(bestIndices[i]);
+      total += distances[i];
+    }
+  }
+  return total;
+#else
+  int total = 0;
+  for (int i = 0; i < 16; i++) {
+    int best = INT_MAX;
+    for (int entry = 0; entry < 16; entry++) {
+      int distance = squaredDistance(block.rgba[i], palette[entry], 4);
+      if (distance < best) {
+        best = distance;
+        mode.indices[i] = static_cast<uint8_t>(entry);
+      }
+    }
+    total += best;
+  }
+  return total;
+#endif
+}
+
+inline int searchBC7Mode6(const TexelBlock &block, const float start[4], const float end[4], BC7Mode6 &best) {
+  int bestError = INT_MAX;
+  for (int pBits = 0; pBits < 4; pBits++) {
+    BC7Mode6 candidate;
+    int error = tryBC7Mode6(block, start, end, pBits & 1, pBits >> 1, candidate);
+    if (error < bestError)
+      bestError = error, best = candidate;
+  }
+  return bestError;
+}
+
+inline void encodeBC7(const TexelBlock &block, uint8_t out[16]) {
+  float start[4], end[4];
+  fitLine<4>(block, start, end);
+
+  BC7Mode6 mode;
+  int error = searchBC7Mode6(block, start, end, mode);
+
+  float weights[16];
+  for (int i = 0; i < 16; i++)
+    weights[i] = BC7_WEIGHTS4[mode.indices[i]] / 64.0f;
+  if (error > 0 && refineEndpoints<4>(block, weights, start, end)) {
+    BC7Mode6 refined;
+    if (searchBC7Mode6(block, start, end, refined) < error)
+      mode = refined;
+  }
+
+  // The most significant bit of the first index is implied to be 0, swap the endpoints if it is not.
+  if (mode.indices[0] >= 8) {
+    for (int c = 0; c < 4; c++)
+      std::swap(mode.endpoints[0][c], mode.endpoints[1][c]);
+    std::swap(mode.pBits[0], mode.pBits[1]);
+    for (uint8_t &index : mode.indices)
+      index = static_cast<uint8_t>(15 - index);
+  }
+
+  memset(out, 0, 16);
+  BitWriter bits = {out};
+  bits.write(1 << 6, 7); // mode 6
+  for (int c = 0; c < 4; c++) {
+    bits.write(mode.endpoints[0][c], 7);
+    bits.write(mode.endpoints[1][c], 7);
+  }
+  bits.write(mode.pBits[0], 1);
+  bits.write(mode.pBits[1], 1);
+  bits.write(mode.indices[0], 3);
+  for (int i = 1; i < 16; i++)
+    bits.write(mode.indices[i], 4);
+}
+#pragma endregion
+
+// Block at (`blockX`, `blockY`), texels past the right or bottom edge repeat the last column or row.
+inline void loadBlock(const unsigned char *rgba, int width, int height, int blockX, int blockY, TexelBlock &block) {
+  for (int y = 0; y < 4; y++) {
+    int sourceY = std::min(blockY * 4 + y, height - 1);
+    for (int x = 0; x < 4; x++) {
+      int sourceX = std::min(blockX * 4 + x, width - 1);
+      memcpy(block.rgba[y * 4 + x], rgba + (static_cast<size_t>(sourceY) * width + sourceX) * 4, 4);
+    }
+  }
+}
+
+} // namespace bc_encoder_detail
+
+inline void encodeBlock(BlockFormat format, const TexelBlock &block, uint8_t *out) {
+  using namespace bc_encoder_detail;
+  switch (format) {
+  case BC1:
+    encodeBC1Color(block, out);
+    break;
+  case BC3:
+    encodeBC3Alpha(block, out);
+    encodeBC1Color(block, out + 8);
+    break;
+  case BC7:
+    encodeBC7(block, out);
+    break;
+  }
+}
+
+/* Compress one RGBA8 image into `out`, which must hold `compressedLevelSize(format, width, height)` bytes.
+ * Rows of blocks are independent and spread over `threadCount` threads (all cores when 0). */
+inline void compressImage(BlockFormat format, const unsigned char *rgba, int width, int height, unsigned char *out,
+                          unsigned int threadCount = 0) {
+  int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+  size_t rowBytes = static_cast<size_t>(blocksWide) * blockBytes(format);
+
+  std::atomic<int> nextRow(0);
+  auto worker = [&]() {
+    for (int blockY = nextRow++; blockY < blocksHigh; blockY = nextRow++) {
+      TexelBlock block;
+      for (int blockX = 0; blockX < blocksWide; blockX++) {
+        bc_encoder_detail::loadBlock(rgba, width, height, blockX, blockY, block);
+        encodeBlock(format, block, out + blockY * rowBytes + blockX * blockBytes(format));
+      }
+    }
+  };
+
+  if (threadCount == 0)
+    threadCount = std::max(1u, std::thread::hardware_concurrency());
+  threadCount = std::min<unsigned int>(threadCount, blocksHigh);
+  std::vector<std::thread> threads;
+  for (unsigned int i = 1; i < threadCount; i++)
+    threads.emplace_back(worker);
+  worker();
+  for (std::thread &thread : threads)
+    thread.join();
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "camera.hpp"
+#include "scene.hpp"
+#ifdef LEARNOPENGL_HEADLESS
+#include "headless.hpp"
+#endif
+
+/* Frame-time benchmark.
+ * Drives the same render loop as the app for a fixed number of frames along a scripted camera path and prints
+ * frame time statistics, CPU time per phase and draws/sec as JSON, so results of two builds can be diffed. */
+
+const unsigned int SCR_WIDTH = 800;
+const unsigned int SCR_HEIGHT = 600;
+
+using Clock = std::chrono::steady_clock;
+
+enum Phase { POLL, INPUT, UNIFORM_UPLOAD, DRAW, SWAP, PHASE_COUNT };
+const char *const phaseNames[PHASE_COUNT] = {"poll", "input", "uniform_upload", "draw", "swap"};
+
+struct BenchmarkOptions {
+  bool headless = false;
+  int frames = 1000;
+  int warmupFrames = 60;         // rendered but not recorded, lets driver caches and clocks settle
+  int instances = 1;             // number of cubes in the scene
+  DrawMode drawMode = INSTANCED; // one instanced draw, or one draw per cube to compare against
+  VertexFormat vertexFormat = FLOAT_VERTICES;
+  const char *jsonPath = NULL;   // stdout when not set
+};
+
+// GL calls issued and skipped by the scene's state cache, summed over the recorded frames.
+struct StateCallTotals {
+  unsigned long long issued = 0;
+  unsigned long long elided = 0;
+};
+
+struct Statistics {
+  double min = 0, median = 0, p99 = 0, mean = 0, max = 0, total = 0;
+
+  explicit Statistics(std::vector<double> samples) {
+    if (samples.empty())
+      return;
+    std::sort(samples.begin(), samples.end());
+    for (double sample : samples)
+      total += sample;
+    min = samples.front();
+    max = samples.back();
+    mean = total / samples.size();
+    median = percentile(samples, 0.5);
+    p99 = percentile(samples, 0.99);
+  }
+
+private:
+  // Nearest-rank percentile of sorted samples.
+  static double percentile(const std::vector<double> &sorted, double fraction) {
+    size_t rank = static_cast<size_t>(std::ceil(fraction * sorted.size()));
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+  }
+};
+
+BenchmarkOptions parseOptions(int argc, char *argv[]);
+GLFWwindow *setupWindow();
+void scriptedInput(Camera &camera, int frame, float deltaTime);
+void writeJson(std::ostream &out, const BenchmarkOptions &options, const std::vector<double> &frameTimes,
+               const std::vector<double> (&phaseTimes)[PHASE_COUNT], unsigned long long drawCalls,
+               const StateCallTotals &stateCalls, const std::vector<ImageArenaStatistics> &textureDecodes);
+
+double millisecondsBetween(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char *argv[]) {
+  BenchmarkOptions options = parseOptions(argc, argv);
+
+  GLFWwindow *window = NULL;
+#ifdef LEARNOPENGL_HEADLESS
+  std::unique_ptr<HeadlessContext> headlessContext;
+  std::unique_ptr<OffscreenTarget> offscreenTarget;
+#endif
+
+  if (options.headless) {
+#ifdef LEARNOPENGL_HEADLESS
+    headlessContext = std::make_unique<HeadlessContext>(4, 5);
+    if (!headlessContext->isValid() || !gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress)) {
+      std::cerr << "Failed to create headless OpenGL context" << std::endl;
+      return -1;
+    }
+    offscreenTarget = std::make_unique<OffscreenTarget>(SCR_WIDTH, SCR_HEIGHT);
+    offscreenTarget->bind();
+#else
+    std::cerr << "Headless mode is not available, configure with -DLEARNOPENGL_HEADLESS=ON" << std::endl;
+    return -1;
+#endif
+  } else {
+    window = setupWindow();
+    if (window == NULL)
+      return -1;
+  }
+
+  float aspectRatio = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+  auto scene = std::make_unique<Scene>(options.vertexFormat);
+  if (options.instances > 1)
+    scene->setInstances(makeInstanceGrid(options.instances));
+  scene->drawMode = options.drawMode;
+  // Frames with the placeholder texture would not be comparable, so wait for the real ones.
+  scene->textureCache.loader.finish();
+  Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
+
+  // Fixed time step, so the camera path does not depend on how fast the frames are.
+  const float deltaTime = 1.0f / 60.0f;
+
+  std::vector<double> frameTimes;
+  std::vector<double> phaseTimes[PHASE_COUNT];
+  frameTimes.reserve(options.frames);
+  for (std::vector<double> &times : phaseTimes)
+    times.reserve(options.frames);
+  unsigned long long drawCalls = 0;
+  StateCallTotals stateCalls;
+
+  for (int frame = -options.warmupFrames; frame < options.frames; frame++) {
+    Clock::time_point marks[PHASE_COUNT + 1];
+    marks[POLL] = Clock::now();
+
+    if (window)
+      glfwPollEvents();
+    marks[INPUT] = Clock::now();
+
+    scriptedInput(camera, frame + options.warmupFrames, deltaTime);
+    marks[UNIFORM_UPLOAD] = Clock::now();
+
+    scene->state.beginFrame();
+    scene->uploadUniforms(camera, aspectRatio);
+    marks[DRAW] = Clock::now();
+
+    scene->clear();
+    unsigned int frameDrawCalls = scene->draw();
+    marks[SWAP] = Clock::now();
+
+    // Without a swap chain nothing throttles the CPU, so wait for the GPU instead to keep frames comparable.
+    if (window)
+      glfwSwapBuffers(window);
+    else
+      glFinish();
+    marks[PHASE_COUNT] = Clock::now();
+
+    if (frame < 0)
+      continue;
+    drawCalls += frameDrawCalls;
+    stateCalls.issued += scene->state.frame.issued;
+    stateCalls.elided += scene->state.frame.elided;
+    frameTimes.push_back(millisecondsBetween(marks[0], marks[PHASE_COUNT]));
+    for (int phase = 0; phase < PHASE_COUNT; phase++)
+      phaseTimes[phase].push_back(millisecondsBetween(marks[phase], marks[phase + 1]));
+  }
+
+  std::vector<ImageArenaStatistics> textureDecodes = {scene->texture0->decodeAllocations,
+                                                      scene->texture1->decodeAllocations};
+  if (options.jsonPath) {
+    std::ofstream file(options.jsonPath);
+    writeJson(file, options, frameTimes, phaseTimes, drawCalls, stateCalls, textureDecodes);
+  } else {
+    writeJson(std::cout, options, frameTimes, phaseTimes, drawCalls, stateCalls, textureDecodes);
+  }
+
+  // GL objects have to be deleted before the context goes away.
+  scene.reset();
+  glfwTerminate();
+  return 0;
+}
+
+BenchmarkOptions parseOptions(int argc, char *argv[]) {
+  BenchmarkOptions options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0)
+      options.headless = true;
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      options.frames = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--warmup") == 0 && i + 1 < argc)
+      options.warmupFrames = std::max(0, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+      options.instances = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--packed-vertices") == 0)
+      options.vertexFormat = PACKED_VERTICES;
+    else if (strcmp(argv[i], "--per-object") == 0)
+      options.drawMode = PER_OBJECT;
+    else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+      options.jsonPath = argv[++i];
+    else
+      std::cerr << "Ignoring unknown option " << argv[i] << std::endl;
+  }
+  return options;
+}
+
+GLFWwindow *setupWindow() {
+  if (!glfwInit()) {
+    std::cerr << "Failed to initialize glfw" << std::endl;
+    return NULL;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+  GLFWwindow *window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "LearnOpenGL Benchmark", NULL, NULL);
+  if (window == NULL) {
+    std::cerr << "Failed to create glfw window" << std::endl;
+    glfwTerminate();
+    return NULL;
+  }
+  glfwMakeContextCurrent(window);
+
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    std::cerr << "Failed to initialize GLAD" << std::endl;
+    glfwTerminate();
+    return NULL;
+  }
+
+  // Disable vsync, otherwise every frame takes exactly one refresh interval.
+  glfwSwapInterval(0);
+  return window;
+}
+
+// Orbits around the cube while looking at it, with a slow pitch wobble and dolly in/out.
+// Goes through the same Camera methods as the keyboard and mouse callbacks of the app.
+void scriptedInput(Camera &camera, int frame, float deltaTime) {
+  camera.ProcessKeyboard(RIGHT, deltaTime);
+  camera.ProcessKeyboard((frame / 240) % 2 == 0 ? FORWARD : BACKWARD, deltaTime * 0.25f);
+  camera.ProcessMouseMovement(-8.0f, 4.0f * std::sin(frame * 0.02f));
+}
+
+void writeStatistics(std::ostream &out, const Statistics &statistics) {
+  out << "{\"min\": " << statistics.min << ", \"median\": " << statistics.median << ", \"p99\": " << statistics.p99
+      << ", \"mean\": " << statistics.mean << ", \"max\": " << statistics.max << ", \"total\": " << statistics.total
+      << "}";
+}
+
+void writeJson(std::ostream &out, const BenchmarkOptions &options, const std::vector<double> &frameTimes,
+               const std::vector<double> (&phaseTimes)[PHASE_COUNT], unsigned long long drawCalls,
+               const StateCallTotals &stateCalls, const std::vector<ImageArenaStatistics> &textureDecodes) {
+  Statistics frameStatistics(frameTimes);
+  double drawsPerSecond = frameStatistics.total > 0 ? drawCalls * 1000.0 / frameStatistics.total : 0;
+  double objectsPerSecond =
+      frameStatistics.total > 0 ? double(options.instances) * frameTimes.size() * 1000.0 / frameStatistics.total : 0;
+
+  out << std::fixed << std::setprecision(4);
+  out << "{\n";
+  out << "  \"mode\": \"" << (options.headless ? "headless" : "window") << "\",\n";
+  out << "  \"renderer\": \"" << reinterpret_cast<const char *>(glGetString(GL_RENDERER)) << "\",\n";
+  out << "  \"resolution\": [" << SCR_WIDTH << ", " << SCR_HEIGHT << "],\n";
+  out << "  \"instances\": " << options.instances << ",\n";
+  out << "  \"draw_mode\": \"" << (options.drawMode == INSTANCED ? "instanced" : "per_object") << "\",\n";
+  out << "  \"vertex_format\": \"" << (options.vertexFormat == PACKED_VERTICES ? "packed" : "float") << "\",\n";
+  out << "  \"frames\": " << frameTimes.size() << ",\n";
+  out << "  \"warmup_frames\": " << options.warmupFrames << ",\n";
+  out << "  \"frame_time_ms\": ";
+  writeStatistics(out, frameStatistics);
+  out << ",\n";
+  out << "  \"phase_cpu_time_ms\": {\n";
+  for (int phase = 0; phase < PHASE_COUNT; phase++) {
+    out << "    \"" << phaseNames[phase] << "\": ";
+    writeStatistics(out, Statistics(phaseTimes[phase]));
+    out << (phase + 1 < PHASE_COUNT ? ",\n" : "\n");
+  }
+  out << "  },\n";
+  out << "  \"draw_calls\": " << drawCalls << ",\n";
+  out << "  \"draws_per_second\": " << drawsPerSecond << ",\n";
+  double frameCount = std::max<size_t>(frameTimes.size(), 1);
+  out << "  \"state_calls_per_frame\": {\"issued\": " << stateCalls.issued / frameCount
+      << ", \"elided\": " << stateCalls.elided / frameCount << "},\n";
+  // What stb_image allocated from the loader's arenas for each texture.
+  out << "  \"texture_decode_allocations\": [";
+  for (size_t i = 0; i < textureDecodes.size(); i++) {
+    const ImageArenaStatistics &decode = textureDecodes[i];
+    out << (i ? ", " : "") << "{\"allocations\": " << decode.allocations
+        << ", \"reallocations\": " << decode.reallocations << ", \"grown_in_place\": " << decode.grownInPlace
+        << ", \"heap_allocations\": " << decode.heapAllocations << ", \"peak_bytes\": " << decode.peakBytes << "}";
+  }
+  out << "],\n";
+  out << "  \"objects_per_second\": " << objectsPerSecond << "\n";
+  out << "}" << std::endl;
+}
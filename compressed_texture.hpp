@@ -0,0 +1,410 @@
+#ifndef COMPRESSED_TEXTURE_HPP
+#define COMPRESSED_TEXTURE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "mipmap.hpp"
+
+// S3TC is an extension (EXT_texture_compression_s3tc), a core profile loader does not necessarily define its enums.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_SRGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_SRGB_S3TC_DXT1_EXT 0x8C4C
+#endif
+#ifndef GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT 0x8C4F
+#endif
+
+/* Block compressed textures stored in KTX2 or DDS files.
+ * Every format here encodes 4x4 texel blocks in a fixed number of bytes, which the GPU decodes on the fly when
+ * sampling, so the texture stays compressed in video memory and in the texture cache:
+ *   BC1 (DXT1)  8 bytes per block, RGB          4 bits per texel, 1/6 of RGB8
+ *   BC3 (DXT5) 16 bytes per block, RGB + alpha  8 bits per texel, 1/4 of RGBA8
+ *   BC7        16 bytes per block, RGBA         8 bits per texel, much better quality than BC3
+ * Files contain the whole mip chain, which cannot be generated on the GPU for compressed formats. They are produced
+ * offline by the texture compressor tool (texture_compressor.cpp), already flipped to OpenGL's bottom-up row order. */
+
+enum BlockFormat { BC1, BC3, BC7 };
+
+struct CompressedLevel {
+  int width, height;
+  size_t offset, size; // into `CompressedImage::data`
+};
+
+struct CompressedImage {
+  BlockFormat format = BC1;
+  bool srgb = false;
+  int width = 0, height = 0;
+  std::vector<CompressedLevel> levels; // largest first
+  std::vector<unsigned char> data;
+};
+
+inline int blockBytes(BlockFormat format) { return format == BC1 ? 8 : 16; }
+
+inline size_t compressedLevelSize(BlockFormat format, int width, int height) {
+  return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+inline GLenum glInternalFormat(BlockFormat format, bool srgb) {
+  switch (format) {
+  case BC1:
+    return srgb ? GL_COMPRESSED_SRGB_S3TC_DXT1_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+  case BC3:
+    return srgb ? GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+  default:
+    return srgb ? GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL_COMPRESSED_RGBA_BPTC_UNORM;
+  }
+}
+
+// Files the texture loader hands to `loadCompressedImage` instead of stb_image.
+inline bool isCompressedTexturePath(const std::string &path) {
+  auto endsWith = [&path](const char *suffix) {
+    size_t length = strlen(suffix);
+    return path.size() >= length && path.compare(path.size() - length, length, suffix) == 0;
+  };
+  return endsWith(".ktx2") || endsWith(".dds") || endsWith(".KTX2") || endsWith(".DDS");
+}
+
+#pragma region File format constants
+namespace compressed_texture_detail {
+
+const unsigned char KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+const size_t KTX2_HEADER_SIZE = 80; // identifier, header and index, followed by the level index
+
+// VkFormat values used by KTX2.
+const uint32_t VK_FORMAT_BC1_RGB_UNORM_BLOCK = 131, VK_FORMAT_BC1_RGB_SRGB_BLOCK = 132;
+const uint32_t VK_FORMAT_BC1_RGBA_UNORM_BLOCK = 133, VK_FORMAT_BC1_RGBA_SRGB_BLOCK = 134;
+const uint32_t VK_FORMAT_BC3_UNORM_BLOCK = 137, VK_FORMAT_BC3_SRGB_BLOCK = 138;
+const uint32_t VK_FORMAT_BC7_UNORM_BLOCK = 145, VK_FORMAT_BC7_SRGB_BLOCK = 146;
+
+// Khronos data format descriptor color models.
+const uint32_t KHR_DF_MODEL_BC1A = 128, KHR_DF_MODEL_BC3 = 130, KHR_DF_MODEL_BC7 = 134;
+
+const size_t DDS_HEADER_SIZE = 4 + 124, DDS_DX10_HEADER_SIZE = 20;
+const uint32_t DDPF_FOURCC = 0x4;
+const uint32_t DDSD_CAPS = 0x1, DDSD_HEIGHT = 0x2, DDSD_WIDTH = 0x4, DDSD_PIXELFORMAT = 0x1000,
+               DDSD_MIPMAPCOUNT = 0x20000, DDSD_LINEARSIZE = 0x80000;
+const uint32_t DDSCAPS_COMPLEX = 0x8, DDSCAPS_TEXTURE = 0x1000, DDSCAPS_MIPMAP = 0x400000;
+const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+// DXGI_FORMAT values of the DX10 extension header.
+const uint32_t DXGI_FORMAT_BC1_UNORM = 71, DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+const uint32_t DXGI_FORMAT_BC3_UNORM = 77, DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+const uint32_t DXGI_FORMAT_BC7_UNORM = 98, DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+constexpr uint32_t fourCC(char a, char b, char c, char d) {
+  return uint32_t(uint8_t(a)) | uint32_t(uint8_t(b)) << 8 | uint32_t(uint8_t(c)) << 16 | uint32_t(uint8_t(d)) << 24;
+}
+
+// Both formats are little endian.
+inline uint32_t read32(const unsigned char *bytes) {
+  return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+}
+inline uint64_t read64(const unsigned char *bytes) { return read32(bytes) | uint64_t(read32(bytes + 4)) << 32; }
+
+// Larger than any GPU's texture size limit, keeps the level sizes far from overflowing.
+const uint32_t MAX_DIMENSION = 1 << 16;
+
+// Dimensions and level count as stored in a header, checked before anything is sized or shifted by them.
+inline bool checkHeader(uint32_t width, uint32_t height, uint32_t levelCount, const char *container,
+                        std::string &error) {
+  if (width == 0 || height == 0 || width > MAX_DIMENSION || height > MAX_DIMENSION) {
+    error = std::string("invalid ") + container + " size " + std::to_string(width) + "x" + std::to_string(height);
+    return false;
+  }
+  if (levelCount > static_cast<uint32_t>(mipLevelCount(width, height))) {
+    error = std::string("too many ") + container + " levels for the size: " + std::to_string(levelCount);
+    return false;
+  }
+  return true;
+}
+
+inline void write32(std::vector<unsigned char> &out, uint32_t value) {
+  for (int i = 0; i < 4; i++)
+    out.push_back(static_cast<unsigned char>(value >> (8 * i)));
+}
+inline void write64(std::vector<unsigned char> &out, uint64_t value) {
+  write32(out, static_cast<uint32_t>(value));
+  write32(out, static_cast<uint32_t>(value >> 32));
+}
+
+} // namespace compressed_texture_detail
+#pragma endregion
+
+#pragma region Reading
+inline bool parseKTX2(const std::vector<unsigned char> &file, CompressedImage &image, std::string &error) {
+  using namespace compressed_texture_detail;
+  const unsigned char *header = file.data() + sizeof(KTX2_IDENTIFIER);
+  uint32_t vkFormat = read32(header);
+  uint32_t width = read32(header + 8), height = read32(header + 12);
+  uint32_t depth = read32(header + 16), layers = read32(header + 20), faces = read32(header + 24);
+  uint32_t levelCount = std::max<uint32_t>(read32(header + 28), 1);
+  uint32_t supercompression = read32(header + 32);
+
+  switch (vkFormat) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+  case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+    image.format = BC1;
+    break;
+  case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+  case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+    image.format = BC1, image.srgb = true;
+    break;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+  case VK_FORMAT_BC3_SRGB_BLOCK:
+    image.format = BC3, image.srgb = vkFormat == VK_FORMAT_BC3_SRGB_BLOCK;
+    break;
+  case VK_FORMAT_BC7_UNORM_BLOCK:
+  case VK_FORMAT_BC7_SRGB_BLOCK:
+    image.format = BC7, image.srgb = vkFormat == VK_FORMAT_BC7_SRGB_BLOCK;
+    break;
+  default:
+    error = "unsupported KTX2 format " + std::to_string(vkFormat);
+    return false;
+  }
+  if (depth > 1 || layers > 1 || faces != 1 || supercompression != 0) {
+    error = "only plain 2D KTX2 textures without supercompression are supported";
+    return false;
+  }
+  if (!checkHeader(width, height, levelCount, "KTX2", error))
+    return false;
+  image.width = static_cast<int>(width);
+  image.height = static_cast<int>(height);
+  if (file.size() < KTX2_HEADER_SIZE + size_t(levelCount) * 24) {
+    error = "truncated KTX2 level index";
+    return false;
+  }
+
+  // The level index lists level 0 first, the data itself is usually stored smallest level first.
+  const unsigned char *levelIndex = file.data() + KTX2_HEADER_SIZE;
+  size_t dataBegin = SIZE_MAX, dataEnd = 0;
+  for (uint32_t level = 0; level < levelCount; level++) {
+    uint64_t offset = read64(levelIndex + level * 24), length = read64(levelIndex + level * 24 + 8);
+    int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+    if (length != compressedLevelSize(image.format, width, height) || offset > file.size() ||
+        length > file.size() - offset) {
+      error = "invalid KTX2 level " + std::to_string(level);
+      return false;
+    }
+    image.levels.push_back({width, height, static_cast<size_t>(offset), static_cast<size_t>(length)});
+    dataBegin = std::min(dataBegin, static_cast<size_t>(offset));
+    dataEnd = std::max(dataEnd, static_cast<size_t>(offset + length));
+  }
+
+  // Keep only the level data, offsets become relative to it.
+  image.data.assign(file.begin() + dataBegin, file.begin() + dataEnd);
+  for (CompressedLevel &level : image.levels)
+    level.offset -= dataBegin;
+  return true;
+}
+
+inline bool parseDDS(const std::vector<unsigned char> &file, CompressedImage &image, std::string &error) {
+  using namespace compressed_texture_detail;
+  const unsigned char *header = file.data() + 4;
+  uint32_t height = read32(header + 8), width = read32(header + 12);
+  uint32_t levelCount = std::max<uint32_t>(read32(header + 24), 1);
+  const unsigned char *pixelFormat = header + 72;
+  uint32_t pixelFormatFlags = read32(pixelFormat + 4), code = read32(pixelFormat + 8);
+
+  size_t dataOffset = DDS_HEADER_SIZE;
+  bool known = true;
+  if (!(pixelFormatFlags & DDPF_FOURCC)) {
+    known = false;
+  } else if (code == fourCC('D', 'X', 'T', '1')) {
+    image.format = BC1;
+  } else if (code == fourCC('D', 'X', 'T', '5')) {
+    image.format = BC3;
+  } else if (code == fourCC('D', 'X', '1', '0') && file.size() >= DDS_HEADER_SIZE + DDS_DX10_HEADER_SIZE) {
+    dataOffset += DDS_DX10_HEADER_SIZE;
+    uint32_t dxgiFormat = read32(file.data() + DDS_HEADER_SIZE);
+    uint32_t arraySize = read32(file.data() + DDS_HEADER_SIZE + 12);
+    image.srgb = dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB || dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB ||
+                 dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB;
+    if (dxgiFormat == DXGI_FORMAT_BC1_UNORM || dxgiFormat == DXGI_FORMAT_BC1_UNORM_SRGB)
+      image.format = BC1;
+    else if (dxgiFormat == DXGI_FORMAT_BC3_UNORM || dxgiFormat == DXGI_FORMAT_BC3_UNORM_SRGB)
+      image.format = BC3;
+    else if (dxgiFormat == DXGI_FORMAT_BC7_UNORM || dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB)
+      image.format = BC7;
+    else
+      known = false;
+    if (arraySize > 1) {
+      error = "DDS texture arrays are not supported";
+      return false;
+    }
+  } else {
+    known = false;
+  }
+  if (!known) {
+    error = "unsupported DDS pixel format";
+    return false;
+  }
+  if (!checkHeader(width, height, levelCount, "DDS", error))
+    return false;
+  image.width = static_cast<int>(width);
+  image.height = static_cast<int>(height);
+
+  // Levels follow each other, largest first.
+  size_t offset = 0;
+  for (uint32_t level = 0; level < levelCount; level++) {
+    int width = std::max(1, image.width >> level), height = std::max(1, image.height >> level);
+    size_t size = compressedLevelSize(image.format, width, height);
+    image.levels.push_back({width, height, offset, size});
+    offset += size;
+  }
+  if (offset > file.size() - dataOffset) {
+    error = "truncated DDS file";
+    return false;
+  }
+  image.data.assign(file.begin() + dataOffset, file.begin() + dataOffset + offset);
+  return true;
+}
+
+// Read a KTX2 or DDS file, recognized by its signature. On failure `error` says why.
+inline bool loadCompressedImage(const char *path, CompressedImage &image, std::string &error) {
+  using namespace compressed_texture_detail;
+  std::ifstream stream(path, std::ios::binary);
+  if (!stream) {
+    error = "can't open file";
+    return false;
+  }
+  std::vector<unsigned char> file((std::istreambuf_iterator<char>(stream)), std::istreambuf_iterator<char>());
+
+  image = CompressedImage();
+  if (file.size() >= KTX2_HEADER_SIZE && memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0)
+    return parseKTX2(file, image, error);
+  if (file.size() >= DDS_HEADER_SIZE && read32(file.data()) == fourCC('D', 'D', 'S', ' '))
+    return parseDDS(file, image, error);
+  error = "not a KTX2 or DDS file";
+  return false;
+}
+#pragma endregion
+
+#pragma region Writing
+// KTX2 with a basic data format descriptor, levels stored smallest first as the specification recommends.
+inline std::vector<unsigned char> encodeKTX2(const CompressedImage &image) {
+  using namespace compressed_texture_detail;
+  const uint32_t vkFormats[3][2] = {{VK_FORMAT_BC1_RGB_UNORM_BLOCK, VK_FORMAT_BC1_RGB_SRGB_BLOCK},
+                                    {VK_FORMAT_BC3_UNORM_BLOCK, VK_FORMAT_BC3_SRGB_BLOCK},
+                                    {VK_FORMAT_BC7_UNORM_BLOCK, VK_FORMAT_BC7_SRGB_BLOCK}};
+  const uint32_t colorModels[3] = {KHR_DF_MODEL_BC1A, KHR_DF_MODEL_BC3, KHR_DF_MODEL_BC7};
+  uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+  uint32_t bytesPerBlock = blockBytes(image.format);
+
+  // Data format descriptor: one block describing the samples of a texel block.
+  // BC3 has an alpha sample (bits 0-63) and a color sample (bits 64-127), the others a single color sample.
+  std::vector<unsigned char> descriptor;
+  uint32_t sampleCount = image.format == BC3 ? 2 : 1;
+  uint32_t blockSize = 24 + 16 * sampleCount;
+  write32(descriptor, 4 + blockSize);
+  write32(descriptor, 0);                // vendor Khronos, basic descriptor type
+  write32(descriptor, 2 | blockSize << 16); // version 1.3
+  write32(descriptor, colorModels[image.format] | 1 << 8 | (image.srgb ? 2 : 1) << 16); // BT.709, sRGB or linear
+  write32(descriptor, 3 | 3 << 8);       // 4x4 texel blocks
+  write32(descriptor, bytesPerBlock);    // bytes of plane 0
+  write32(descriptor, 0);
+  for (uint32_t sample = 0; sample < sampleCount; sample++) {
+    bool alpha = image.format == BC3 && sample == 0;
+    uint32_t bitOffset = sample * 64, bitLength = (image.format == BC1 || image.format == BC3 ? 64 : 128) - 1;
+    write32(descriptor, bitOffset | bitLength << 16 | (alpha ? 15u : 0u) << 24);
+    write32(descriptor, 0);
+    write32(descriptor, 0);
+    write32(descriptor, 0xFFFFFFFF);
+  }
+
+  size_t levelIndexSize = levelCount * 24;
+  size_t descriptorOffset = KTX2_HEADER_SIZE + levelIndexSize;
+  size_t dataOffset = descriptorOffset + descriptor.size();
+
+  // Level data has to be aligned to the block size (and 4 bytes).
+  std::vector<uint64_t> levelOffsets(levelCount);
+  size_t end = dataOffset;
+  for (int level = levelCount - 1; level >= 0; level--) {
+    end = (end + bytesPerBlock - 1) / bytesPerBlock * bytesPerBlock;
+    levelOffsets[level] = end;
+    end += image.levels[level].size;
+  }
+
+  std::vector<unsigned char> out(KTX2_IDENTIFIER, KTX2_IDENTIFIER + sizeof(KTX2_IDENTIFIER));
+  write32(out, vkFormats[image.format][image.srgb ? 1 : 0]);
+  write32(out, 1); // type size of block compressed formats
+  write32(out, image.width);
+  write32(out, image.height);
+  write32(out, 0); // depth
+  write32(out, 0); // layers
+  write32(out, 1); // faces
+  write32(out, levelCount);
+  write32(out, 0); // no supercompression
+  write32(out, static_cast<uint32_t>(descriptorOffset));
+  write32(out, static_cast<uint32_t>(descriptor.size()));
+  write32(out, 0); // no key/value data
+  write32(out, 0);
+  write64(out, 0); // no supercompression global data
+  write64(out, 0);
+  for (uint32_t level = 0; level < levelCount; level++) {
+    write64(out, levelOffsets[level]);
+    write64(out, image.levels[level].size);
+    write64(out, image.levels[level].size);
+  }
+  out.insert(out.end(), descriptor.begin(), descriptor.end());
+
+  out.resize(end, 0);
+  for (uint32_t level = 0; level < levelCount; level++)
+    memcpy(out.data() + levelOffsets[level], image.data.data() + image.levels[level].offset, image.levels[level].size);
+  return out;
+}
+
+// DDS with the DX10 extension header, which is the only way to store BC7 and sRGB formats.
+inline std::vector<unsigned char> encodeDDS(const CompressedImage &image) {
+  using namespace compressed_texture_detail;
+  const uint32_t dxgiFormats[3][2] = {{DXGI_FORMAT_BC1_UNORM, DXGI_FORMAT_BC1_UNORM_SRGB},
+                                      {DXGI_FORMAT_BC3_UNORM, DXGI_FORMAT_BC3_UNORM_SRGB},
+                                      {DXGI_FORMAT_BC7_UNORM, DXGI_FORMAT_BC7_UNORM_SRGB}};
+  uint32_t levelCount = static_cast<uint32_t>(image.levels.size());
+
+  std::vector<unsigned char> out;
+  write32(out, fourCC('D', 'D', 'S', ' '));
+  write32(out, 124);
+  write32(out, DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE);
+  write32(out, image.height);
+  write32(out, image.width);
+  write32(out, static_cast<uint32_t>(image.levels.empty() ? 0 : image.levels[0].size));
+  write32(out, 0); // depth
+  write32(out, levelCount);
+  for (int i = 0; i < 11; i++)
+    write32(out, 0);
+  // Pixel format
+  write32(out, 32);
+  write32(out, DDPF_FOURCC);
+  write32(out, fourCC('D', 'X', '1', '0'));
+  for (int i = 0; i < 5; i++)
+    write32(out, 0);
+  write32(out, DDSCAPS_TEXTURE | (levelCount > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0));
+  for (int i = 0; i < 4; i++)
+    write32(out, 0);
+  // DX10 header
+  write32(out, dxgiFormats[image.format][image.srgb ? 1 : 0]);
+  write32(out, DDS_DIMENSION_TEXTURE2D);
+  write32(out, 0);
+  write32(out, 1); // array size
+  write32(out, 0);
+
+  for (const CompressedLevel &level : image.levels)
+    out.insert(out.end(), image.data.begin() + level.offset, image.data.begin() + level.offset + level.size);
+  return out;
+}
+#pragma endregion
+
+#endif
@@ -0,0 +1,227 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_arena.hpp"
+#include "stb_image.hpp"
+#include "task_pool.hpp"
+
+/* Image decoding benchmark.
+ * Decodes every image of a corpus with stb_image the way the texture loader does (`stbi_load_into` a preallocated
+ * buffer, with stb_image's temporaries in an `ImageArenaScope`) and prints the median time per image as JSON.
+ * Files are read into memory first, so only decoding is measured, not the disk. By default each image is decoded on
+ * a single thread. `--threads 1,2,4,8,16` decodes the corpus once per thread count, large images split over a
+ * `TaskPool` of that many threads like in the loader, and reports the speedup over the first count; `--parallel` is
+ * short for the number of cores. `--jpeg-target-size 256` decodes JPEGs at reduced size like previews are.
+ * `--band-rows 64` decodes in bands of that many rows through `stbi_load_bands` instead, copying each band into the
+ * buffer like a streaming upload would; compare the `peak_bytes` of both.
+ * Run with `LearnOpenGLDecodeBenchmark [--parallel | --threads 1,2,4] [--jpeg-target-size 256] [--band-rows 64]
+ * [--iterations 20] [--json result.json] [image ...]`. */
+
+using Clock = std::chrono::steady_clock;
+
+struct DecodeBenchmarkOptions {
+  std::vector<unsigned int> threadCounts; // empty to decode on the calling thread only
+  int iterations = 20;
+  int jpegTargetSize = 0;      // see stbi_set_jpeg_target_size
+  int bandRows = 0;            // decode with stbi_load_bands when set
+  const char *jsonPath = NULL; // stdout when not set
+  std::vector<std::string> images;
+};
+
+struct EncodedImage {
+  std::string path;
+  std::vector<unsigned char> bytes;
+  int width, height, channels;
+};
+
+struct DecodeResult {
+  const EncodedImage *image;
+  double milliseconds;              // median
+  ImageArenaStatistics allocations; // of the last iteration
+};
+
+struct DecodeRun {
+  unsigned int threads; // 0 when stb_image decodes on the calling thread only
+  std::vector<DecodeResult> results;
+  double totalMilliseconds = 0;
+};
+
+DecodeBenchmarkOptions parseOptions(int argc, char *argv[]);
+DecodeRun decodeCorpus(const std::vector<EncodedImage> &corpus, unsigned int threads,
+                       const DecodeBenchmarkOptions &options);
+void writeJson(std::ostream &out, const DecodeBenchmarkOptions &options, const std::vector<DecodeRun> &runs);
+
+double millisecondsBetween(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// The pool of the run in progress, `stbi_set_parallel_run` only takes a function.
+TaskPool *benchmarkPool = NULL;
+
+void runOnBenchmarkPool(stbi_parallel_task *task, void *data, int count) { benchmarkPool->execute(task, data, count); }
+
+// A `stbi_band_callback` copying each band into the image buffer `user`.
+int copyBand(void *user, int x, int /*y*/, int channels, int row, int rows, const stbi_uc *pixels) {
+  size_t rowBytes = static_cast<size_t>(x) * channels;
+  memcpy(static_cast<stbi_uc *>(user) + row * rowBytes, pixels, rows * rowBytes);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  DecodeBenchmarkOptions options = parseOptions(argc, argv);
+  // Before stbi_info, which reports the reduced size.
+  stbi_set_jpeg_target_size(options.jpegTargetSize);
+
+  std::vector<EncodedImage> corpus;
+  for (const std::string &path : options.images) {
+    std::ifstream file(path, std::ios::binary);
+    EncodedImage image;
+    image.path = path;
+    image.bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (!stbi_info_from_memory(image.bytes.data(), static_cast<int>(image.bytes.size()), &image.width, &image.height,
+                               &image.channels)) {
+      std::cerr << "Failed to load " << path << ": " << stbi_failure_reason() << std::endl;
+      continue;
+    }
+    corpus.push_back(std::move(image));
+  }
+
+  std::vector<DecodeRun> runs;
+  if (options.threadCounts.empty())
+    runs.push_back(decodeCorpus(corpus, 0, options));
+  for (unsigned int threads : options.threadCounts)
+    runs.push_back(decodeCorpus(corpus, threads, options));
+
+  if (options.jsonPath) {
+    std::ofstream file(options.jsonPath);
+    writeJson(file, options, runs);
+  } else {
+    writeJson(std::cout, options, runs);
+  }
+  return 0;
+}
+
+DecodeRun decodeCorpus(const std::vector<EncodedImage> &corpus, unsigned int threads,
+                       const DecodeBenchmarkOptions &options) {
+  DecodeRun run;
+  run.threads = threads;
+  // The decoding thread works on the tasks too, so the pool gets one helper less.
+  std::unique_ptr<TaskPool> pool(threads ? new TaskPool(threads - 1) : NULL);
+  benchmarkPool = pool.get();
+  stbi_set_parallel_run(threads ? runOnBenchmarkPool : NULL);
+
+  for (const EncodedImage &image : corpus) {
+    std::vector<unsigned char> pixels(static_cast<size_t>(image.width) * image.height * image.channels);
+    DecodeResult result;
+    result.image = &image;
+    std::vector<double> times;
+    bool failed = false;
+    for (int i = 0; i < options.iterations && !failed; i++) {
+      Clock::time_point start = Clock::now();
+      ImageArenaScope arena;
+      int width, height, channels;
+      if (options.bandRows)
+        failed = !stbi_load_bands_from_memory(image.bytes.data(), static_cast<int>(image.bytes.size()),
+                                              options.bandRows, copyBand, pixels.data(), &width, &height, &channels,
+                                              image.channels);
+      else
+        failed = !stbi_load_into_from_memory(image.bytes.data(), static_cast<int>(image.bytes.size()), pixels.data(),
+                                             pixels.size(), 0, &width, &height, &channels, image.channels);
+      times.push_back(millisecondsBetween(start, Clock::now()));
+      result.allocations = arena.stats();
+    }
+    if (failed) {
+      std::cerr << "Failed to decode " << image.path << ": " << stbi_failure_reason() << std::endl;
+      continue;
+    }
+    std::sort(times.begin(), times.end());
+    result.milliseconds = times[times.size() / 2];
+    run.totalMilliseconds += result.milliseconds;
+    run.results.push_back(result);
+  }
+
+  stbi_set_parallel_run(NULL);
+  benchmarkPool = NULL;
+  return run;
+}
+
+DecodeBenchmarkOptions parseOptions(int argc, char *argv[]) {
+  DecodeBenchmarkOptions options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--parallel") == 0) {
+      options.threadCounts = {std::max(1u, std::thread::hardware_concurrency())};
+    } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.threadCounts.clear();
+      std::stringstream list(argv[++i]);
+      std::string count;
+      while (std::getline(list, count, ','))
+        options.threadCounts.push_back(std::max(1, atoi(count.c_str())));
+    } else if (strcmp(argv[i], "--jpeg-target-size") == 0 && i + 1 < argc) {
+      options.jpegTargetSize = std::max(0, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--band-rows") == 0 && i + 1 < argc) {
+      options.bandRows = std::max(0, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) {
+      options.iterations = std::max(1, atoi(argv[++i]));
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      options.jsonPath = argv[++i];
+    } else {
+      options.images.push_back(argv[i]);
+    }
+  }
+  // Paths are relative to the build output directory, like the app's.
+  if (options.images.empty())
+    options.images = {"../../images/container.png", "../../images/awesomeface.png"};
+  return options;
+}
+
+void writeJson(std::ostream &out, const DecodeBenchmarkOptions &options, const std::vector<DecodeRun> &runs) {
+  out << std::fixed << std::setprecision(4);
+  out << "{\n";
+  out << "  \"cores\": " << std::max(1u, std::thread::hardware_concurrency()) << ",\n";
+  out << "  \"iterations\": " << options.iterations << ",\n";
+  out << "  \"jpeg_target_size\": " << options.jpegTargetSize << ",\n";
+  out << "  \"band_rows\": " << options.bandRows << ",\n";
+  out << "  \"runs\": [\n";
+  for (size_t r = 0; r < runs.size(); r++) {
+    const DecodeRun &run = runs[r];
+    double totalPixels = 0;
+    out << "    {\n";
+    out << "      \"threads\": " << std::max(1u, run.threads) << ",\n";
+    out << "      \"parallel\": " << (run.threads ? "true" : "false") << ",\n";
+    out << "      \"images\": [\n";
+    for (size_t i = 0; i < run.results.size(); i++) {
+      const DecodeResult &result = run.results[i];
+      const EncodedImage &image = *result.image;
+      double pixels = double(image.width) * image.height;
+      totalPixels += pixels;
+      out << "        {\"path\": \"" << image.path << "\", \"size\": [" << image.width << ", " << image.height
+          << "], \"channels\": " << image.channels << ", \"file_bytes\": " << image.bytes.size()
+          << ", \"decode_ms\": " << result.milliseconds
+          << ", \"megapixels_per_second\": " << pixels / 1000.0 / result.milliseconds
+          << ", \"allocations\": " << result.allocations.allocations + result.allocations.reallocations
+          << ", \"peak_bytes\": " << result.allocations.peakBytes << "}"
+          << (i + 1 < run.results.size() ? ",\n" : "\n");
+    }
+    out << "      ],\n";
+    out << "      \"total_decode_ms\": " << run.totalMilliseconds << ",\n";
+    out << "      \"megapixels_per_second\": "
+        << (run.totalMilliseconds > 0 ? totalPixels / 1000.0 / run.totalMilliseconds : 0) << ",\n";
+    // Relative to the first run, e.g. 1 thread in `--threads 1,2,4,8,16`.
+    out << "      \"speedup\": "
+        << (run.totalMilliseconds > 0 ? runs[0].totalMilliseconds / run.totalMilliseconds : 0) << "\n";
+    out << "    }" << (r + 1 < runs.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n";
+  out << "}" << std::endl;
+}
@@ -0,0 +1,130 @@
+#ifndef GL_RESOURCES_HPP
+#define GL_RESOURCES_HPP
+
+#include <algorithm>
+#include <utility>
+
+#include <glad/glad.h>
+
+#include "mipmap.hpp"
+
+/* Thin owners for OpenGL objects, built on Direct State Access (OpenGL 4.5).
+ * With DSA an object is edited through its name (`glNamedBufferStorage(buffer, ...)`) instead of being bound to a
+ * target first (`glBindBuffer` + `glBufferData`), so setup code does not disturb the bindings the renderer relies on.
+ * Storage is immutable (`glNamedBufferStorage`, `glTextureStorage2D`): size and format are fixed at creation, so the
+ * driver never has to revalidate or reallocate the object when it is used for drawing.
+ * Each class owns its object, deletes it in the destructor and can be moved but not copied. */
+
+class Buffer {
+public:
+  unsigned int ID = 0;
+
+  Buffer() = default;
+
+  // `flags` are the glNamedBufferStorage flags, 0 for data the CPU never touches again.
+  Buffer(GLsizeiptr size, const void *data, GLbitfield flags = 0) {
+    glCreateBuffers(1, &ID);
+    glNamedBufferStorage(ID, size, data, flags);
+  }
+
+  ~Buffer() { glDeleteBuffers(1, &ID); }
+
+  Buffer(Buffer &&other) noexcept : ID(std::exchange(other.ID, 0)) {}
+  Buffer &operator=(Buffer &&other) noexcept {
+    std::swap(ID, other.ID);
+    return *this;
+  }
+  Buffer(const Buffer &) = delete;
+  Buffer &operator=(const Buffer &) = delete;
+};
+
+class VertexArray {
+public:
+  unsigned int ID = 0;
+
+  VertexArray() { glCreateVertexArrays(1, &ID); }
+
+  ~VertexArray() { glDeleteVertexArrays(1, &ID); }
+
+  VertexArray(VertexArray &&other) noexcept : ID(std::exchange(other.ID, 0)) {}
+  VertexArray &operator=(VertexArray &&other) noexcept {
+    std::swap(ID, other.ID);
+    return *this;
+  }
+  VertexArray(const VertexArray &) = delete;
+  VertexArray &operator=(const VertexArray &) = delete;
+
+  void setElementBuffer(const Buffer &buffer) { glVertexArrayElementBuffer(ID, buffer.ID); }
+
+  // Attributes read from a vertex buffer binding point, not from a buffer directly.
+  void setVertexBuffer(unsigned int binding, const Buffer &buffer, GLintptr offset, GLsizei stride) {
+    glVertexArrayVertexBuffer(ID, binding, buffer.ID, offset, stride);
+  }
+
+  // Float attribute, `normalized` maps integer types to [0, 1] / [-1, 1].
+  void setAttribute(unsigned int location, unsigned int binding, int size, GLenum type, bool normalized,
+                    unsigned int relativeOffset) {
+    glEnableVertexArrayAttrib(ID, location);
+    glVertexArrayAttribFormat(ID, location, size, type, normalized ? GL_TRUE : GL_FALSE, relativeOffset);
+    glVertexArrayAttribBinding(ID, location, binding);
+  }
+};
+
+class Texture2D {
+public:
+  unsigned int ID = 0;
+  int Width = 0, Height = 0, Levels = 0;
+
+  Texture2D() = default;
+
+  // Allocates every level down to 1x1 when `levels` is 0.
+  Texture2D(GLenum internalFormat, int width, int height, int levels = 0) : Width(width), Height(height) {
+    Levels = levels > 0 ? levels : mipLevelCount(width, height);
+    glCreateTextures(GL_TEXTURE_2D, 1, &ID);
+    glTextureStorage2D(ID, Levels, internalFormat, width, height);
+  }
+
+  ~Texture2D() { glDeleteTextures(1, &ID); }
+
+  Texture2D(Texture2D &&other) noexcept
+      : ID(std::exchange(other.ID, 0)), Width(other.Width), Height(other.Height), Levels(other.Levels) {}
+  Texture2D &operator=(Texture2D &&other) noexcept {
+    std::swap(ID, other.ID);
+    std::swap(Width, other.Width);
+    std::swap(Height, other.Height);
+    std::swap(Levels, other.Levels);
+    return *this;
+  }
+  Texture2D(const Texture2D &) = delete;
+  Texture2D &operator=(const Texture2D &) = delete;
+
+  // Tightly packed rows, whatever their length.
+  void upload(int level, GLenum format, GLenum type, const void *pixels) {
+    uploadRows(level, 0, std::max(1, Height >> level), format, type, pixels);
+  }
+
+  // Rows [y, y + rows) of a level. With a buffer bound to GL_PIXEL_UNPACK_BUFFER, `pixels` is an offset into it.
+  void uploadRows(int level, int y, int rows, GLenum format, GLenum type, const void *pixels) {
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTextureSubImage2D(ID, level, 0, y, std::max(1, Width >> level), rows, format, type, pixels);
+  }
+
+  // Block compressed rows: `y` and `rows` are in texels and multiples of 4, except for the last rows of a level.
+  void uploadCompressedRows(int level, int y, int rows, GLenum internalFormat, GLsizei size, const void *data) {
+    glCompressedTextureSubImage2D(ID, level, 0, y, std::max(1, Width >> level), rows, internalFormat, size, data);
+  }
+
+  void generateMipmaps() { glGenerateTextureMipmap(ID); }
+
+  void setWrap(GLenum wrap) {
+    glTextureParameteri(ID, GL_TEXTURE_WRAP_S, wrap);
+    glTextureParameteri(ID, GL_TEXTURE_WRAP_T, wrap);
+  }
+
+  void setFilter(GLenum minFilter, GLenum magFilter) {
+    glTextureParameteri(ID, GL_TEXTURE_MIN_FILTER, minFilter);
+    glTextureParameteri(ID, GL_TEXTURE_MAG_FILTER, magFilter);
+  }
+};
+
+#endif
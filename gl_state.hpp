@@ -0,0 +1,127 @@
+#ifndef GL_STATE_HPP
+#define GL_STATE_HPP
+
+#include <glad/glad.h>
+
+/* Shadow copy of the GL state the renderer changes while drawing.
+ * Every setter compares against the value it last set and only calls into the driver when it differs, so code can
+ * state what it needs before each draw ("this program, this VAO, these textures") without paying for calls that
+ * would not change anything. The driver validates state lazily at draw time, but every call still costs a trip
+ * through the API layer, and with many objects per frame those redundant calls add up.
+ * All changes to the tracked state have to go through the cache. If other code touches it directly, call
+ * `invalidate` so the next setter of each kind is issued again. */
+class GLStateCache {
+public:
+  static const int MAX_TEXTURE_UNITS = 16;
+
+  // Calls passed on to the driver and calls skipped because they would not have changed anything.
+  struct Counters {
+    unsigned int issued = 0;
+    unsigned int elided = 0;
+  };
+
+  // Counters of the current frame, and of the last one once `beginFrame` has been called.
+  Counters frame, lastFrame;
+
+  GLStateCache() { invalidate(); }
+
+  GLStateCache(const GLStateCache &) = delete;
+  GLStateCache &operator=(const GLStateCache &) = delete;
+
+  // Forget everything we know, e.g. after code that does not use the cache changed bindings.
+  void invalidate() {
+    program = UNKNOWN;
+    vertexArray = UNKNOWN;
+    for (unsigned int &texture : textures)
+      texture = UNKNOWN;
+    depthTest = blend = cullFace = UNKNOWN_FLAG;
+    depthFunc = UNKNOWN;
+    depthMask = UNKNOWN_FLAG;
+    blendSource = blendDestination = UNKNOWN;
+  }
+
+  void beginFrame() {
+    lastFrame = frame;
+    frame = Counters();
+  }
+
+  void useProgram(unsigned int id) {
+    if (changed(program, id))
+      glUseProgram(id);
+  }
+
+  void bindVertexArray(unsigned int id) {
+    if (changed(vertexArray, id))
+      glBindVertexArray(id);
+  }
+
+  void bindTextureUnit(unsigned int unit, unsigned int texture) {
+    // Units beyond what we track are passed through unfiltered.
+    if (unit >= MAX_TEXTURE_UNITS) {
+      frame.issued++;
+      glBindTextureUnit(unit, texture);
+      return;
+    }
+    if (changed(textures[unit], texture))
+      glBindTextureUnit(unit, texture);
+  }
+
+  void setDepthTest(bool enabled) { setCapability(GL_DEPTH_TEST, depthTest, enabled); }
+  void setBlend(bool enabled) { setCapability(GL_BLEND, blend, enabled); }
+  void setCullFace(bool enabled) { setCapability(GL_CULL_FACE, cullFace, enabled); }
+
+  void setDepthFunc(GLenum func) {
+    if (changed(depthFunc, func))
+      glDepthFunc(func);
+  }
+
+  void setDepthMask(bool write) {
+    if (changed(depthMask, write ? 1 : 0))
+      glDepthMask(write ? GL_TRUE : GL_FALSE);
+  }
+
+  void setBlendFunc(GLenum source, GLenum destination) {
+    if (blendSource == source && blendDestination == destination) {
+      frame.elided++;
+      return;
+    }
+    frame.issued++;
+    blendSource = source;
+    blendDestination = destination;
+    glBlendFunc(source, destination);
+  }
+
+private:
+  // No GL object name or enum has these values, so the first call after `invalidate` is always issued.
+  static const unsigned int UNKNOWN = ~0u;
+  static const int UNKNOWN_FLAG = -1;
+
+  unsigned int program, vertexArray;
+  unsigned int textures[MAX_TEXTURE_UNITS];
+  int depthTest, blend, cullFace;
+  unsigned int depthFunc;
+  int depthMask;
+  unsigned int blendSource, blendDestination;
+
+  // Record `value` as the current one, returns whether the GL call is needed.
+  template <typename T> bool changed(T &current, T value) {
+    if (current == value) {
+      frame.elided++;
+      return false;
+    }
+    frame.issued++;
+    current = value;
+    return true;
+  }
+
+  void setCapability(GLenum capability, int &current, bool enabled) {
+    if (changed(current, enabled ? 1 : 0)) {
+      if (enabled)
+        glEnable(capability);
+      else
+        glDisable(capability);
+    }
+  }
+};
+
+#endif
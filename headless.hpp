@@ -0,0 +1,164 @@
+#ifndef HEADLESS_HPP
+#define HEADLESS_HPP
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+/* A window-less OpenGL context created through EGL.
+ * On Mesa the surfaceless platform (EGL_MESA_platform_surfaceless) gives us a context without any display server,
+ * and with `LIBGL_ALWAYS_SOFTWARE=1` it runs on llvmpipe, so the renderer works on GPU-less Linux hosts.
+ * If the driver does not support surfaceless contexts we fall back to a tiny pbuffer surface, since all rendering
+ * goes into an `OffscreenTarget` anyway. */
+class HeadlessContext {
+public:
+  EGLDisplay Display = EGL_NO_DISPLAY;
+  EGLContext Context = EGL_NO_CONTEXT;
+  EGLSurface Surface = EGL_NO_SURFACE;
+
+  HeadlessContext(int major, int minor) {
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+      auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+      if (getPlatformDisplay)
+        Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    }
+    if (Display == EGL_NO_DISPLAY)
+      Display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (Display == EGL_NO_DISPLAY || !eglInitialize(Display, NULL, NULL)) {
+      std::cerr << "ERROR::EGL::DISPLAY_INITIALIZATION_FAILED" << std::endl;
+      Display = EGL_NO_DISPLAY;
+      return;
+    }
+
+    bool surfaceless = hasExtension(eglQueryString(Display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+    EGLint configAttributes[] = {EGL_SURFACE_TYPE, surfaceless ? 0 : EGL_PBUFFER_BIT,
+                                 EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                 EGL_NONE};
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(Display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0) {
+      std::cerr << "ERROR::EGL::NO_MATCHING_CONFIG" << std::endl;
+      return;
+    }
+
+    // Desktop OpenGL instead of the default OpenGL ES.
+    eglBindAPI(EGL_OPENGL_API);
+
+    EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION, major,
+                                  EGL_CONTEXT_MINOR_VERSION, minor,
+                                  EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                  EGL_NONE};
+    Context = eglCreateContext(Display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (Context == EGL_NO_CONTEXT) {
+      std::cerr << "ERROR::EGL::CONTEXT_CREATION_FAILED" << std::endl;
+      return;
+    }
+
+    if (!surfaceless) {
+      EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+      Surface = eglCreatePbufferSurface(Display, config, pbufferAttributes);
+    }
+
+    if (!eglMakeCurrent(Display, Surface, Surface, Context)) {
+      std::cerr << "ERROR::EGL::MAKE_CURRENT_FAILED" << std::endl;
+      eglDestroyContext(Display, Context);
+      Context = EGL_NO_CONTEXT;
+    }
+  }
+
+  ~HeadlessContext() {
+    if (Display == EGL_NO_DISPLAY)
+      return;
+    eglMakeCurrent(Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (Surface != EGL_NO_SURFACE)
+      eglDestroySurface(Display, Surface);
+    if (Context != EGL_NO_CONTEXT)
+      eglDestroyContext(Display, Context);
+    eglTerminate(Display);
+  }
+
+  HeadlessContext(const HeadlessContext &) = delete;
+  HeadlessContext &operator=(const HeadlessContext &) = delete;
+
+  bool isValid() const { return Context != EGL_NO_CONTEXT; }
+
+  // Same role as `glfwGetProcAddress`, for `gladLoadGLLoader`.
+  static void *getProcAddress(const char *name) { return (void *)eglGetProcAddress(name); }
+
+private:
+  static bool hasExtension(const char *extensions, const char *name) {
+    if (!extensions)
+      return false;
+    size_t length = strlen(name);
+    for (const char *start = extensions; (start = strstr(start, name)) != NULL; start += length) {
+      // Make sure we matched a whole word and not just a prefix of a longer extension name.
+      bool atStart = start == extensions || start[-1] == ' ';
+      bool atEnd = start[length] == ' ' || start[length] == '\0';
+      if (atStart && atEnd)
+        return true;
+    }
+    return false;
+  }
+};
+
+/* Framebuffer object with a color and a depth attachment.
+ * Without a window there is no default framebuffer, so the scene is rendered into this instead. */
+class OffscreenTarget {
+public:
+  unsigned int FBO = 0, colorRBO = 0, depthRBO = 0;
+  int Width, Height;
+
+  OffscreenTarget(int width, int height) : Width(width), Height(height) {
+    glCreateFramebuffers(1, &FBO);
+    glCreateRenderbuffers(1, &colorRBO);
+    glCreateRenderbuffers(1, &depthRBO);
+
+    glNamedRenderbufferStorage(colorRBO, GL_RGBA8, width, height);
+    glNamedRenderbufferStorage(depthRBO, GL_DEPTH24_STENCIL8, width, height);
+
+    glNamedFramebufferRenderbuffer(FBO, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorRBO);
+    glNamedFramebufferRenderbuffer(FBO, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthRBO);
+    if (glCheckNamedFramebufferStatus(FBO, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+      std::cerr << "ERROR::FRAMEBUFFER::INCOMPLETE" << std::endl;
+  }
+
+  ~OffscreenTarget() {
+    glDeleteFramebuffers(1, &FBO);
+    glDeleteRenderbuffers(1, &colorRBO);
+    glDeleteRenderbuffers(1, &depthRBO);
+  }
+
+  OffscreenTarget(const OffscreenTarget &) = delete;
+  OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+  void bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+    glViewport(0, 0, Width, Height);
+  }
+
+  // Write the color attachment as a binary PPM, so a frame can be compared against a reference image.
+  bool savePPM(const char *path) const {
+    std::vector<unsigned char> pixels(static_cast<size_t>(Width) * Height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, FBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, Width, Height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file)
+      return false;
+    file << "P6\n" << Width << " " << Height << "\n255\n";
+    // OpenGL's origin is the bottom-left corner, PPM's is the top-left one.
+    for (int row = Height - 1; row >= 0; row--)
+      file.write(reinterpret_cast<const char *>(pixels.data()) + static_cast<size_t>(row) * Width * 3, Width * 3);
+    return static_cast<bool>(file);
+  }
+};
+
+#endif
@@ -0,0 +1,220 @@
+#ifndef IMAGE_ARENA_HPP
+#define IMAGE_ARENA_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+/* Bump allocator behind stb_image's STBI_MALLOC, STBI_REALLOC_SIZED and STBI_FREE (hooked up in stb_image.cpp).
+ * A single decode makes dozens of allocations: the zlib output buffer that doubles in `stbi__zexpand`, the PNG IDAT
+ * buffer and filter rows, JPEG's component planes and line buffers. When several loader threads decode at once all of
+ * them go through the global heap, where they contend for its locks and fragment it with short lived blocks.
+ * While an `ImageArenaScope` is alive on a thread, stb_image allocates from that thread's arena instead:
+ *   - allocating moves a pointer forward in a large block,
+ *   - freeing or growing the newest allocation happens in place, which is how the zlib buffer grows,
+ *   - everything else is only released when the scope ends, all at once.
+ * The arena keeps its memory for the next image, so a thread that decodes images of similar size stops touching the
+ * heap after the first one.
+ * Outside of a scope stb_image uses malloc as before. Memory that stb_image returns inside a scope, e.g. the pixels
+ * of `stbi_load`, is gone once the scope ends: decode into your own memory with `stbi_load_into`, or copy it out. */
+
+// What one decode asked of the allocator.
+struct ImageArenaStatistics {
+  unsigned int allocations = 0;     // STBI_MALLOC calls
+  unsigned int reallocations = 0;   // STBI_REALLOC_SIZED calls
+  unsigned int grownInPlace = 0;    // reallocations that extended the newest allocation instead of copying it
+  unsigned int frees = 0;           // STBI_FREE calls
+  unsigned int heapAllocations = 0; // blocks the arena had to get from malloc, 0 once it is warm
+  size_t peakBytes = 0;             // most arena memory in use at once
+};
+
+class ImageArena {
+public:
+  static const size_t ALIGNMENT = 16;
+  static const size_t MIN_BLOCK_SIZE = size_t(1) << 20;
+  // Memory kept between scopes, a thread that decoded one huge image should not hold on to all of it.
+  static const size_t RETAINED_BYTES = size_t(64) << 20;
+
+  ImageArena() = default;
+  ImageArena(const ImageArena &) = delete;
+  ImageArena &operator=(const ImageArena &) = delete;
+
+  ~ImageArena() {
+    for (Block &block : blocks)
+      free(block.memory);
+  }
+
+  // The arena stb_image allocates from on this thread, NULL outside of an `ImageArenaScope`.
+  static ImageArena *&active() {
+    thread_local ImageArena *arena = NULL;
+    return arena;
+  }
+
+  static ImageArena &forThisThread() {
+    thread_local ImageArena arena;
+    return arena;
+  }
+
+  void *allocate(size_t size) {
+    statistics.allocations++;
+    size_t aligned = alignUp(std::max<size_t>(size, 1));
+    if ((blocks.empty() || blocks.back().size - blocks.back().used < aligned) && !addBlock(aligned))
+      return NULL; // stb_image reports "outofmem" like it would for malloc
+
+    Block &block = blocks.back();
+    newest = block.memory + block.used;
+    block.used += aligned;
+    inUse += aligned;
+    statistics.peakBytes = std::max(statistics.peakBytes, inUse);
+    return newest;
+  }
+
+  void *reallocate(void *pointer, size_t oldSize, size_t newSize) {
+    if (!pointer)
+      return allocate(newSize);
+    if (!owns(pointer))
+      return realloc(pointer, newSize);
+
+    statistics.reallocations++;
+    Block &block = blocks.back();
+    if (pointer == newest) {
+      size_t offset = newest - block.memory, aligned = alignUp(std::max<size_t>(newSize, 1));
+      if (offset + aligned <= block.size) {
+        statistics.grownInPlace++;
+        inUse += offset + aligned - block.used;
+        block.used = offset + aligned;
+        statistics.peakBytes = std::max(statistics.peakBytes, inUse);
+        return pointer;
+      }
+    }
+    // `allocate` counts itself as an allocation, the call was a reallocation.
+    statistics.allocations--;
+    void *moved = allocate(newSize);
+    if (moved)
+      memcpy(moved, pointer, std::min(oldSize, newSize));
+    return moved;
+  }
+
+  void release(void *pointer) {
+    if (!pointer)
+      return;
+    if (!owns(pointer)) {
+      free(pointer);
+      return;
+    }
+    statistics.frees++;
+    if (pointer == newest) {
+      Block &block = blocks.back();
+      size_t offset = newest - block.memory;
+      inUse -= block.used - offset;
+      block.used = offset;
+      newest = NULL;
+    }
+  }
+
+  // Release every allocation, keep up to `RETAINED_BYTES` of memory for the next scope.
+  void reset() {
+    size_t capacity = 0;
+    for (const Block &block : blocks)
+      capacity += block.size;
+    if (blocks.size() > 1 || capacity > RETAINED_BYTES) {
+      // Next time a single block gets everything this image needed.
+      for (Block &block : blocks)
+        free(block.memory);
+      blocks.clear();
+      nextBlockSize = capacity < RETAINED_BYTES ? capacity : RETAINED_BYTES;
+    } else if (!blocks.empty()) {
+      blocks.back().used = 0;
+    }
+    newest = NULL;
+    inUse = 0;
+    statistics = ImageArenaStatistics();
+  }
+
+  const ImageArenaStatistics &stats() const { return statistics; }
+
+private:
+  struct Block {
+    unsigned char *memory;
+    size_t size, used;
+  };
+
+  std::vector<Block> blocks; // allocations come from the last one
+  unsigned char *newest = NULL;
+  size_t inUse = 0;
+  size_t nextBlockSize = MIN_BLOCK_SIZE;
+  ImageArenaStatistics statistics;
+
+  static size_t alignUp(size_t size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+  bool addBlock(size_t minimumSize) {
+    // Grow geometrically, an image that needs many blocks needs few of them.
+    size_t size = std::max(nextBlockSize, minimumSize);
+    if (!blocks.empty())
+      size = std::max(size, blocks.back().size * 2);
+    Block block = {static_cast<unsigned char *>(malloc(size)), size, 0};
+    if (!block.memory)
+      return false;
+    blocks.push_back(block);
+    nextBlockSize = MIN_BLOCK_SIZE;
+    statistics.heapAllocations++;
+    return true;
+  }
+
+  bool owns(const void *pointer) const {
+    const unsigned char *bytes = static_cast<const unsigned char *>(pointer);
+    for (const Block &block : blocks)
+      if (bytes >= block.memory && bytes < block.memory + block.size)
+        return true;
+    return false;
+  }
+};
+
+/* Routes the stb_image allocations of this thread to its arena while alive, and frees them all when it ends:
+ *   {
+ *     ImageArenaScope arena;
+ *     stbi_load_into(path, pixels, size, 0, &width, &height, &channels, 4);
+ *     ImageArenaStatistics allocations = arena.stats();
+ *   }
+ * Scopes on the same thread do not nest. */
+class ImageArenaScope {
+public:
+  ImageArenaScope() : arena(ImageArena::forThisThread()) { ImageArena::active() = &arena; }
+
+  ~ImageArenaScope() {
+    ImageArena::active() = NULL;
+    arena.reset();
+  }
+
+  ImageArenaScope(const ImageArenaScope &) = delete;
+  ImageArenaScope &operator=(const ImageArenaScope &) = delete;
+
+  // Allocations stb_image made since the scope started.
+  const ImageArenaStatistics &stats() const { return arena.stats(); }
+
+private:
+  ImageArena &arena;
+};
+
+// The STBI_MALLOC, STBI_REALLOC_SIZED and STBI_FREE of stb_image.cpp.
+inline void *imageArenaMalloc(size_t size) {
+  ImageArena *arena = ImageArena::active();
+  return arena ? arena->allocate(size) : malloc(size);
+}
+
+inline void *imageArenaRealloc(void *pointer, size_t oldSize, size_t newSize) {
+  ImageArena *arena = ImageArena::active();
+  return arena ? arena->reallocate(pointer, oldSize, newSize) : realloc(pointer, newSize);
+}
+
+inline void imageArenaFree(void *pointer) {
+  ImageArena *arena = ImageArena::active();
+  if (arena)
+    arena->release(pointer);
+  else
+    free(pointer);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "image_scanner.hpp"
+#include "task_pool.hpp"
+
+/* Image metadata indexer: lists size, channels, bit depth and format of every image below the given directories
+ * (and of the given files) without decoding them, with the texture memory each takes once loaded, as JSON.
+ * See image_scanner.hpp. `--threads 1` probes on the calling thread only, by default every core is used.
+ * Run with `LearnOpenGLImageScanner [--threads 8] [--json index.json] [directory | image ...]`. */
+
+using Clock = std::chrono::steady_clock;
+
+struct ScannerOptions {
+  unsigned int threads = std::max(1u, std::thread::hardware_concurrency());
+  const char *jsonPath = NULL; // stdout when not set
+  std::vector<std::string> inputs;
+};
+
+ScannerOptions parseOptions(int argc, char *argv[]);
+void writeJson(std::ostream &out, const std::vector<ScannedImage> &images, unsigned int threads, double milliseconds);
+std::string jsonString(const std::string &text);
+
+int main(int argc, char *argv[]) {
+  ScannerOptions options = parseOptions(argc, argv);
+
+  Clock::time_point start = Clock::now();
+  std::vector<std::string> paths;
+  for (const std::string &input : options.inputs) {
+    std::error_code error;
+    if (std::filesystem::is_directory(input, error)) {
+      std::vector<std::string> listed = listImageFiles(input);
+      paths.insert(paths.end(), listed.begin(), listed.end());
+    } else {
+      paths.push_back(input);
+    }
+  }
+  // The probing thread works on the files too, so the pool gets one helper less.
+  TaskPool pool(options.threads - 1);
+  std::vector<ScannedImage> images = scanImages(paths, pool);
+  double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+
+  if (options.jsonPath) {
+    std::ofstream file(options.jsonPath);
+    writeJson(file, images, options.threads, milliseconds);
+  } else {
+    writeJson(std::cout, images, options.threads, milliseconds);
+  }
+  return 0;
+}
+
+ScannerOptions parseOptions(int argc, char *argv[]) {
+  ScannerOptions options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+      options.threads = static_cast<unsigned int>(std::max(1, atoi(argv[++i])));
+    } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+      options.jsonPath = argv[++i];
+    } else {
+      options.inputs.push_back(argv[i]);
+    }
+  }
+  // Paths are relative to the build output directory, like the app's.
+  if (options.inputs.empty())
+    options.inputs = {"../../images"};
+  return options;
+}
+
+void writeJson(std::ostream &out, const std::vector<ScannedImage> &images, unsigned int threads, double milliseconds) {
+  size_t valid = 0, textureBytes = 0;
+  out << "{\n";
+  out << "  \"images\": [\n";
+  for (size_t i = 0; i < images.size(); i++) {
+    const ScannedImage &image = images[i];
+    out << "    {\"path\": " << jsonString(image.path);
+    if (image.valid) {
+      const stbi_image_info &info = image.info;
+      out << ", \"format\": \"" << info.format << "\", \"size\": [" << info.x << ", " << info.y
+          << "], \"channels\": " << info.channels << ", \"bits_per_channel\": " << info.bits_per_channel
+          << ", \"texture_bytes\": " << image.textureBytes;
+      valid++;
+      textureBytes += image.textureBytes;
+    } else {
+      out << ", \"error\": " << jsonString(image.error);
+    }
+    out << "}" << (i + 1 < images.size() ? ",\n" : "\n");
+  }
+  out << "  ],\n";
+  out << "  \"files\": " << images.size() << ",\n";
+  out << "  \"valid\": " << valid << ",\n";
+  out << "  \"texture_bytes\": " << textureBytes << ",\n";
+  out << "  \"threads\": " << threads << ",\n";
+  out << "  \"scan_ms\": " << milliseconds << "\n";
+  out << "}" << std::endl;
+}
+
+// Quoted, with the characters JSON does not allow in strings escaped.
+std::string jsonString(const std::string &text) {
+  std::string quoted = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char escape[8];
+      snprintf(escape, sizeof(escape), "\\u%04x", c);
+      quoted += escape;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
@@ -0,0 +1,86 @@
+#ifndef IMAGE_SCANNER_HPP
+#define IMAGE_SCANNER_HPP
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include "mipmap.hpp"
+#include "stb_image.hpp"
+#include "task_pool.hpp"
+
+/* Image metadata for a whole directory without decoding anything, e.g. to plan how much video memory a set of
+ * textures needs before loading them. Every file is probed with `stbi_probe`, which only reads the start of it, and
+ * the files are spread over a `TaskPool`:
+ *   std::vector<ScannedImage> images = scanImages(listImageFiles("../../images"));
+ * Block compressed KTX2/DDS files are not stb_image's and are not listed. */
+
+struct ScannedImage {
+  std::string path;
+  bool valid = false;
+  std::string error; // stb_image's failure reason when not valid
+  stbi_image_info info = {};
+  size_t textureBytes = 0; // of the texture the loader creates: 8 bits per channel, full mip chain
+};
+
+// Texture memory of an image with all its mip levels, laid out by `layoutMipChain` like the loader's. An estimate from
+// the channel count, drivers may pad RGB8 to 4 bytes per texel.
+inline size_t mipChainBytes(int width, int height, int channels) {
+  MipLevel last = layoutMipChain(width, height, channels).levels.back();
+  return last.offset + last.size;
+}
+
+// Files below `directory` with an extension stb_image reads, sorted. Unreadable directories are skipped.
+inline std::vector<std::string> listImageFiles(const std::string &directory, bool recursive = true) {
+  namespace fs = std::filesystem;
+  static const char *const extensions[] = {".png", ".jpg", ".jpeg", ".bmp", ".tga", ".gif",
+                                           ".psd", ".hdr", ".pic", ".ppm", ".pgm"};
+  std::vector<std::string> paths;
+  auto add = [&paths](const fs::directory_entry &entry) {
+    std::error_code error;
+    if (!entry.is_regular_file(error))
+      return;
+    std::string extension = entry.path().extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(),
+                   [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    if (std::find(std::begin(extensions), std::end(extensions), extension) != std::end(extensions))
+      paths.push_back(entry.path().string());
+  };
+
+  std::error_code error;
+  if (recursive) {
+    for (fs::recursive_directory_iterator it(directory, fs::directory_options::skip_permission_denied, error), end;
+         !error && it != end; it.increment(error))
+      add(*it);
+  } else {
+    for (fs::directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+      add(*it);
+  }
+  std::sort(paths.begin(), paths.end());
+  return paths;
+}
+
+// Probe every file in `paths`, results in the same order. Blocks until all are done.
+inline std::vector<ScannedImage> scanImages(const std::vector<std::string> &paths,
+                                            TaskPool &pool = TaskPool::shared()) {
+  std::vector<ScannedImage> images(paths.size());
+  for (size_t i = 0; i < paths.size(); i++)
+    images[i].path = paths[i];
+
+  // One task per file, the pool hands them out as threads get free, so a few slow files do not hold up the rest.
+  auto probe = [](void *data, int index) {
+    ScannedImage &image = static_cast<ScannedImage *>(data)[index];
+    image.valid = stbi_probe(image.path.c_str(), &image.info) != 0;
+    if (image.valid)
+      image.textureBytes = mipChainBytes(image.info.x, image.info.y, image.info.channels);
+    else
+      image.error = stbi_failure_reason(); // per thread
+  };
+  pool.execute(probe, images.data(), static_cast<int>(images.size()));
+  return images;
+}
+
+#endif
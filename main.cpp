@@ -1,20 +1,23 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include "shader.hpp"
 #include "camera.hpp"
-#include "stb_image.hpp"
+#include "scene.hpp"
+#ifdef LEARNOPENGL_HEADLESS
+#include "headless.hpp"
+#endif
 
 const unsigned int SCR_WIDTH = 800;
 const unsigned int SCR_HEIGHT = 600;
-const char *vertexShaderPath = "../../shaders/vertex_shader.glsl";
-const char *fragmentShaderPath = "../../shaders/fragment_shader.glsl";
-const char *imagePath0 = "../../images/container.png";
-const char *imagePath1 = "../../images/awesomeface.png";
 
 // camera
 Camera camera(glm::vec3(0.0f, 0.0f, 3.0f));
@@ -26,18 +29,137 @@ bool firstMouse = true;
 float deltaTime = 0.0f; // time between current frame and last frame
 float lastFrame = 0.0f;
 
+// command line options
+struct Options {
+  bool headless = false;          // render into an offscreen framebuffer instead of a window
+  int frames = 600;               // number of frames to render in headless mode
+  int instances = 1;              // number of cubes, drawn with one instanced draw call
+  VertexFormat vertexFormat = FLOAT_VERTICES;
+  const char *outputPath = NULL;  // write the last headless frame to this PPM file
+};
+
+Options parseOptions(int argc, char *argv[]);
+GLFWwindow *setupWindow();
 void process_input(GLFWwindow *window);
 void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
-unsigned char *loadImage(const char *file_name, int *width, int *height);
 
-int main() {
+int main(int argc, char *argv[]) {
+  Options options = parseOptions(argc, argv);
+
+  GLFWwindow *window = NULL;
+#ifdef LEARNOPENGL_HEADLESS
+  // Declared before the target, so the framebuffer is deleted while its context is still alive.
+  std::unique_ptr<HeadlessContext> headlessContext;
+  std::unique_ptr<OffscreenTarget> offscreenTarget;
+#endif
+
+  if (options.headless) {
+#ifdef LEARNOPENGL_HEADLESS
+    headlessContext = std::make_unique<HeadlessContext>(4, 5);
+    if (!headlessContext->isValid()) {
+      std::cout << "Failed to create headless OpenGL context" << std::endl;
+      return -1;
+    }
+
+    if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress)) {
+      std::cout << "Failed to initialize GLAD" << std::endl;
+      return -1;
+    }
+
+    offscreenTarget = std::make_unique<OffscreenTarget>(SCR_WIDTH, SCR_HEIGHT);
+    offscreenTarget->bind();
+#else
+    std::cout << "Headless mode is not available, configure with -DLEARNOPENGL_HEADLESS=ON" << std::endl;
+    return -1;
+#endif
+  } else {
+    window = setupWindow();
+    if (window == NULL)
+      return -1;
+  }
+
+  float aspectRatio = (float)SCR_WIDTH / (float)SCR_HEIGHT;
+  auto scene = std::make_unique<Scene>(options.vertexFormat);
+  if (options.instances > 1)
+    scene->setInstances(makeInstanceGrid(options.instances));
+
+  if (options.headless) {
+#ifdef LEARNOPENGL_HEADLESS
+    // Like the benchmark: time rendering only, not decoding and uploading, and save the textures, not the placeholder.
+    scene->textureCache.loader.finish();
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = 0; frame < options.frames; frame++)
+      scene->render(camera, aspectRatio);
+    // Commands are only queued by the loop above, wait for the GPU so the time includes the actual rendering.
+    glFinish();
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << "Rendered " << options.frames << " frames in " << elapsed.count() << " ms ("
+              << elapsed.count() / options.frames << " ms/frame, " << options.frames * 1000.0 / elapsed.count()
+              << " fps)" << std::endl;
+
+    if (options.outputPath && !offscreenTarget->savePPM(options.outputPath))
+      std::cout << "Failed to write " << options.outputPath << std::endl;
+#endif
+  } else {
+    while (!glfwWindowShouldClose(window)) {
+      float currentFrame = static_cast<float>(glfwGetTime());
+      deltaTime = currentFrame - lastFrame;
+      lastFrame = currentFrame;
+
+      /* When an event occurs, GLFW stores it in an internal event queue.
+       * `glfwPollEvents()` is used to process the events in the queue.
+       * Here's what `glfwPollEvents()` does:
+       * 1. Check the event queue: GLFW checks the event queue for pending events.
+       * 2. Process each event: For each event in the queue, GLFW calls the corresponding callback function.
+       * 3. Clear the event queue: After processing all events, GLFW clears the event queue. */
+      glfwPollEvents();
+      process_input(window);
+
+      scene->render(camera, aspectRatio);
+
+      /* In OpenGL, a window typically has two buffers: the front buffer and the back buffer.
+       * The front buffer is the buffer that is currently being displayed on the screen.
+       * The back buffer is the buffer that is being drawn to.
+       * When we call `glfwSwapBuffers(window)` the back buffer becomes the front buffer,
+       * and the front buffer becomes the back buffer. */
+      glfwSwapBuffers(window);
+    }
+  }
+
+  // GL objects have to be deleted before the context goes away.
+  scene.reset();
+  glfwTerminate();
+  return 0;
+}
+
+Options parseOptions(int argc, char *argv[]) {
+  Options options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0)
+      options.headless = true;
+    else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+      options.frames = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--instances") == 0 && i + 1 < argc)
+      options.instances = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--packed-vertices") == 0)
+      options.vertexFormat = PACKED_VERTICES;
+    else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+      options.outputPath = argv[++i];
+    else
+      std::cout << "Ignoring unknown option " << argv[i] << std::endl;
+  }
+  return options;
+}
+
+GLFWwindow *setupWindow() {
 #pragma region Setup GLFW
   // Initialize glfw
   if (!glfwInit()) {
     std::cout << "Failed to initialize glfw" << std::endl;
-    return 0;
+    return NULL;
   }
 
   // Use OpenGL 4.5
@@ -57,7 +179,7 @@ int main() {
   if (window == NULL) {
     std::cout << "Failed to create glfw window" << std::endl;
     glfwTerminate();
-    return -1;
+    return NULL;
   }
 
   /* When you create a GLFW window, it also creates an OpenGL context associated with that window.
@@ -72,7 +194,7 @@ int main() {
   if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
     std::cout << "Failed to initialize GLAD" << std::endl;
     glfwTerminate();
-    return -1;
+    return NULL;
   }
 
   // Set glfw callbacks
@@ -82,166 +204,7 @@ int main() {
   glfwSetScrollCallback(window, scroll_callback);
 #pragma endregion
 
-#pragma region Setup VAO, VBO, EBO
-  float vertices[] = {
-      -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f,  -0.5f, -0.5f, 1.0f, 0.0f, 0.5f,  0.5f,  -0.5f, 1.0f, 1.0f,
-      0.5f,  0.5f,  -0.5f, 1.0f, 1.0f, -0.5f, 0.5f,  -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
-
-      -0.5f, -0.5f, 0.5f,  0.0f, 0.0f, 0.5f,  -0.5f, 0.5f,  1.0f, 0.0f, 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
-      0.5f,  0.5f,  0.5f,  1.0f, 1.0f, -0.5f, 0.5f,  0.5f,  0.0f, 1.0f, -0.5f, -0.5f, 0.5f,  0.0f, 0.0f,
-
-      -0.5f, 0.5f,  0.5f,  1.0f, 0.0f, -0.5f, 0.5f,  -0.5f, 1.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f,  0.0f, 0.0f, -0.5f, 0.5f,  0.5f,  1.0f, 0.0f,
-
-      0.5f,  0.5f,  0.5f,  1.0f, 0.0f, 0.5f,  0.5f,  -0.5f, 1.0f, 1.0f, 0.5f,  -0.5f, -0.5f, 0.0f, 1.0f,
-      0.5f,  -0.5f, -0.5f, 0.0f, 1.0f, 0.5f,  -0.5f, 0.5f,  0.0f, 0.0f, 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-
-      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f,  -0.5f, -0.5f, 1.0f, 1.0f, 0.5f,  -0.5f, 0.5f,  1.0f, 0.0f,
-      0.5f,  -0.5f, 0.5f,  1.0f, 0.0f, -0.5f, -0.5f, 0.5f,  0.0f, 0.0f, -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
-
-      -0.5f, 0.5f,  -0.5f, 0.0f, 1.0f, 0.5f,  0.5f,  -0.5f, 1.0f, 1.0f, 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
-      0.5f,  0.5f,  0.5f,  1.0f, 0.0f, -0.5f, 0.5f,  0.5f,  0.0f, 0.0f, -0.5f, 0.5f,  -0.5f, 0.0f, 1.0f};
-
-  // VAO is required in OpenGL core profile.
-  // For OpenGL compatibility profile there is default VAO.
-  unsigned int VAO, VBO, EBO;
-  glGenVertexArrays(1, &VAO);
-  glGenBuffers(1, &VBO);
-  // glGenBuffers(1, &EBO);
-
-  glBindVertexArray(VAO);
-  glBindBuffer(GL_ARRAY_BUFFER, VBO);
-  // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-
-  glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-  // glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-
-  // Store attribute info and the bounded VBO (id/name) in a VAO.
-  // We can unbound VBO, since it's info is stored in VAO.
-  unsigned int stride = 5 * sizeof(float);
-  glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, 0);
-  glEnableVertexAttribArray(0);
-
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
-  glEnableVertexAttribArray(1);
-
-  // Unbind buffers
-  glBindVertexArray(0);
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  // glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-#pragma endregion
-
-#pragma region Setup Texture
-  stbi_set_flip_vertically_on_load(true);
-
-  unsigned int texture0, texture1;
-  glGenTextures(1, &texture0);
-  glGenTextures(1, &texture1);
-
-  glActiveTexture(GL_TEXTURE0);
-  glBindTexture(GL_TEXTURE_2D, texture0);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-
-  int width0, height0;
-  unsigned char *texture0Data = loadImage(imagePath0, &width0, &height0);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width0, height0, 0, GL_RGB, GL_UNSIGNED_BYTE, texture0Data);
-  glGenerateTextureMipmap(texture0);
-
-  glActiveTexture(GL_TEXTURE1);
-  glBindTexture(GL_TEXTURE_2D, texture1);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-  int width1, height1;
-  unsigned char *texture1Data = loadImage(imagePath1, &width1, &height1);
-  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width1, height1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texture1Data);
-  glGenerateTextureMipmap(texture1);
-
-  stbi_image_free(texture0Data);
-  stbi_image_free(texture1Data);
-#pragma endregion
-
-  // Model Matrix: Scale -> Rotate -> Translate
-  glm::mat4 model = glm::mat4(1.0f);
-  model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
-  model = glm::rotate(model, glm::radians(30.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-  model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
-
-  // View Matrix
-  glm::mat4 view = glm::mat4(1.0f);
-  // note that we're translating the scene in the reverse direction of where we want to move
-  view = glm::translate(view, glm::vec3(0.0f, 0.0f, -3.0f));
-
-  // Projection Matrix
-  float aspectRatio = (float)SCR_WIDTH / (float)SCR_HEIGHT;
-  glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspectRatio, 0.1f, 100.0f);
-
-#pragma region Setup Shader
-  Shader shader(vertexShaderPath, fragmentShaderPath);
-
-  shader.use();
-  shader.setInt("texture0", 0);
-  shader.setInt("texture1", 1);
-  shader.setMat4("model", model);
-  shader.setMat4("view", view);
-  shader.setMat4("projection", projection);
-#pragma endregion
-
-  glEnable(GL_DEPTH_TEST);
-
-  while (!glfwWindowShouldClose(window)) {
-    float currentFrame = static_cast<float>(glfwGetTime());
-    deltaTime = currentFrame - lastFrame;
-    lastFrame = currentFrame;
-
-    /* When an event occurs, GLFW stores it in an internal event queue.
-     * `glfwPollEvents()` is used to process the events in the queue.
-     * Here's what `glfwPollEvents()` does:
-     * 1. Check the event queue: GLFW checks the event queue for pending events.
-     * 2. Process each event: For each event in the queue, GLFW calls the corresponding callback function.
-     * 3. Clear the event queue: After processing all events, GLFW clears the event queue. */
-    glfwPollEvents();
-    process_input(window);
-
-    glClearColor(.196f, .196f, .196f, 1);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-    shader.use();
-    glBindVertexArray(VAO);
-
-    glm::mat4 projection =
-        glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 100.0f);
-    shader.setMat4("projection", projection);
-
-    // camera/view transformation
-    glm::mat4 view = camera.GetViewMatrix();
-    shader.setMat4("view", view);
-
-    // It will try to draw triangles by grouping the vertices in sets of 3, any extra vertices will be ignored.
-    // For example if the vertex buffer contains 4 vertices, last one is ignored
-    unsigned int numberOfVertices = sizeof(vertices) / (5 * sizeof(float));
-    glDrawArrays(GL_TRIANGLES, 0, numberOfVertices);
-
-    // unsigned int numberOfIndices = sizeof(indices) / sizeof(unsigned int);
-    // glDrawElements(GL_TRIANGLES, numberOfIndices, GL_UNSIGNED_INT, 0);
-
-    /* In OpenGL, a window typically has two buffers: the front buffer and the back buffer.
-     * The front buffer is the buffer that is currently being displayed on the screen.
-     * The back buffer is the buffer that is being drawn to.
-     * When we call `glfwSwapBuffers(window)` the back buffer becomes the front buffer,
-     * and the front buffer becomes the back buffer. */
-    glfwSwapBuffers(window);
-  }
-
-  glDeleteVertexArrays(1, &VAO);
-  glDeleteBuffers(1, &VBO);
-  glfwTerminate();
-  return 0;
+  return window;
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height) { glViewport(0, 0, width, height); }
@@ -282,16 +245,3 @@ void process_input(GLFWwindow *window) {
   if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
     camera.ProcessKeyboard(RIGHT, deltaTime);
 }
-
-unsigned char *loadImage(const char *file_name, int *width, int *height) {
-  int nrChannels;
-  unsigned char *textureData = stbi_load(file_name, width, height, &nrChannels, 0);
-
-  if (!textureData) {
-    std::cout << "Failed to load texture" << std::endl;
-    glfwTerminate();
-    return 0;
-  }
-
-  return textureData;
-}
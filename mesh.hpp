@@ -0,0 +1,129 @@
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+// Interleaved vertex layout used by every mesh: location 0 = position, location 1 = texture coordinates.
+struct Vertex {
+  glm::vec3 position;
+  glm::vec2 uv;
+};
+
+// Indexed triangle list, every 3 indices form a triangle.
+struct Mesh {
+  std::vector<Vertex> vertices;
+  std::vector<uint32_t> indices;
+};
+
+/* Build an indexed mesh from a flat triangle list of interleaved `x y z u v` floats.
+ * Vertices with exactly the same position and texture coordinates are welded into one, so shared corners are stored
+ * and transformed only once (the GPU caches vertex shader results by index). */
+inline Mesh buildIndexedMesh(const float *interleaved, size_t vertexCount) {
+  // Vertices are compared bit for bit, which is what we want for welding exact copies.
+  struct VertexHash {
+    size_t operator()(const Vertex &vertex) const {
+      uint32_t words[5];
+      memcpy(words, &vertex, sizeof(words));
+      size_t hash = 0;
+      for (uint32_t word : words)
+        hash = (hash ^ word) * 0x100000001b3ull;
+      return hash;
+    }
+  };
+  struct VertexEqual {
+    bool operator()(const Vertex &a, const Vertex &b) const { return memcmp(&a, &b, sizeof(Vertex)) == 0; }
+  };
+  static_assert(sizeof(Vertex) == 5 * sizeof(float), "Vertex must be tightly packed");
+
+  Mesh mesh;
+  mesh.indices.reserve(vertexCount);
+  std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> unique;
+  unique.reserve(vertexCount);
+
+  for (size_t i = 0; i < vertexCount; i++) {
+    const float *v = interleaved + i * 5;
+    Vertex vertex = {glm::vec3(v[0], v[1], v[2]), glm::vec2(v[3], v[4])};
+
+    auto inserted = unique.emplace(vertex, static_cast<uint32_t>(mesh.vertices.size()));
+    if (inserted.second)
+      mesh.vertices.push_back(vertex);
+    mesh.indices.push_back(inserted.first->second);
+  }
+  return mesh;
+}
+
+/* Compact vertex layout, 12 bytes instead of the 20 of `Vertex`:
+ * positions are 16-bit unsigned normalized values inside the mesh's bounding box (the 4th component is padding that
+ * keeps the texture coordinates 4-byte aligned), texture coordinates are half floats. */
+struct PackedVertex {
+  uint16_t position[4];
+  uint16_t uv[2];
+};
+
+struct PackedMesh {
+  std::vector<PackedVertex> vertices;
+  // The vertex shader restores positions as `positionOffset + positionScale * position`.
+  glm::vec3 positionOffset;
+  glm::vec3 positionScale;
+};
+
+inline PackedMesh packVertices(const std::vector<Vertex> &vertices) {
+  PackedMesh packed;
+  glm::vec3 minimum(0.0f), maximum(0.0f);
+  if (!vertices.empty())
+    minimum = maximum = vertices[0].position;
+  for (const Vertex &vertex : vertices) {
+    minimum = glm::min(minimum, vertex.position);
+    maximum = glm::max(maximum, vertex.position);
+  }
+  packed.positionOffset = minimum;
+  packed.positionScale = maximum - minimum;
+
+  packed.vertices.reserve(vertices.size());
+  for (const Vertex &vertex : vertices) {
+    PackedVertex out = {};
+    for (int axis = 0; axis < 3; axis++) {
+      // A flat axis has zero extent, every vertex then maps to 0.
+      float extent = packed.positionScale[axis];
+      float normalized = extent > 0.0f ? (vertex.position[axis] - minimum[axis]) / extent : 0.0f;
+      out.position[axis] = static_cast<uint16_t>(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f + 0.5f);
+    }
+    out.uv[0] = glm::packHalf1x16(vertex.uv.x);
+    out.uv[1] = glm::packHalf1x16(vertex.uv.y);
+    packed.vertices.push_back(out);
+  }
+  return packed;
+}
+
+// Index buffer contents in the narrowest type that can address every vertex of the mesh.
+struct IndexBuffer {
+  GLenum type;
+  std::vector<unsigned char> data;
+  size_t count;
+};
+
+inline IndexBuffer packIndices(const Mesh &mesh) {
+  IndexBuffer buffer;
+  buffer.count = mesh.indices.size();
+  if (mesh.vertices.size() <= 0x10000) {
+    buffer.type = GL_UNSIGNED_SHORT;
+    buffer.data.resize(buffer.count * sizeof(uint16_t));
+    uint16_t *indices = reinterpret_cast<uint16_t *>(buffer.data.data());
+    for (size_t i = 0; i < buffer.count; i++)
+      indices[i] = static_cast<uint16_t>(mesh.indices[i]);
+  } else {
+    buffer.type = GL_UNSIGNED_INT;
+    buffer.data.resize(buffer.count * sizeof(uint32_t));
+    memcpy(buffer.data.data(), mesh.indices.data(), buffer.data.size());
+  }
+  return buffer;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "mesh.hpp"
+
+/* Index buffer optimizations, run once per mesh before it is uploaded:
+ * 1. `optimizeVertexCache` reorders triangles so vertices are reused while they are still in the post-transform
+ *    cache (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation").
+ * 2. `optimizeOverdraw` splits that order into clusters at cache boundaries and sorts the clusters so outward
+ *    facing parts are drawn first, which lets early depth testing reject more fragments
+ *    (Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw").
+ * 3. `optimizeVertexFetch` renumbers vertices in the order they are first used, so vertex fetches walk the
+ *    vertex buffer mostly linearly.
+ * `optimizeMesh` runs all three and measures the result with `analyzeVertexCache`. */
+
+// Post-transform cache efficiency of an index buffer, simulated with a FIFO cache.
+struct VertexCacheStatistics {
+  float acmr = 0; // average cache miss ratio: transformed vertices per triangle, 0.5 is ideal, 3 is worst
+  float atvr = 0; // average transform to vertex ratio: transformed vertices per unique vertex, 1 is ideal
+};
+
+inline VertexCacheStatistics analyzeVertexCache(const std::vector<uint32_t> &indices, size_t vertexCount,
+                                                unsigned int cacheSize = 16) {
+  VertexCacheStatistics statistics;
+  if (indices.empty() || vertexCount == 0)
+    return statistics;
+
+  // The timestamp at which a vertex entered the cache; it is still cached while less than `cacheSize` vertices
+  // entered after it.
+  std::vector<size_t> cachedAt(vertexCount, 0);
+  size_t misses = 0;
+  for (uint32_t index : indices) {
+    if (cachedAt[index] == 0 || misses + 1 - cachedAt[index] > cacheSize) {
+      misses++;
+      cachedAt[index] = misses;
+    }
+  }
+
+  statistics.acmr = static_cast<float>(misses) / (indices.size() / 3);
+  statistics.atvr = static_cast<float>(misses) / vertexCount;
+  return statistics;
+}
+
+inline void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount) {
+  const size_t cacheSize = 32;
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0)
+    return;
+
+  // Triangles using each vertex, as offsets into one flat array.
+  std::vector<uint32_t> valence(vertexCount, 0), firstTriangle(vertexCount + 1, 0);
+  for (uint32_t index : indices)
+    valence[index]++;
+  for (size_t vertex = 0; vertex < vertexCount; vertex++)
+    firstTriangle[vertex + 1] = firstTriangle[vertex] + valence[vertex];
+  std::vector<uint32_t> adjacency(indices.size());
+  std::vector<uint32_t> filled(firstTriangle.begin(), firstTriangle.end() - 1);
+  for (size_t triangle = 0; triangle < triangleCount; triangle++)
+    for (int corner = 0; corner < 3; corner++)
+      adjacency[filled[indices[triangle * 3 + corner]]++] = static_cast<uint32_t>(triangle);
+
+  // Remaining triangles are kept at the front of each vertex's adjacency range.
+  std::vector<uint32_t> remaining = valence;
+  std::vector<int> cachePosition(vertexCount, -1);
+
+  auto vertexScore = [&](uint32_t vertex) -> float {
+    if (remaining[vertex] == 0)
+      return -1.0f;
+    float score = 0.0f;
+    int position = cachePosition[vertex];
+    if (position >= 0) {
+      // The three vertices of the last triangle get a fixed score, so the next triangle does not simply
+      // reuse the same edge again and again.
+      if (position < 3)
+        score = 0.75f;
+      else
+        score = std::pow(1.0f - (position - 3) * (1.0f / (cacheSize - 3)), 1.5f);
+    }
+    // Prefer vertices with few triangles left, so they are finished instead of left behind as lone triangles.
+    return score + 2.0f * std::pow(static_cast<float>(remaining[vertex]), -0.5f);
+  };
+
+  std::vector<float> vertexScores(vertexCount);
+  for (size_t vertex = 0; vertex < vertexCount; vertex++)
+    vertexScores[vertex] = vertexScore(static_cast<uint32_t>(vertex));
+
+  std::vector<float> triangleScores(triangleCount);
+  std::vector<bool> emitted(triangleCount, false);
+  for (size_t triangle = 0; triangle < triangleCount; triangle++)
+    triangleScores[triangle] = vertexScores[indices[triangle * 3]] + vertexScores[indices[triangle * 3 + 1]] +
+                               vertexScores[indices[triangle * 3 + 2]];
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  std::vector<uint32_t> cache, nextCache;
+  size_t scanCursor = 0;
+
+  while (result.size() < indices.size()) {
+    // Best triangle touching the cache; when the cache has nothing left to offer, fall back to the first
+    // triangle not yet emitted (the cursor only moves forward, which keeps this linear overall).
+    int64_t best = -1;
+    float bestScore = -1.0f;
+    for (uint32_t vertex : cache)
+      for (uint32_t i = 0; i < remaining[vertex]; i++) {
+        uint32_t triangle = adjacency[firstTriangle[vertex] + i];
+        if (triangleScores[triangle] > bestScore) {
+          bestScore = triangleScores[triangle];
+          best = triangle;
+        }
+      }
+    if (best < 0) {
+      while (emitted[scanCursor])
+        scanCursor++;
+      best = static_cast<int64_t>(scanCursor);
+    }
+
+    emitted[best] = true;
+    const uint32_t *corners = &indices[best * 3];
+    result.insert(result.end(), corners, corners + 3);
+
+    // Take the triangle out of its vertices' adjacency lists.
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t vertex = corners[corner];
+      uint32_t *begin = &adjacency[firstTriangle[vertex]];
+      uint32_t *end = begin + remaining[vertex];
+      std::iter_swap(std::find(begin, end, static_cast<uint32_t>(best)), end - 1);
+      remaining[vertex]--;
+    }
+
+    // LRU cache update: the triangle's vertices move to the front.
+    nextCache.assign(corners, corners + 3);
+    for (uint32_t vertex : cache)
+      if (vertex != corners[0] && vertex != corners[1] && vertex != corners[2])
+        nextCache.push_back(vertex);
+    for (size_t position = 0; position < nextCache.size(); position++)
+      cachePosition[nextCache[position]] = position < cacheSize ? static_cast<int>(position) : -1;
+    if (nextCache.size() > cacheSize)
+      nextCache.resize(cacheSize);
+    cache.swap(nextCache);
+
+    // Only vertices that were or are in the cache changed score, and with them only their remaining triangles.
+    for (const std::vector<uint32_t> *vertices : {&cache, &nextCache})
+      for (uint32_t vertex : *vertices) {
+        float score = vertexScore(vertex);
+        float delta = score - vertexScores[vertex];
+        if (delta == 0.0f)
+          continue;
+        vertexScores[vertex] = score;
+        for (uint32_t i = 0; i < remaining[vertex]; i++)
+          triangleScores[adjacency[firstTriangle[vertex] + i]] += delta;
+      }
+  }
+
+  indices.swap(result);
+}
+
+inline void optimizeOverdraw(std::vector<uint32_t> &indices, const std::vector<Vertex> &vertices,
+                             float threshold = 1.05f, unsigned int cacheSize = 16) {
+  size_t triangleCount = indices.size() / 3;
+  if (triangleCount == 0 || indices.size() % 3 != 0)
+    return;
+
+  // Hard boundaries: triangles where the simulated cache misses on all three vertices, so starting a cluster there
+  // costs nothing. The cache holds when each vertex was last used, moving `time` on by more than the cache size
+  // empties it without touching every vertex.
+  std::vector<size_t> cachedAt(vertices.size(), 0);
+  size_t time = 0;
+  auto clearCache = [&]() { time += cacheSize + 1; };
+  auto triangleMisses = [&](size_t triangle) {
+    int misses = 0;
+    for (int corner = 0; corner < 3; corner++) {
+      uint32_t index = indices[triangle * 3 + corner];
+      if (cachedAt[index] == 0 || time + 1 - cachedAt[index] > cacheSize) {
+        cachedAt[index] = ++time;
+        misses++;
+      }
+    }
+    return misses;
+  };
+
+  // The first cluster starts at triangle 0 whether or not it misses three times, e.g. when it is degenerate.
+  std::vector<size_t> hardBoundaries = {0};
+  for (size_t triangle = 0; triangle < triangleCount; triangle++)
+    if (triangleMisses(triangle) == 3 && triangle != 0)
+      hardBoundaries.push_back(triangle);
+  hardBoundaries.push_back(triangleCount);
+
+  // Soft boundaries: split hard clusters further wherever the part so far is about as cache efficient as the whole
+  // cluster, i.e. where cutting costs at most `threshold` times the optimized ACMR.
+  std::vector<size_t> clusters;
+  for (size_t hard = 0; hard + 1 < hardBoundaries.size(); hard++) {
+    size_t begin = hardBoundaries[hard], end = hardBoundaries[hard + 1];
+
+    clearCache();
+    size_t clusterMisses = 0;
+    for (size_t triangle = begin; triangle < end; triangle++)
+      clusterMisses += triangleMisses(triangle);
+    float clusterACMR = static_cast<float>(clusterMisses) / (end - begin);
+
+    clearCache();
+    size_t start = begin, misses = 0;
+    clusters.push_back(begin);
+    for (size_t triangle = begin; triangle < end; triangle++) {
+      misses += triangleMisses(triangle);
+      if (triangle + 1 < end && static_cast<float>(misses) / (triangle + 1 - start) <= clusterACMR * threshold) {
+        clusters.push_back(triangle + 1);
+        start = triangle + 1;
+        misses = 0;
+        clearCache();
+      }
+    }
+  }
+  clusters.push_back(triangleCount);
+
+  // Sort clusters by how far they face outward: dot(cluster centroid - mesh centroid, cluster normal).
+  glm::vec3 meshCentroid(0.0f);
+  float meshArea = 0.0f;
+  std::vector<float> sortKeys(clusters.size() - 1);
+  std::vector<glm::vec3> clusterCentroids(clusters.size() - 1), clusterNormals(clusters.size() - 1);
+  for (size_t cluster = 0; cluster + 1 < clusters.size(); cluster++) {
+    glm::vec3 centroid(0.0f), normal(0.0f);
+    float area = 0.0f;
+    for (size_t triangle = clusters[cluster]; triangle < clusters[cluster + 1]; triangle++) {
+      const glm::vec3 &a = vertices[indices[triangle * 3]].position;
+      const glm::vec3 &b = vertices[indices[triangle * 3 + 1]].position;
+      const glm::vec3 &c = vertices[indices[triangle * 3 + 2]].position;
+      glm::vec3 areaNormal = glm::cross(b - a, c - a);
+      float triangleArea = glm::length(areaNormal);
+      centroid += (a + b + c) * (triangleArea / 3.0f);
+      normal += areaNormal;
+      area += triangleArea;
+    }
+    meshCentroid += centroid;
+    meshArea += area;
+    clusterCentroids[cluster] = area > 0.0f ? centroid / area : centroid;
+    clusterNormals[cluster] = glm::length(normal) > 0.0f ? glm::normalize(normal) : normal;
+  }
+  if (meshArea > 0.0f)
+    meshCentroid = meshCentroid / meshArea;
+  for (size_t cluster = 0; cluster < sortKeys.size(); cluster++)
+    sortKeys[cluster] = glm::dot(clusterCentroids[cluster] - meshCentroid, clusterNormals[cluster]);
+
+  std::vector<size_t> order(sortKeys.size());
+  for (size_t i = 0; i < order.size(); i++)
+    order[i] = i;
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return sortKeys[a] > sortKeys[b]; });
+
+  std::vector<uint32_t> result;
+  result.reserve(indices.size());
+  for (size_t cluster : order)
+    result.insert(result.end(), indices.begin() + clusters[cluster] * 3, indices.begin() + clusters[cluster + 1] * 3);
+  // The clusters cover every triangle exactly once; should they not, keep the input order rather than lose any.
+  if (result.size() != indices.size())
+    return;
+  indices.swap(result);
+}
+
+inline void optimizeVertexFetch(Mesh &mesh) {
+  const uint32_t unused = ~0u;
+  std::vector<uint32_t> remap(mesh.vertices.size(), unused);
+  std::vector<Vertex> vertices;
+  vertices.reserve(mesh.vertices.size());
+
+  for (uint32_t &index : mesh.indices) {
+    if (remap[index] == unused) {
+      remap[index] = static_cast<uint32_t>(vertices.size());
+      vertices.push_back(mesh.vertices[index]);
+    }
+    index = remap[index];
+  }
+  // Vertices no index refers to are dropped.
+  mesh.vertices.swap(vertices);
+}
+
+struct MeshOptimizationReport {
+  VertexCacheStatistics before, after;
+};
+
+inline MeshOptimizationReport optimizeMesh(Mesh &mesh) {
+  MeshOptimizationReport report;
+  report.before = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+
+  optimizeVertexCache(mesh.indices, mesh.vertices.size());
+  optimizeOverdraw(mesh.indices, mesh.vertices);
+  optimizeVertexFetch(mesh);
+
+  report.after = analyzeVertexCache(mesh.indices, mesh.vertices.size());
+  return report;
+}
+
+inline void printReport(const char *name, const Mesh &mesh, const MeshOptimizationReport &report) {
+  std::ostringstream line;
+  line << std::fixed << std::setprecision(3) << "Mesh " << name << ": " << mesh.vertices.size() << " vertices, "
+       << mesh.indices.size() / 3 << " triangles, ACMR " << report.before.acmr << " -> " << report.after.acmr
+       << ", ATVR " << report.before.atvr << " -> " << report.after.atvr;
+  std::cout << line.str() << std::endl;
+}
+
+#endif
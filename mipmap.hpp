@@ -0,0 +1,348 @@
+#ifndef MIPMAP_HPP
+#define MIPMAP_HPP
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIPMAP_NEON
+#include <arm_neon.h>
+#endif
+
+/* Mip chain generation on the CPU, as a replacement for `glGenerateTextureMipmap`.
+ * The driver decides how it filters (usually a plain box filter on the encoded 8-bit values) and does the work on
+ * the GL thread. Here every level is filtered from the previous one in 32-bit float RGBA, which lets us:
+ *   - average color in linear light: sRGB encoded texels are decoded first, otherwise every level gets darker where
+ *     bright and dark texels meet,
+ *   - use a wider Kaiser windowed sinc filter that keeps more detail than the 2x2 box,
+ *   - keep the alpha test coverage of cutout textures (foliage, fences) constant, instead of letting them fade out
+ *     in the distance as alpha gets averaged down.
+ * Each RGBA texel is one 4-wide vector, so the filter runs with SSE2 or NEON where available. It only touches CPU
+ * memory and can run on the texture loader's worker threads or in an offline asset baker. */
+
+enum MipmapFilter {
+  BOX_FILTER,   // 2x2 average, what drivers do
+  KAISER_FILTER // 6x6 taps, Kaiser windowed sinc
+};
+
+struct MipmapOptions {
+  MipmapFilter filter = BOX_FILTER;
+  // RGB of 3 and 4 channel images is sRGB encoded, filter it in linear light. 1 and 2 channel images are data.
+  bool gammaCorrect = true;
+  // Above 0: scale alpha so the fraction of texels with alpha > reference is the same in every level.
+  float alphaCoverageReference = 0.0f;
+};
+
+struct MipLevel {
+  int width, height;
+  size_t offset, size; // into `MipChain::data`
+};
+
+// All levels of an 8-bit image, tightly packed one after the other, largest first.
+struct MipChain {
+  int channels = 0;
+  std::vector<MipLevel> levels;
+  std::vector<unsigned char> data;
+};
+
+namespace mipmap_detail {
+
+#pragma region 4-wide float vectors
+#if defined(MIPMAP_SSE2)
+typedef __m128 Float4;
+inline Float4 load4(const float *values) { return _mm_loadu_ps(values); }
+inline void store4(float *values, Float4 vector) { _mm_storeu_ps(values, vector); }
+inline Float4 zero4() { return _mm_setzero_ps(); }
+inline Float4 multiplyAdd4(Float4 sum, Float4 vector, float weight) {
+  return _mm_add_ps(sum, _mm_mul_ps(vector, _mm_set1_ps(weight)));
+}
+#elif defined(MIPMAP_NEON)
+typedef float32x4_t Float4;
+inline Float4 load4(const float *values) { return vld1q_f32(values); }
+inline void store4(float *values, Float4 vector) { vst1q_f32(values, vector); }
+inline Float4 zero4() { return vdupq_n_f32(0.0f); }
+inline Float4 multiplyAdd4(Float4 sum, Float4 vector, float weight) { return vmlaq_n_f32(sum, vector, weight); }
+#else
+struct Float4 {
+  float v[4];
+};
+inline Float4 load4(const float *values) { return {{values[0], values[1], values[2], values[3]}}; }
+inline void store4(float *values, Float4 vector) {
+  for (int i = 0; i < 4; i++)
+    values[i] = vector.v[i];
+}
+inline Float4 zero4() { return {{0, 0, 0, 0}}; }
+inline Float4 multiplyAdd4(Float4 sum, Float4 vector, float weight) {
+  for (int i = 0; i < 4; i++)
+    sum.v[i] += vector.v[i] * weight;
+  return sum;
+}
+#endif
+#pragma endregion
+
+#pragma region sRGB conversion
+inline float srgbToLinear(float value) {
+  return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+}
+
+/* Decoding is a table lookup. Encoding finds the 8-bit value whose rounding interval contains the linear value,
+ * which gives exactly the rounded sRGB encoding without calling `pow` per texel: a second table gives the answer for
+ * the start of each of 4096 equal linear intervals, and since no interval spans more than one rounding threshold at
+ * most one step forward is needed from there. */
+struct SrgbTables {
+  static const int BUCKETS = 4096;
+  float toLinear[256];
+  float thresholds[256];        // linear value halfway (in sRGB) between two consecutive 8-bit values, then +inf
+  unsigned char start[BUCKETS]; // encoding of `bucket / BUCKETS`
+
+  SrgbTables() {
+    for (int i = 0; i < 256; i++)
+      toLinear[i] = srgbToLinear(i / 255.0f);
+    for (int i = 0; i < 255; i++)
+      thresholds[i] = srgbToLinear((i + 0.5f) / 255.0f);
+    thresholds[255] = INFINITY;
+    for (int bucket = 0, value = 0; bucket < BUCKETS; bucket++) {
+      while (static_cast<float>(bucket) / BUCKETS >= thresholds[value])
+        value++;
+      start[bucket] = static_cast<unsigned char>(value);
+    }
+  }
+
+  // `linear` in [0, 1].
+  unsigned char encode(float linear) const {
+    int value = start[std::min(static_cast<int>(linear * BUCKETS), BUCKETS - 1)];
+    while (linear >= thresholds[value])
+      value++;
+    return static_cast<unsigned char>(value);
+  }
+};
+
+inline const SrgbTables &srgbTables() {
+  static const SrgbTables tables;
+  return tables;
+}
+#pragma endregion
+
+// Image with 4 floats per texel, the working format of the filter.
+struct FloatImage {
+  int width = 0, height = 0;
+  std::vector<float> texels;
+
+  float *row(int y) { return texels.data() + static_cast<size_t>(y) * width * 4; }
+  const float *row(int y) const { return texels.data() + static_cast<size_t>(y) * width * 4; }
+};
+
+// Weights of the source texels around the center of a destination texel, which lies between source texels 2i and
+// 2i + 1. Taps are at offsets `firstTap`, `firstTap + 1`, ... from 2i.
+struct Kernel {
+  int taps;
+  int firstTap;
+  float weights[6];
+};
+
+inline double besselI0(double x) {
+  double sum = 1.0, term = 1.0;
+  for (int k = 1; k < 20; k++) {
+    term *= (x / (2.0 * k)) * (x / (2.0 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+inline Kernel makeKernel(MipmapFilter filter) {
+  if (filter == BOX_FILTER)
+    return {2, 0, {0.5f, 0.5f}};
+
+  // Low-pass at the new Nyquist frequency (sinc stretched by 2), windowed to 3 source texels on each side.
+  const double radius = 3.0, beta = 4.0, pi = 3.14159265358979323846;
+  Kernel kernel = {6, -2, {}};
+  double sum = 0;
+  for (int tap = 0; tap < kernel.taps; tap++) {
+    double x = std::fabs(kernel.firstTap + tap - 0.5);
+    double sinc = std::sin(pi * x / 2.0) / (pi * x / 2.0);
+    double window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - (x / radius) * (x / radius)))) / besselI0(beta);
+    kernel.weights[tap] = static_cast<float>(sinc * window);
+    sum += kernel.weights[tap];
+  }
+  for (int tap = 0; tap < kernel.taps; tap++)
+    kernel.weights[tap] = static_cast<float>(kernel.weights[tap] / sum);
+  return kernel;
+}
+
+// Halve the width; texels outside the image repeat the edge. A width of 1 is copied.
+inline FloatImage downsampleHorizontal(const FloatImage &source, const Kernel &kernel) {
+  if (source.width == 1)
+    return source;
+  FloatImage out;
+  out.width = source.width / 2;
+  out.height = source.height;
+  out.texels.resize(static_cast<size_t>(out.width) * out.height * 4);
+  for (int y = 0; y < source.height; y++) {
+    const float *in = source.row(y);
+    float *result = out.row(y);
+    for (int x = 0; x < out.width; x++) {
+      Float4 sum = zero4();
+      for (int tap = 0; tap < kernel.taps; tap++) {
+        int sourceX = std::min(std::max(2 * x + kernel.firstTap + tap, 0), source.width - 1);
+        sum = multiplyAdd4(sum, load4(in + sourceX * 4), kernel.weights[tap]);
+      }
+      store4(result + x * 4, sum);
+    }
+  }
+  return out;
+}
+
+// Halve the height, a whole row at a time so the inner loop walks memory linearly.
+inline FloatImage downsampleVertical(const FloatImage &source, const Kernel &kernel) {
+  if (source.height == 1)
+    return source;
+  FloatImage out;
+  out.width = source.width;
+  out.height = source.height / 2;
+  out.texels.resize(static_cast<size_t>(out.width) * out.height * 4);
+  for (int y = 0; y < out.height; y++) {
+    const float *rows[6];
+    for (int tap = 0; tap < kernel.taps; tap++)
+      rows[tap] = source.row(std::min(std::max(2 * y + kernel.firstTap + tap, 0), source.height - 1));
+    float *result = out.row(y);
+    for (int x = 0; x < out.width; x++) {
+      Float4 sum = zero4();
+      for (int tap = 0; tap < kernel.taps; tap++)
+        sum = multiplyAdd4(sum, load4(rows[tap] + x * 4), kernel.weights[tap]);
+      store4(result + x * 4, sum);
+    }
+  }
+  return out;
+}
+
+inline float alphaCoverage(const FloatImage &image, float reference, float scale) {
+  size_t covered = 0, count = static_cast<size_t>(image.width) * image.height;
+  for (size_t i = 0; i < count; i++)
+    covered += image.texels[i * 4 + 3] * scale > reference;
+  return static_cast<float>(covered) / count;
+}
+
+// Scale alpha so that `coverage` of the texels pass the alpha test, found by bisection.
+inline void preserveAlphaCoverage(FloatImage &image, float reference, float coverage) {
+  float low = 0.0f, high = 4.0f;
+  for (int iteration = 0; iteration < 12; iteration++) {
+    float middle = (low + high) / 2;
+    if (alphaCoverage(image, reference, middle) < coverage)
+      low = middle;
+    else
+      high = middle;
+  }
+  size_t count = static_cast<size_t>(image.width) * image.height;
+  for (size_t i = 0; i < count; i++)
+    image.texels[i * 4 + 3] = std::min(image.texels[i * 4 + 3] * high, 1.0f);
+}
+
+inline FloatImage toFloat(const unsigned char *pixels, int width, int height, int channels, bool gammaCorrect) {
+  const SrgbTables &srgb = srgbTables();
+  FloatImage image;
+  image.width = width;
+  image.height = height;
+  image.texels.assign(static_cast<size_t>(width) * height * 4, 0.0f);
+  size_t count = static_cast<size_t>(width) * height;
+  for (size_t i = 0; i < count; i++) {
+    const unsigned char *in = pixels + i * channels;
+    float *out = &image.texels[i * 4];
+    for (int c = 0; c < channels; c++)
+      out[c] = gammaCorrect && c < 3 ? srgb.toLinear[in[c]] : in[c] / 255.0f;
+  }
+  return image;
+}
+
+inline void toBytes(const FloatImage &image, int channels, bool gammaCorrect, unsigned char *pixels) {
+  const SrgbTables &srgb = srgbTables();
+  size_t count = static_cast<size_t>(image.width) * image.height;
+  for (size_t i = 0; i < count; i++) {
+    const float *in = &image.texels[i * 4];
+    unsigned char *out = pixels + i * channels;
+    for (int c = 0; c < channels; c++) {
+      float value = std::min(std::max(in[c], 0.0f), 1.0f);
+      out[c] = gammaCorrect && c < 3 ? srgb.encode(value) : static_cast<unsigned char>(value * 255.0f + 0.5f);
+    }
+  }
+}
+
+} // namespace mipmap_detail
+
+// Levels of a full chain down to 1x1, the count `Texture2D` allocates storage for by default.
+inline int mipLevelCount(int width, int height) {
+  int levels = 1;
+  while (width > 1 || height > 1) {
+    width = std::max(1, width / 2);
+    height = std::max(1, height / 2);
+    levels++;
+  }
+  return levels;
+}
+
+/* Lay out the mip chain of a `width` x `height` image with `channels` interleaved 8-bit channels: each level halves
+ * the size (rounding down) until 1x1, or stops after `maxLevels` levels when that is above 0. Only the levels are
+ * filled in, `data` stays empty; the last level ends at the chain's total size. */
+inline MipChain layoutMipChain(int width, int height, int channels, int maxLevels = 0) {
+  int levelCount = mipLevelCount(width, height);
+  if (maxLevels > 0)
+    levelCount = std::min(levelCount, maxLevels);
+
+  MipChain chain;
+  chain.channels = channels;
+  size_t total = 0;
+  for (int level = 0, w = width, h = height; level < levelCount; level++) {
+    size_t size = static_cast<size_t>(w) * h * channels;
+    chain.levels.push_back({w, h, total, size});
+    total += size;
+    w = std::max(1, w / 2);
+    h = std::max(1, h / 2);
+  }
+  return chain;
+}
+
+/* `layoutMipChain` with the memory for all levels. Level 0 is left for the caller to fill, e.g. by decoding the image
+ * straight into it, before `generateMipLevels` fills the rest. */
+inline MipChain allocateMipChain(int width, int height, int channels, int maxLevels = 0) {
+  MipChain chain = layoutMipChain(width, height, channels, maxLevels);
+  chain.data.resize(chain.levels.back().offset + chain.levels.back().size);
+  return chain;
+}
+
+// Filter every level after the first from level 0.
+inline void generateMipLevels(MipChain &chain, const MipmapOptions &options = MipmapOptions()) {
+  using namespace mipmap_detail;
+  int levelCount = static_cast<int>(chain.levels.size()), channels = chain.channels;
+  if (levelCount <= 1)
+    return;
+
+  bool gammaCorrect = options.gammaCorrect && channels >= 3;
+  bool keepCoverage = options.alphaCoverageReference > 0.0f && channels == 4;
+  Kernel kernel = makeKernel(options.filter);
+  const MipLevel &base = chain.levels[0];
+  FloatImage image = toFloat(chain.data.data(), base.width, base.height, channels, gammaCorrect);
+  float coverage = keepCoverage ? alphaCoverage(image, options.alphaCoverageReference, 1.0f) : 0.0f;
+
+  for (int level = 1; level < levelCount; level++) {
+    image = downsampleVertical(downsampleHorizontal(image, kernel), kernel);
+    if (keepCoverage)
+      preserveAlphaCoverage(image, options.alphaCoverageReference, coverage);
+    toBytes(image, channels, gammaCorrect, chain.data.data() + chain.levels[level].offset);
+  }
+}
+
+// Build the whole mip chain of `pixels`, level 0 is a copy of them.
+inline MipChain generateMipChain(const unsigned char *pixels, int width, int height, int channels,
+                                 const MipmapOptions &options = MipmapOptions(), int maxLevels = 0) {
+  MipChain chain = allocateMipChain(width, height, channels, maxLevels);
+  std::copy(pixels, pixels + chain.levels[0].size, chain.data.begin());
+  generateMipLevels(chain, options);
+  return chain;
+}
+
+#endif
@@ -0,0 +1,226 @@
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gl_resources.hpp"
+#include "mipmap.hpp"
+#include "stb_image.hpp"
+#ifdef LEARNOPENGL_HEADLESS
+#include "headless.hpp"
+#endif
+
+/* Mipmap generation benchmark.
+ * Compares building the mip chain with `glGenerateTextureMipmap` (the driver path) against `generateMipChain` on the
+ * CPU for every filter variant, and prints the median times per image as JSON:
+ *   - driver: upload level 0 and generate the rest, all on the GL thread, timed up to glFinish
+ *   - cpu: `generateMipChain` alone, the part that moves to a worker thread
+ *   - cpu_upload: uploading every level of that chain, what remains on the GL thread
+ * Run with `LearnOpenGLMipmapBenchmark [--headless] [--iterations 20] [--json result.json] [image ...]`. */
+
+using Clock = std::chrono::steady_clock;
+
+struct MipmapBenchmarkOptions {
+  bool headless = false;
+  int iterations = 20;
+  const char *jsonPath = NULL; // stdout when not set
+  std::vector<std::string> images;
+};
+
+struct Variant {
+  const char *name;
+  MipmapOptions options;
+};
+
+struct ImageResult {
+  std::string path;
+  int width, height, channels;
+  double driver;
+  std::vector<double> cpu, cpuUpload; // per variant
+};
+
+MipmapBenchmarkOptions parseOptions(int argc, char *argv[]);
+GLFWwindow *setupWindow();
+void writeJson(std::ostream &out, const MipmapBenchmarkOptions &options, const std::vector<Variant> &variants,
+               const std::vector<ImageResult> &results);
+
+double millisecondsBetween(Clock::time_point start, Clock::time_point end) {
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+// Median over the iterations of the time `run` takes.
+template <typename Function> double medianTime(int iterations, Function run) {
+  std::vector<double> times;
+  for (int i = 0; i < iterations; i++) {
+    Clock::time_point start = Clock::now();
+    run();
+    times.push_back(millisecondsBetween(start, Clock::now()));
+  }
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+int main(int argc, char *argv[]) {
+  MipmapBenchmarkOptions options = parseOptions(argc, argv);
+
+  GLFWwindow *window = NULL;
+#ifdef LEARNOPENGL_HEADLESS
+  std::unique_ptr<HeadlessContext> headlessContext;
+#endif
+  if (options.headless) {
+#ifdef LEARNOPENGL_HEADLESS
+    headlessContext = std::make_unique<HeadlessContext>(4, 5);
+    if (!headlessContext->isValid() || !gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress)) {
+      std::cerr << "Failed to create headless OpenGL context" << std::endl;
+      return -1;
+    }
+#else
+    std::cerr << "Headless mode is not available, configure with -DLEARNOPENGL_HEADLESS=ON" << std::endl;
+    return -1;
+#endif
+  } else {
+    window = setupWindow();
+    if (window == NULL)
+      return -1;
+  }
+
+  std::vector<Variant> variants(4);
+  variants[0].name = "box";
+  variants[0].options.gammaCorrect = false;
+  variants[1].name = "box_gamma";
+  variants[2].name = "kaiser_gamma";
+  variants[2].options.filter = KAISER_FILTER;
+  variants[3].name = "kaiser_gamma_alpha_coverage";
+  variants[3].options.filter = KAISER_FILTER;
+  variants[3].options.alphaCoverageReference = 0.5f;
+
+  const GLenum internalFormats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+  const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+  std::vector<ImageResult> results;
+  for (const std::string &path : options.images) {
+    ImageResult result;
+    result.path = path;
+    unsigned char *pixels = stbi_load(path.c_str(), &result.width, &result.height, &result.channels, 0);
+    if (!pixels) {
+      std::cerr << "Failed to load " << path << ": " << stbi_failure_reason() << std::endl;
+      continue;
+    }
+    GLenum internalFormat = internalFormats[result.channels - 1], format = formats[result.channels - 1];
+
+    result.driver = medianTime(options.iterations, [&]() {
+      Texture2D texture(internalFormat, result.width, result.height);
+      texture.upload(0, format, GL_UNSIGNED_BYTE, pixels);
+      texture.generateMipmaps();
+      glFinish();
+    });
+
+    for (const Variant &variant : variants) {
+      MipChain chain;
+      result.cpu.push_back(medianTime(options.iterations, [&]() {
+        chain = generateMipChain(pixels, result.width, result.height, result.channels, variant.options);
+      }));
+      result.cpuUpload.push_back(medianTime(options.iterations, [&]() {
+        Texture2D texture(internalFormat, result.width, result.height);
+        for (size_t level = 0; level < chain.levels.size(); level++)
+          texture.upload(static_cast<int>(level), format, GL_UNSIGNED_BYTE,
+                         chain.data.data() + chain.levels[level].offset);
+        glFinish();
+      }));
+    }
+    stbi_image_free(pixels);
+    results.push_back(result);
+  }
+
+  if (options.jsonPath) {
+    std::ofstream file(options.jsonPath);
+    writeJson(file, options, variants, results);
+  } else {
+    writeJson(std::cout, options, variants, results);
+  }
+
+  glfwTerminate();
+  return 0;
+}
+
+MipmapBenchmarkOptions parseOptions(int argc, char *argv[]) {
+  MipmapBenchmarkOptions options;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--headless") == 0)
+      options.headless = true;
+    else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc)
+      options.iterations = std::max(1, atoi(argv[++i]));
+    else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc)
+      options.jsonPath = argv[++i];
+    else
+      options.images.push_back(argv[i]);
+  }
+  // Paths are relative to the build output directory, like the app's.
+  if (options.images.empty())
+    options.images = {"../../images/container.png", "../../images/awesomeface.png"};
+  return options;
+}
+
+GLFWwindow *setupWindow() {
+  if (!glfwInit()) {
+    std::cerr << "Failed to initialize glfw" << std::endl;
+    return NULL;
+  }
+
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  // Only the context is needed.
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+  GLFWwindow *window = glfwCreateWindow(64, 64, "LearnOpenGL Mipmap Benchmark", NULL, NULL);
+  if (window == NULL) {
+    std::cerr << "Failed to create glfw window" << std::endl;
+    glfwTerminate();
+    return NULL;
+  }
+  glfwMakeContextCurrent(window);
+
+  if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+    std::cerr << "Failed to initialize GLAD" << std::endl;
+    glfwTerminate();
+    return NULL;
+  }
+  return window;
+}
+
+void writeJson(std::ostream &out, const MipmapBenchmarkOptions &options, const std::vector<Variant> &variants,
+               const std::vector<ImageResult> &results) {
+  out << std::fixed << std::setprecision(4);
+  out << "{\n";
+  out << "  \"mode\": \"" << (options.headless ? "headless" : "window") << "\",\n";
+  out << "  \"renderer\": \"" << reinterpret_cast<const char *>(glGetString(GL_RENDERER)) << "\",\n";
+  out << "  \"iterations\": " << options.iterations << ",\n";
+  out << "  \"images\": [\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const ImageResult &result = results[i];
+    out << "    {\n";
+    out << "      \"path\": \"" << result.path << "\",\n";
+    out << "      \"size\": [" << result.width << ", " << result.height << "],\n";
+    out << "      \"channels\": " << result.channels << ",\n";
+    out << "      \"driver_ms\": " << result.driver << ",\n";
+    out << "      \"cpu_ms\": {";
+    for (size_t v = 0; v < variants.size(); v++)
+      out << (v ? ", " : "") << "\"" << variants[v].name << "\": " << result.cpu[v];
+    out << "},\n";
+    out << "      \"cpu_upload_ms\": {";
+    for (size_t v = 0; v < variants.size(); v++)
+      out << (v ? ", " : "") << "\"" << variants[v].name << "\": " << result.cpuUpload[v];
+    out << "}\n";
+    out << "    }" << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  out << "  ]\n";
+  out << "}" << std::endl;
+}
@@ -0,0 +1,250 @@
+#ifndef SCENE_HPP
+#define SCENE_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "camera.hpp"
+#include "gl_resources.hpp"
+#include "gl_state.hpp"
+#include "mesh.hpp"
+#include "mesh_optimizer.hpp"
+#include "shader.hpp"
+#include "texture_cache.hpp"
+#include "uniform_buffer.hpp"
+
+// Paths are relative to the build output directory.
+const char *const vertexShaderPath = "../../shaders/vertex_shader.glsl";
+const char *const fragmentShaderPath = "../../shaders/fragment_shader.glsl";
+const char *const imagePath0 = "../../images/container.png";
+const char *const imagePath1 = "../../images/awesomeface.png";
+
+// Per-frame camera data, std140 layout of the `Camera` block in vertex_shader.glsl.
+struct CameraUniforms {
+  glm::mat4 projection;
+  glm::mat4 view;
+};
+const unsigned int CAMERA_UNIFORM_BINDING = 0;
+// Per-instance model matrices, the `Instances` shader storage block in vertex_shader.glsl.
+const unsigned int INSTANCE_STORAGE_BINDING = 1;
+
+// Layout of the vertex buffer.
+enum VertexFormat {
+  FLOAT_VERTICES, // `Vertex`: float position and texture coordinates, 20 bytes
+  PACKED_VERTICES // `PackedVertex`: quantized position and half float texture coordinates, 12 bytes
+};
+
+// How `Scene::draw` submits the instances.
+enum DrawMode {
+  INSTANCED,  // all instances with a single glDrawElementsInstanced
+  PER_OBJECT  // one glDrawElements per instance, the way a naive renderer would do it
+};
+
+// `count` cubes laid out on a 3D grid in front of the camera, each rotated a bit differently.
+inline std::vector<glm::mat4> makeInstanceGrid(int count) {
+  int side = static_cast<int>(std::ceil(std::cbrt(static_cast<double>(count))));
+  float spacing = 2.0f;
+  float center = (side - 1) * spacing / 2.0f;
+
+  std::vector<glm::mat4> models;
+  models.reserve(count);
+  for (int i = 0; i < count; i++) {
+    int x = i % side, y = (i / side) % side, z = i / (side * side);
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(x * spacing - center, y * spacing - center, -z * spacing));
+    model = glm::rotate(model, glm::radians(30.0f + 7.0f * i), glm::vec3(1.0f, 0.3f, 0.5f));
+    models.push_back(model);
+  }
+  return models;
+}
+
+/* The textured cube together with its GL objects.
+ * Shared by the interactive app and the benchmark, so both render exactly the same thing.
+ * Requires a current OpenGL context when constructed. */
+class Scene {
+public:
+  static constexpr float vertices[] = {
+      -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.5f,  -0.5f, -0.5f, 1.0f, 0.0f, 0.5f,  0.5f,  -0.5f, 1.0f, 1.0f,
+      0.5f,  0.5f,  -0.5f, 1.0f, 1.0f, -0.5f, 0.5f,  -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 0.0f,
+
+      -0.5f, -0.5f, 0.5f,  0.0f, 0.0f, 0.5f,  -0.5f, 0.5f,  1.0f, 0.0f, 0.5f,  0.5f,  0.5f,  1.0f, 1.0f,
+      0.5f,  0.5f,  0.5f,  1.0f, 1.0f, -0.5f, 0.5f,  0.5f,  0.0f, 1.0f, -0.5f, -0.5f, 0.5f,  0.0f, 0.0f,
+
+      -0.5f, 0.5f,  0.5f,  1.0f, 0.0f, -0.5f, 0.5f,  -0.5f, 1.0f, 1.0f, -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, -0.5f, -0.5f, 0.5f,  0.0f, 0.0f, -0.5f, 0.5f,  0.5f,  1.0f, 0.0f,
+
+      0.5f,  0.5f,  0.5f,  1.0f, 0.0f, 0.5f,  0.5f,  -0.5f, 1.0f, 1.0f, 0.5f,  -0.5f, -0.5f, 0.0f, 1.0f,
+      0.5f,  -0.5f, -0.5f, 0.0f, 1.0f, 0.5f,  -0.5f, 0.5f,  0.0f, 0.0f, 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+
+      -0.5f, -0.5f, -0.5f, 0.0f, 1.0f, 0.5f,  -0.5f, -0.5f, 1.0f, 1.0f, 0.5f,  -0.5f, 0.5f,  1.0f, 0.0f,
+      0.5f,  -0.5f, 0.5f,  1.0f, 0.0f, -0.5f, -0.5f, 0.5f,  0.0f, 0.0f, -0.5f, -0.5f, -0.5f, 0.0f, 1.0f,
+
+      -0.5f, 0.5f,  -0.5f, 0.0f, 1.0f, 0.5f,  0.5f,  -0.5f, 1.0f, 1.0f, 0.5f,  0.5f,  0.5f,  1.0f, 0.0f,
+      0.5f,  0.5f,  0.5f,  1.0f, 0.0f, -0.5f, 0.5f,  0.5f,  0.0f, 0.0f, -0.5f, 0.5f,  -0.5f, 0.0f, 1.0f};
+
+  // Flat triangle list: it will try to draw triangles by grouping the vertices in sets of 3,
+  // any extra vertices will be ignored.
+  static constexpr unsigned int numberOfVertices = sizeof(vertices) / (5 * sizeof(float));
+
+  // VAO is required in OpenGL core profile.
+  // For OpenGL compatibility profile there is default VAO.
+  VertexArray VAO;
+  Buffer VBO, EBO;
+  // Type and count of the indices in the EBO.
+  GLenum indexType;
+  unsigned int numberOfIndices;
+  // Shares textures between everything that requests the same image, and loads them in the background.
+  // The cube shows a placeholder until they are resident.
+  TextureCache textureCache;
+  std::shared_ptr<AsyncTexture> texture0, texture1;
+  Buffer instanceSSBO;
+  int instanceCount = 0;
+  DrawMode drawMode = INSTANCED;
+  Shader shader;
+  int instanceOffsetLocation;
+  // Filters redundant binds and enables, its counters show how many were skipped.
+  GLStateCache state;
+  UniformRingBuffer<CameraUniforms> cameraUniforms;
+
+  Scene(VertexFormat vertexFormat = FLOAT_VERTICES)
+      : shader(vertexShaderPath, fragmentShaderPath), cameraUniforms(CAMERA_UNIFORM_BINDING) {
+#pragma region Setup VAO, VBO, EBO
+    // Every face repeats two of its corners and faces share corners with matching texture coordinates, so welding
+    // the 36 vertices of the triangle list leaves 16 unique ones, referenced by 36 indices.
+    Mesh mesh = buildIndexedMesh(vertices, numberOfVertices);
+    // Reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch before uploading.
+    MeshOptimizationReport report = optimizeMesh(mesh);
+    printReport("cube", mesh, report);
+    IndexBuffer indices = packIndices(mesh);
+    indexType = indices.type;
+    numberOfIndices = static_cast<unsigned int>(indices.count);
+
+    // The EBO reference is part of the VAO state.
+    EBO = Buffer(indices.data.size(), indices.data.data());
+    VAO.setElementBuffer(EBO);
+
+    // Store attribute info in the VAO. The format of each attribute is described separately from the buffer it is
+    // read from: both attributes read from vertex buffer binding 0, which refers to the VBO.
+    // Positions of the packed format are read as normalized integers, so the shader sees them in [0, 1] and scales
+    // them back into the bounding box with `position_offset` and `position_scale`.
+    glm::vec3 positionOffset(0.0f), positionScale(1.0f);
+    unsigned int stride;
+    if (vertexFormat == PACKED_VERTICES) {
+      PackedMesh packed = packVertices(mesh.vertices);
+      positionOffset = packed.positionOffset;
+      positionScale = packed.positionScale;
+      stride = sizeof(PackedVertex);
+      VBO = Buffer(packed.vertices.size() * stride, packed.vertices.data());
+      VAO.setAttribute(0, 0, 3, GL_UNSIGNED_SHORT, true, offsetof(PackedVertex, position));
+      VAO.setAttribute(1, 0, 2, GL_HALF_FLOAT, false, offsetof(PackedVertex, uv));
+    } else {
+      stride = sizeof(Vertex);
+      VBO = Buffer(mesh.vertices.size() * stride, mesh.vertices.data());
+      VAO.setAttribute(0, 0, 3, GL_FLOAT, false, offsetof(Vertex, position));
+      VAO.setAttribute(1, 0, 2, GL_FLOAT, false, offsetof(Vertex, uv));
+    }
+    VAO.setVertexBuffer(0, VBO, 0, stride);
+#pragma endregion
+
+#pragma region Setup Texture
+    // Flipped vertically, repeated and linearly filtered (the `TextureParameters` defaults).
+    texture0 = textureCache.acquire(imagePath0);
+    texture1 = textureCache.acquire(imagePath1);
+#pragma endregion
+
+    // Model Matrix: Scale -> Rotate -> Translate
+    // By default the scene is just this one cube, use `setInstances` to draw more.
+    glm::mat4 model = glm::mat4(1.0f);
+    model = glm::translate(model, glm::vec3(0.0f, 0.0f, 0.0f));
+    model = glm::rotate(model, glm::radians(30.0f), glm::vec3(1.0f, 0.0f, 0.0f));
+    model = glm::scale(model, glm::vec3(1.0f, 1.0f, 1.0f));
+    setInstances({model});
+
+#pragma region Setup Shader
+    state.useProgram(shader.ID);
+    shader.setInt("texture0", 0);
+    shader.setInt("texture1", 1);
+    // View and projection matrices come from the camera uniform buffer, written every frame,
+    // and model matrices from the instance storage buffer.
+    instanceOffsetLocation = shader.getUniformLocation("instance_offset");
+    shader.setInt(instanceOffsetLocation, 0);
+    shader.setVec3("position_offset", positionOffset);
+    shader.setVec3("position_scale", positionScale);
+#pragma endregion
+  }
+
+  Scene(const Scene &) = delete;
+  Scene &operator=(const Scene &) = delete;
+
+  // Replace the model matrices of all instances.
+  void setInstances(const std::vector<glm::mat4> &models) {
+    instanceSSBO = Buffer(models.size() * sizeof(glm::mat4), models.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_STORAGE_BINDING, instanceSSBO.ID);
+    instanceCount = static_cast<int>(models.size());
+  }
+
+  void clear() const {
+    glClearColor(.196f, .196f, .196f, 1);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+  }
+
+  void uploadUniforms(Camera &camera, float aspectRatio) {
+    CameraUniforms uniforms;
+    uniforms.projection = glm::perspective(glm::radians(camera.Zoom), aspectRatio, 0.1f, 100.0f);
+    // camera/view transformation
+    uniforms.view = camera.GetViewMatrix();
+    cameraUniforms.write(uniforms);
+  }
+
+  // Returns the number of draw calls issued.
+  unsigned int draw() {
+    unsigned int drawCalls = 0;
+    if (drawMode == INSTANCED) {
+      applyDrawState();
+      // The vertex shader picks the model matrix with `gl_InstanceID`.
+      glDrawElementsInstanced(GL_TRIANGLES, numberOfIndices, indexType, 0, instanceCount);
+      drawCalls = 1;
+    } else {
+      for (int instance = 0; instance < instanceCount; instance++) {
+        // Like a naive renderer each object sets up everything it needs, the state cache skips all but the first.
+        applyDrawState();
+        shader.setInt(instanceOffsetLocation, instance);
+        glDrawElements(GL_TRIANGLES, numberOfIndices, indexType, 0);
+      }
+      shader.setInt(instanceOffsetLocation, 0);
+      drawCalls = instanceCount;
+    }
+
+    // Last draw reading this frame's camera data.
+    cameraUniforms.fence();
+    return drawCalls;
+  }
+
+  void render(Camera &camera, float aspectRatio) {
+    state.beginFrame();
+    textureCache.update();
+    clear();
+    uploadUniforms(camera, aspectRatio);
+    draw();
+  }
+
+private:
+  // Everything a draw of the cube depends on, set through the state cache so unchanged state costs no GL call.
+  void applyDrawState() {
+    state.useProgram(shader.ID);
+    state.bindVertexArray(VAO.ID);
+    // The placeholder until the texture is resident, then the texture itself.
+    state.bindTextureUnit(0, texture0->ID());
+    state.bindTextureUnit(1, texture1->ID());
+    state.setDepthTest(true);
+  }
+};
+
+#endif
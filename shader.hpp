@@ -1,13 +1,17 @@
 #ifndef SHADER_HPP
 #define SHADER_HPP
 
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 #include <glad/glad.h>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
 class Shader {
 public:
@@ -63,28 +67,81 @@ public:
 
     glDeleteShader(vertex);
     glDeleteShader(fragment);
+
+    reflectUniforms();
   }
 
   // Use/activate the shader
   void use() const { glUseProgram(ID); }
 
-  // Utility uniform functions
-  void setBool(const std::string &name, bool value) const {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), static_cast<int>(value));
+  // Location of an active uniform, or -1 if the program has no such uniform.
+  // Looked up in the table built after linking, so it never calls into the driver.
+  // Resolve locations once and pass them to the setters below on per-frame paths.
+  int getUniformLocation(std::string_view name) const {
+    auto it = std::lower_bound(uniforms.begin(), uniforms.end(), name,
+                               [](const UniformInfo &uniform, std::string_view key) { return uniform.name < key; });
+    return it != uniforms.end() && it->name == name ? it->location : -1;
   }
 
-  void setInt(const std::string &name, int value) const { glUniform1i(glGetUniformLocation(ID, name.c_str()), value); }
+  // Utility uniform functions
+  void setBool(int location, bool value) const { glUniform1i(location, static_cast<int>(value)); }
 
-  void setFloat(const std::string &name, float value) const {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
-  }
+  void setInt(int location, int value) const { glUniform1i(location, value); }
 
-  void setMat4(const std::string &name, const glm::mat4 &mat) const {
-    unsigned int matLoc = glGetUniformLocation(ID, name.c_str());
-    glUniformMatrix4fv(matLoc, 1, GL_FALSE, glm::value_ptr(mat));
+  void setFloat(int location, float value) const { glUniform1f(location, value); }
+
+  void setVec3(int location, const glm::vec3 &value) const { glUniform3fv(location, 1, glm::value_ptr(value)); }
+
+  void setMat4(int location, const glm::mat4 &mat) const {
+    glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(mat));
   }
 
+  void setBool(std::string_view name, bool value) const { setBool(getUniformLocation(name), value); }
+
+  void setInt(std::string_view name, int value) const { setInt(getUniformLocation(name), value); }
+
+  void setFloat(std::string_view name, float value) const { setFloat(getUniformLocation(name), value); }
+
+  void setVec3(std::string_view name, const glm::vec3 &value) const { setVec3(getUniformLocation(name), value); }
+
+  void setMat4(std::string_view name, const glm::mat4 &mat) const { setMat4(getUniformLocation(name), mat); }
+
 private:
+  struct UniformInfo {
+    std::string name;
+    int location;
+  };
+
+  // Active uniforms that have a location (block members don't), sorted by name.
+  std::vector<UniformInfo> uniforms;
+
+  void reflectUniforms() {
+    int count = 0;
+    glGetProgramInterfaceiv(ID, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+
+    const GLenum properties[] = {GL_NAME_LENGTH, GL_LOCATION};
+    std::string name;
+    for (int index = 0; index < count; index++) {
+      int values[2];
+      glGetProgramResourceiv(ID, GL_UNIFORM, index, 2, properties, 2, NULL, values);
+      if (values[1] < 0)
+        continue;
+
+      // GL_NAME_LENGTH includes the null terminator.
+      name.resize(values[0]);
+      glGetProgramResourceName(ID, GL_UNIFORM, index, values[0], NULL, name.data());
+      name.resize(values[0] - 1);
+
+      // Arrays are reported as "name[0]", make them reachable by their plain name as well.
+      if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+        uniforms.push_back({name.substr(0, name.size() - 3), values[1]});
+      uniforms.push_back({name, values[1]});
+    }
+
+    std::sort(uniforms.begin(), uniforms.end(),
+              [](const UniformInfo &a, const UniformInfo &b) { return a.name < b.name; });
+  }
+
   void checkCompileErrors(unsigned int shader, const std::string &type) {
     int success;
     char infoLog[1024];
@@ -4,12 +4,31 @@ layout (location = 1) in vec2 texture_coordinates;
 
 out vec2 interpolated_texture_coordinates;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// Written once per frame and shared by every program that declares it.
+layout (std140, binding = 0) uniform Camera
+{
+    mat4 projection;
+    mat4 view;
+};
+
+// Model matrix of every instance of the mesh.
+layout (std430, binding = 1) readonly buffer Instances
+{
+    mat4 models[];
+};
+
+// Packed vertices store positions normalized to the mesh's bounding box, this maps them back.
+// (0, 0, 0) and (1, 1, 1) for float vertices.
+uniform vec3 position_offset;
+uniform vec3 position_scale;
+
+// Index of the first instance of the current draw, so objects can also be drawn one at a time.
+uniform int instance_offset;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(vertex_position, 1.0);
+    mat4 model = models[instance_offset + gl_InstanceID];
+    vec3 position = position_offset + position_scale * vertex_position;
+    gl_Position = projection * view * model * vec4(position, 1.0);
     interpolated_texture_coordinates = texture_coordinates;
 }
\ No newline at end of file
@@ -1,2 +1,8 @@
+#include "image_arena.hpp"
+
+// Allocate from the calling thread's arena while an ImageArenaScope is alive, see image_arena.hpp.
+#define STBI_MALLOC(size) imageArenaMalloc(size)
+#define STBI_REALLOC_SIZED(pointer, oldSize, newSize) imageArenaRealloc(pointer, oldSize, newSize)
+#define STBI_FREE(pointer) imageArenaFree(pointer)
 #define STB_IMAGE_IMPLEMENTATION
-#include "stb_image.hpp"
\ No newline at end of file
+#include "stb_image.hpp"
@@ -36,8 +36,9 @@
           http://gist.github.com/urraka/685d9a6340b26b830d49
 
       - decode from memory or through FILE (define STBI_NO_STDIO to remove code)
+      - files loaded by name are memory-mapped where mmap exists (define STBI_NO_MMAP to read them through FILE)
       - decode from arbitrary I/O callbacks
-      - SIMD acceleration on x86/x64 (SSE2) and ARM (NEON)
+      - SIMD acceleration on x86/x64 (SSE2, AVX2) and ARM (NEON)
 
    Full documentation under "DOCUMENTATION" below.
 
@@ -265,7 +266,9 @@ RECENT REVISION HISTORY:
 // code.)
 //
 // On x86, SSE2 will automatically be used when available based on a run-time
-// test; if not, the generic C versions are used as a fall-back. On ARM targets,
+// test; if not, the generic C versions are used as a fall-back. The JPEG IDCT,
+// color conversion and 2x2 upsampling additionally have AVX2 kernels that are
+// picked the same way on CPUs that have it. On ARM targets,
 // the typical path is to have separate builds for NEON and non-NEON devices
 // (at least this is true for iOS and Android). Therefore, the NEON support is
 // toggled by a build flag: define STBI_NEON to get NEON loops.
@@ -429,10 +432,61 @@ extern "C" {
     // for stbi_load_from_file, file pointer is left pointing immediately after image
 #endif
 
+    // decode into memory owned by the caller instead of a new allocation, e.g. a mapped pixel unpack buffer.
+    // rows are 'stride' bytes apart (0 for tightly packed), size the buffer with stbi_info first. PNG and JPEG
+    // write their rows straight into 'output', other formats are decoded as usual and copied. returns 0 on
+    // failure, including when the image does not fit into 'output_size' bytes.
+    STBIDEF int stbi_load_into_from_memory(stbi_uc const* buffer, int len, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+    STBIDEF int stbi_load_into(char const* filename, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF int stbi_load_into_from_file(FILE* f, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+
+    // decode in bands of 'band_rows' rows (the last one may be shorter), top to bottom, handing each to 'band':
+    // 'pixels' holds rows 'row' to 'row + rows - 1' of the x*y image, tightly packed with 'channels' 8-bit channels
+    // ('desired_channels' or the file's), and is only valid during the call. return 0 from it to stop decoding.
+    // non-interlaced PNGs and baseline JPEGs with a single scan are decoded a band at a time, so memory stays in the
+    // order of a band plus (for PNG) the compressed data instead of the whole image; other images are decoded whole
+    // and then handed out. rows come in file order, the vertical flip flag does not apply. returns 0 on failure;
+    // a callback that stops decoding is not one, the rows it did not get are simply not decoded.
+    typedef int stbi_band_callback(void* user, int x, int y, int channels, int row, int rows, stbi_uc const* pixels);
+
+    STBIDEF int stbi_load_bands_from_memory(stbi_uc const* buffer, int len, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF int stbi_load_bands_from_callbacks(stbi_io_callbacks const* clbk, void* user, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+    STBIDEF int stbi_load_bands(char const* filename, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF int stbi_load_bands_from_file(FILE* f, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+
+    // decode only the rectangle at (rx, ry) of rw*rh pixels into 'output', rows 'stride' bytes apart (0 for tightly
+    // packed), e.g. one tile of a sparse texture. built on the band decode: memory is bounded the same way and
+    // decoding stops after the rectangle's last row. ry counts from the top of the image as stored, the vertical flip
+    // flag stores the rectangle bottom up. x, y and channels_in_file are the whole image's. returns 0 on failure,
+    // including when the rectangle is not inside the image or does not fit into 'output_size' bytes.
+    STBIDEF int stbi_load_region_from_memory(stbi_uc const* buffer, int len, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF int stbi_load_region_from_callbacks(stbi_io_callbacks const* clbk, void* user, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+
+#ifndef STBI_NO_STDIO
+    STBIDEF int stbi_load_region(char const* filename, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+    STBIDEF int stbi_load_region_from_file(FILE* f, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* channels_in_file, int desired_channels);
+#endif
+
 #ifndef STBI_NO_GIF
     STBIDEF stbi_uc* stbi_load_gif_from_memory(stbi_uc const* buffer, int len, int** delays, int* x, int* y, int* z, int* comp, int req_comp);
 #endif
 
+#ifndef STBI_NO_STDIO
+    // map the whole file read-only for the _from_memory functions, with a hint that it is read front to back. the
+    // functions taking a filename decode this way, where mmap is available; elsewhere (or with STBI_NO_MMAP) the file
+    // is read into memory instead. returns NULL on failure, e.g. for an empty file or one of 2 GB or more. release
+    // with stbi_unmap_file. the file must not be truncated while it is mapped.
+    STBIDEF stbi_uc const* stbi_map_file(char const* filename, int* len);
+    STBIDEF void stbi_unmap_file(stbi_uc const* data, int len);
+#endif
+
 #ifdef STBI_WINDOWS_UTF8
     STBIDEF int stbi_convert_wchar_to_utf8(char* buffer, size_t bufferlen, const wchar_t* input);
 #endif
@@ -503,6 +557,26 @@ extern "C" {
     STBIDEF int      stbi_is_16_bit_from_file(FILE* f);
 #endif
 
+    // what stbi_info and stbi_is_16_bit report plus the format, from one pass over the header, e.g. to index many
+    // files. the format is picked by its signature instead of trying each format's test in turn; TGA, which has
+    // none, is the fallback. bits_per_channel is 16 for the images stbi_is_16_bit reports, 32 for HDR (loaded as
+    // float) and 8 otherwise. the filename versions read through FILE rather than mapping the file, which for a
+    // header is cheaper, and mostly only read the first block of it.
+    typedef struct
+    {
+        int x, y, channels;
+        int bits_per_channel;
+        char const* format; // "jpeg", "png", "gif", "bmp", "psd", "pic", "pnm", "hdr" or "tga"
+    } stbi_image_info;
+
+    STBIDEF int      stbi_probe_from_memory(stbi_uc const* buffer, int len, stbi_image_info* info);
+    STBIDEF int      stbi_probe_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_image_info* info);
+
+#ifndef STBI_NO_STDIO
+    STBIDEF int      stbi_probe(char const* filename, stbi_image_info* info);
+    STBIDEF int      stbi_probe_from_file(FILE* f, stbi_image_info* info);
+#endif
+
 
 
     // for image formats that explicitly notate that they have premultiplied alpha,
@@ -524,6 +598,24 @@ extern "C" {
     STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_convert);
     STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_flip);
 
+    // decode JPEGs at 1/2, 1/4 or 1/8 of their size, the smallest of these that still is at least 'target_size'
+    // pixels wide or high, e.g. for thumbnails that are resized to 'target_size' afterwards. The reduction happens
+    // in the IDCT, so it saves decoding time and memory. stbi_info reports the reduced size. 0, the default, decodes
+    // at full size; other formats are not affected. The _thread version only applies to the calling thread like
+    // the functions above.
+    STBIDEF void stbi_set_jpeg_target_size(int target_size);
+    STBIDEF void stbi_set_jpeg_target_size_thread(int target_size);
+
+    // decode large images on several threads. stb_image creates no threads itself: it splits a decode into
+    // tasks and hands them to 'run', which has to call task(data, 0) .. task(data, count - 1), concurrently
+    // if it can, and return once all of them finished. Tasks never allocate memory. NULL, the default,
+    // runs everything on the calling thread. Used for images with at least 1 MB of pixel data: non-interlaced
+    // PNGs, and JPEGs, whose color conversion is split into strips. Baseline JPEGs with restart markers that are
+    // decoded from memory (not from a FILE or callbacks) are decoded a run of restart intervals per task.
+    typedef void stbi_parallel_task(void* data, int index);
+    typedef void stbi_parallel_run(stbi_parallel_task* task, void* data, int count);
+    STBIDEF void stbi_set_parallel_run(stbi_parallel_run* run);
+
     // ZLIB client - used by PNG, available for other purposes
 
     STBIDEF char* stbi_zlib_decode_malloc_guesssize(const char* buffer, int len, int initial_size, int* outlen);
@@ -598,6 +690,14 @@ extern "C" {
 #include <stdio.h>
 #endif
 
+#if !defined(STBI_NO_STDIO) && !defined(STBI_NO_MMAP) && (defined(__unix__) || defined(__APPLE__))
+#define STBI__MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 #ifndef STBI_ASSERT
 #include <assert.h>
 #define STBI_ASSERT(x) assert(x)
@@ -643,12 +743,14 @@ typedef unsigned short stbi__uint16;
 typedef   signed short stbi__int16;
 typedef unsigned int   stbi__uint32;
 typedef   signed int   stbi__int32;
+typedef unsigned __int64 stbi__uint64;
 #else
 #include <stdint.h>
 typedef uint16_t stbi__uint16;
 typedef int16_t  stbi__int16;
 typedef uint32_t stbi__uint32;
 typedef int32_t  stbi__int32;
+typedef uint64_t stbi__uint64;
 #endif
 
 // should produce compiler error if size is wrong
@@ -750,7 +852,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     int info3 = stbi__cpuid3();
@@ -761,7 +863,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
     // If we're even attempting to compile this on GCC/Clang, that means
@@ -817,6 +919,17 @@ typedef struct
 
     stbi_uc* img_buffer, * img_buffer_end;
     stbi_uc* img_buffer_original, * img_buffer_original_end;
+
+    // caller's buffer for stbi_load_into, NULL when the decoder allocates the image
+    stbi_uc* out_buffer;
+    size_t out_size;
+    int out_stride;
+    int out_flip;
+
+    // band callback for stbi_load_bands, NULL otherwise. band_y is the first row not handed out yet
+    stbi_band_callback* band;
+    void* band_user;
+    int band_rows, band_y;
 } stbi__context;
 
 
@@ -828,6 +941,8 @@ static void stbi__start_mem(stbi__context* s, stbi_uc const* buffer, int len)
     s->io.read = NULL;
     s->read_from_callbacks = 0;
     s->callback_already_read = 0;
+    s->out_buffer = NULL;
+    s->band = NULL;
     s->img_buffer = s->img_buffer_original = (stbi_uc*)buffer;
     s->img_buffer_end = s->img_buffer_original_end = (stbi_uc*)buffer + len;
 }
@@ -840,6 +955,8 @@ static void stbi__start_callbacks(stbi__context* s, stbi_io_callbacks* c, void*
     s->buflen = sizeof(s->buffer_start);
     s->read_from_callbacks = 1;
     s->callback_already_read = 0;
+    s->out_buffer = NULL;
+    s->band = NULL;
     s->img_buffer = s->img_buffer_original = s->buffer_start;
     stbi__refill_buffer(s);
     s->img_buffer_original_end = s->img_buffer_end;
@@ -905,6 +1022,31 @@ typedef struct
     int channel_order;
 } stbi__result_info;
 
+// whether a decoder can write its x*y image with 'channels' 8-bit channels straight into the caller's buffer,
+// only call it once the decoder is committed to do so
+static int stbi__out_direct(stbi__context* s, stbi__uint32 x, stbi__uint32 y, int channels)
+{
+    size_t row_bytes = (size_t)x * channels;
+    size_t stride;
+    if (!s->out_buffer || x == 0 || y == 0) return 0;
+    stride = s->out_stride ? (size_t)s->out_stride : row_bytes;
+    if (stride < row_bytes || (y - 1) * stride + row_bytes > s->out_size) return 0;
+    s->out_stride = (int)stride;
+    return 1;
+}
+
+// row 'row' of the caller's buffer, flipped here so the decoder writes every row exactly once
+static stbi_uc* stbi__out_row(stbi__context* s, stbi__uint32 row)
+{
+    if (s->out_flip) row = s->img_y - 1 - row;
+    return s->out_buffer + (size_t)row * s->out_stride;
+}
+
+// what decoders that handed every row to the band callback return instead of an image
+#define stbi__bands_done(s)  ((void*)&(s)->band_y)
+
+static int stbi__band_out(stbi__context* s, stbi_uc const* pixels, int rows, int channels);
+
 #ifndef STBI_NO_JPEG
 static int      stbi__jpeg_test(stbi__context* s);
 static void* stbi__jpeg_load(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri);
@@ -1134,6 +1276,36 @@ STBIDEF void stbi_set_flip_vertically_on_load_thread(int flag_true_if_should_fli
                                          : stbi__vertically_flip_on_load_global)
 #endif // STBI_THREAD_LOCAL
 
+static int stbi__jpeg_target_size_global = 0;
+
+STBIDEF void stbi_set_jpeg_target_size(int target_size)
+{
+    stbi__jpeg_target_size_global = target_size;
+}
+
+#ifndef STBI_THREAD_LOCAL
+#define stbi__jpeg_target_size  stbi__jpeg_target_size_global
+#else
+static STBI_THREAD_LOCAL int stbi__jpeg_target_size_local, stbi__jpeg_target_size_set;
+
+STBIDEF void stbi_set_jpeg_target_size_thread(int target_size)
+{
+    stbi__jpeg_target_size_local = target_size;
+    stbi__jpeg_target_size_set = 1;
+}
+
+#define stbi__jpeg_target_size  (stbi__jpeg_target_size_set       \
+                                  ? stbi__jpeg_target_size_local  \
+                                  : stbi__jpeg_target_size_global)
+#endif // STBI_THREAD_LOCAL
+
+static stbi_parallel_run* stbi__parallel_run = NULL;
+
+STBIDEF void stbi_set_parallel_run(stbi_parallel_run* run)
+{
+    stbi__parallel_run = run;
+}
+
 static void* stbi__load_main(stbi__context* s, int* x, int* y, int* comp, int req_comp, stbi__result_info* ri, int bpc)
 {
     memset(ri, 0, sizeof(*ri)); // make sure it's initialized if we add new fields
@@ -1283,6 +1455,149 @@ static unsigned char* stbi__load_and_postprocess_8bit(stbi__context* s, int* x,
     return (unsigned char*)result;
 }
 
+// hand the next 'rows' rows of the image, tightly packed in 'pixels', to the band callback. returns 0 when the
+// callback stopped decoding, which the decoder then wraps up like after the last row
+static int stbi__band_out(stbi__context* s, stbi_uc const* pixels, int rows, int channels)
+{
+    int row = s->band_y;
+    s->band_y += rows;
+    return s->band(s->band_user, (int)s->img_x, (int)s->img_y, channels, row, rows, pixels);
+}
+
+// decode into s->out_buffer: PNG and JPEG write into it directly and return it, the image of any other decoder
+// is converted to 8 bits and copied in
+static int stbi__load_into_main(stbi__context* s, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__result_info ri;
+    void* result;
+    int w, h, c, channels, row;
+    size_t row_bytes;
+
+    if (stride < 0) return stbi__err("bad stride", "Negative stride");
+    s->out_buffer = output;
+    s->out_size = output_size;
+    s->out_stride = stride;
+    s->out_flip = stbi__vertically_flip_on_load;
+    result = stbi__load_main(s, &w, &h, &c, req_comp, &ri, 8);
+    if (result == NULL)
+        return 0;
+
+    if (result != output) {
+        channels = req_comp ? req_comp : c;
+        if (ri.bits_per_channel != 8) {
+            result = stbi__convert_16_to_8((stbi__uint16*)result, w, h, channels);
+            if (result == NULL) return 0;
+        }
+        s->img_y = h; // for stbi__out_row
+        if (!stbi__out_direct(s, w, h, channels)) {
+            STBI_FREE(result);
+            return stbi__err("buffer too small", "Output buffer too small for image");
+        }
+        row_bytes = (size_t)w * channels;
+        for (row = 0; row < h; ++row)
+            memcpy(stbi__out_row(s, row), (stbi_uc*)result + row * row_bytes, row_bytes);
+        STBI_FREE(result);
+    }
+
+    if (x) *x = w;
+    if (y) *y = h;
+    if (comp) *comp = c;
+    return 1;
+}
+
+// decode through the band callback: PNG and JPEG hand out bands as they decode them when they can and then return
+// stbi__bands_done, the image of any other decoder is converted to 8 bits and handed out here
+static int stbi__load_bands_main(stbi__context* s, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__result_info ri;
+    void* result;
+    int w, h, c, channels, row;
+
+    if (band_rows < 1) return stbi__err("bad band rows", "Bands need at least one row");
+    s->band = band;
+    s->band_user = band_user;
+    s->band_rows = band_rows;
+    s->band_y = 0;
+    result = stbi__load_main(s, &w, &h, &c, req_comp, &ri, 8);
+    if (result == NULL)
+        return 0;
+
+    if (result != stbi__bands_done(s)) {
+        channels = req_comp ? req_comp : c;
+        if (ri.bits_per_channel != 8) {
+            result = stbi__convert_16_to_8((stbi__uint16*)result, w, h, channels);
+            if (result == NULL) return 0;
+        }
+        s->img_x = w;
+        s->img_y = h;
+        for (row = 0; row < h; row += band_rows)
+            if (!stbi__band_out(s, (stbi_uc*)result + (size_t)row * w * channels, h - row < band_rows ? h - row : band_rows, channels))
+                break;
+        STBI_FREE(result);
+    }
+
+    if (x) *x = w;
+    if (y) *y = h;
+    if (comp) *comp = c;
+    return 1;
+}
+
+#define STBI__REGION_BAND_ROWS  32
+
+typedef struct
+{
+    int rx, ry, rw, rh;
+    stbi_uc* output;
+    size_t output_size;
+    int stride, flip;
+    int done; // rows of the rectangle copied, -1 when it does not fit
+} stbi__region;
+
+// band callback of stbi_load_region: copies the part of the band inside the rectangle, stops after its last row
+static int stbi__region_band(void* user, int x, int y, int channels, int row, int rows, stbi_uc const* pixels)
+{
+    stbi__region* r = (stbi__region*)user;
+    size_t row_bytes = (size_t)r->rw * channels;
+    int j;
+    if (row == 0) {
+        if (!r->stride) r->stride = (int)row_bytes;
+        if (r->rx > x - r->rw || r->ry > y - r->rh || (size_t)r->stride < row_bytes
+            || (size_t)(r->rh - 1) * r->stride + row_bytes > r->output_size) {
+            r->done = -1;
+            return 0;
+        }
+    }
+    for (j = row > r->ry ? row : r->ry; j < row + rows && j < r->ry + r->rh; ++j) {
+        int out_row = r->flip ? r->ry + r->rh - 1 - j : j - r->ry;
+        memcpy(r->output + (size_t)out_row * r->stride, pixels + ((size_t)(j - row) * x + r->rx) * channels, row_bytes);
+        ++r->done;
+    }
+    return r->done < r->rh;
+}
+
+static int stbi__load_region_main(stbi__context* s, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__region r;
+    int w, h, c;
+    if (rx < 0 || ry < 0 || rw < 1 || rh < 1) return stbi__err("bad region", "Empty or negative region");
+    if (stride < 0) return stbi__err("bad stride", "Negative stride");
+    r.rx = rx;
+    r.ry = ry;
+    r.rw = rw;
+    r.rh = rh;
+    r.output = output;
+    r.output_size = output_size;
+    r.stride = stride;
+    r.flip = stbi__vertically_flip_on_load;
+    r.done = 0;
+    if (!stbi__load_bands_main(s, STBI__REGION_BAND_ROWS, stbi__region_band, &r, &w, &h, &c, req_comp)) return 0;
+    if (r.done < rh) return stbi__err("bad region", "Region outside the image or buffer too small");
+    if (x) *x = w;
+    if (y) *y = h;
+    if (comp) *comp = c;
+    return 1;
+}
+
 static stbi__uint16* stbi__load_and_postprocess_16bit(stbi__context* s, int* x, int* y, int* comp, int req_comp)
 {
     stbi__result_info ri;
@@ -1362,11 +1677,78 @@ static FILE* stbi__fopen(char const* filename, char const* mode)
     return f;
 }
 
+#ifdef STBI__MMAP
+STBIDEF stbi_uc const* stbi_map_file(char const* filename, int* len)
+{
+    struct stat st;
+    void* map;
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) return stbi__errpuc("can't fopen", "Unable to open file");
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX) {
+        close(fd);
+        return stbi__errpuc("can't mmap", "Not a regular file, empty or too large");
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping stays valid
+    if (map == MAP_FAILED) return stbi__errpuc("can't mmap", "Unable to map file");
+#ifdef POSIX_MADV_SEQUENTIAL // not declared in strict ISO C modes
+    // decoders read front to back, so the kernel can read ahead further than for random access
+    posix_madvise(map, (size_t)st.st_size, POSIX_MADV_SEQUENTIAL);
+#endif
+    *len = (int)st.st_size;
+    return (stbi_uc const*)map;
+}
+
+STBIDEF void stbi_unmap_file(stbi_uc const* data, int len)
+{
+    if (data) munmap((void*)data, (size_t)len);
+}
+#else
+STBIDEF stbi_uc const* stbi_map_file(char const* filename, int* len)
+{
+    // no mmap, read the whole file instead
+    stbi_uc* data;
+    long size;
+    FILE* f = stbi__fopen(filename, "rb");
+    if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0 || size > INT_MAX || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return stbi__errpuc("can't read", "Not seekable, empty or too large");
+    }
+    data = (stbi_uc*)stbi__malloc((size_t)size);
+    if (data && fread(data, 1, (size_t)size, f) != (size_t)size) {
+        STBI_FREE(data);
+        fclose(f);
+        return stbi__errpuc("can't read", "Unable to read file");
+    }
+    fclose(f);
+    if (!data) return stbi__errpuc("outofmem", "Out of memory");
+    *len = (int)size;
+    return data;
+}
+
+STBIDEF void stbi_unmap_file(stbi_uc const* data, int len)
+{
+    STBI_NOTUSED(len);
+    STBI_FREE((void*)data);
+}
+#endif
+
 
 STBIDEF stbi_uc* stbi_load(char const* filename, int* x, int* y, int* comp, int req_comp)
 {
-    FILE* f = stbi__fopen(filename, "rb");
+    FILE* f;
     unsigned char* result;
+#ifdef STBI__MMAP
+    int len;
+    stbi_uc const* map = stbi_map_file(filename, &len);
+    if (map) {
+        result = stbi_load_from_memory(map, len, x, y, comp, req_comp);
+        stbi_unmap_file(map, len);
+        return result;
+    }
+#endif
+    f = stbi__fopen(filename, "rb");
     if (!f) return stbi__errpuc("can't fopen", "Unable to open file");
     result = stbi_load_from_file(f, x, y, comp, req_comp);
     fclose(f);
@@ -1386,6 +1768,100 @@ STBIDEF stbi_uc* stbi_load_from_file(FILE* f, int* x, int* y, int* comp, int req
     return result;
 }
 
+STBIDEF int stbi_load_into(char const* filename, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    FILE* f;
+    int result;
+#ifdef STBI__MMAP
+    int len;
+    stbi_uc const* map = stbi_map_file(filename, &len);
+    if (map) {
+        result = stbi_load_into_from_memory(map, len, output, output_size, stride, x, y, comp, req_comp);
+        stbi_unmap_file(map, len);
+        return result;
+    }
+#endif
+    f = stbi__fopen(filename, "rb");
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi_load_into_from_file(f, output, output_size, stride, x, y, comp, req_comp);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_load_into_from_file(FILE* f, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    int result;
+    stbi__context s;
+    stbi__start_file(&s, f);
+    result = stbi__load_into_main(&s, output, output_size, stride, x, y, comp, req_comp);
+    if (result) {
+        // need to 'unget' all the characters in the IO buffer
+        fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+    }
+    return result;
+}
+
+STBIDEF int stbi_load_bands(char const* filename, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* comp, int req_comp)
+{
+    FILE* f;
+    int result;
+#ifdef STBI__MMAP
+    int len;
+    stbi_uc const* map = stbi_map_file(filename, &len);
+    if (map) {
+        result = stbi_load_bands_from_memory(map, len, band_rows, band, band_user, x, y, comp, req_comp);
+        stbi_unmap_file(map, len);
+        return result;
+    }
+#endif
+    f = stbi__fopen(filename, "rb");
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi_load_bands_from_file(f, band_rows, band, band_user, x, y, comp, req_comp);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_load_bands_from_file(FILE* f, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* comp, int req_comp)
+{
+    int result;
+    stbi__context s;
+    stbi__start_file(&s, f);
+    result = stbi__load_bands_main(&s, band_rows, band, band_user, x, y, comp, req_comp);
+    if (result) {
+        // need to 'unget' all the characters in the IO buffer
+        fseek(f, -(int)(s.img_buffer_end - s.img_buffer), SEEK_CUR);
+    }
+    return result;
+}
+
+STBIDEF int stbi_load_region(char const* filename, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    FILE* f;
+    int result;
+#ifdef STBI__MMAP
+    int len;
+    stbi_uc const* map = stbi_map_file(filename, &len);
+    if (map) {
+        result = stbi_load_region_from_memory(map, len, rx, ry, rw, rh, output, output_size, stride, x, y, comp, req_comp);
+        stbi_unmap_file(map, len);
+        return result;
+    }
+#endif
+    f = stbi__fopen(filename, "rb");
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi_load_region_from_file(f, rx, ry, rw, rh, output, output_size, stride, x, y, comp, req_comp);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_load_region_from_file(FILE* f, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_file(&s, f);
+    // the file is left wherever decoding stopped
+    return stbi__load_region_main(&s, rx, ry, rw, rh, output, output_size, stride, x, y, comp, req_comp);
+}
+
 STBIDEF stbi__uint16* stbi_load_from_file_16(FILE* f, int* x, int* y, int* comp, int req_comp)
 {
     stbi__uint16* result;
@@ -1401,8 +1877,18 @@ STBIDEF stbi__uint16* stbi_load_from_file_16(FILE* f, int* x, int* y, int* comp,
 
 STBIDEF stbi_us* stbi_load_16(char const* filename, int* x, int* y, int* comp, int req_comp)
 {
-    FILE* f = stbi__fopen(filename, "rb");
+    FILE* f;
     stbi__uint16* result;
+#ifdef STBI__MMAP
+    int len;
+    stbi_uc const* map = stbi_map_file(filename, &len);
+    if (map) {
+        result = stbi_load_16_from_memory(map, len, x, y, comp, req_comp);
+        stbi_unmap_file(map, len);
+        return result;
+    }
+#endif
+    f = stbi__fopen(filename, "rb");
     if (!f) return (stbi_us*)stbi__errpuc("can't fopen", "Unable to open file");
     result = stbi_load_from_file_16(f, x, y, comp, req_comp);
     fclose(f);
@@ -1440,6 +1926,48 @@ STBIDEF stbi_uc* stbi_load_from_callbacks(stbi_io_callbacks const* clbk, void* u
     return stbi__load_and_postprocess_8bit(&s, x, y, comp, req_comp);
 }
 
+STBIDEF int stbi_load_into_from_memory(stbi_uc const* buffer, int len, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__load_into_main(&s, output, output_size, stride, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_into_from_callbacks(stbi_io_callbacks const* clbk, void* user, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+    return stbi__load_into_main(&s, output, output_size, stride, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_bands_from_memory(stbi_uc const* buffer, int len, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__load_bands_main(&s, band_rows, band, band_user, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_bands_from_callbacks(stbi_io_callbacks const* clbk, void* user, int band_rows, stbi_band_callback* band, void* band_user, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+    return stbi__load_bands_main(&s, band_rows, band, band_user, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_region_from_memory(stbi_uc const* buffer, int len, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__load_region_main(&s, rx, ry, rw, rh, output, output_size, stride, x, y, comp, req_comp);
+}
+
+STBIDEF int stbi_load_region_from_callbacks(stbi_io_callbacks const* clbk, void* user, int rx, int ry, int rw, int rh, stbi_uc* output, size_t output_size, int stride, int* x, int* y, int* comp, int req_comp)
+{
+    stbi__context s;
+    stbi__start_callbacks(&s, (stbi_io_callbacks*)clbk, user);
+    return stbi__load_region_main(&s, rx, ry, rw, rh, output, output_size, stride, x, y, comp, req_comp);
+}
+
 #ifndef STBI_NO_GIF
 STBIDEF stbi_uc* stbi_load_gif_from_memory(stbi_uc const* buffer, int len, int** delays, int* x, int* y, int* z, int* comp, int req_comp)
 {
@@ -1492,8 +2020,18 @@ STBIDEF float* stbi_loadf_from_callbacks(stbi_io_callbacks const* clbk, void* us
 #ifndef STBI_NO_STDIO
 STBIDEF float* stbi_loadf(char const* filename, int* x, int* y, int* comp, int req_comp)
 {
+    FILE* f;
     float* result;
-    FILE* f = stbi__fopen(filename, "rb");
+#ifdef STBI__MMAP
+    int len;
+    stbi_uc const* map = stbi_map_file(filename, &len);
+    if (map) {
+        result = stbi_loadf_from_memory(map, len, x, y, comp, req_comp);
+        stbi_unmap_file(map, len);
+        return result;
+    }
+#endif
+    f = stbi__fopen(filename, "rb");
     if (!f) return stbi__errpf("can't fopen", "Unable to open file");
     result = stbi_loadf_from_file(f, x, y, comp, req_comp);
     fclose(f);
@@ -1972,6 +2510,7 @@ typedef struct
 
         int x, y, w2, h2;
         stbi_uc* data;
+        int y0;         // the plane row at 'data', nonzero when decoding in bands
         void* raw_data, * raw_coeff;
         stbi_uc* linebuf;
         short* coeff;   // progressive only
@@ -1992,12 +2531,17 @@ typedef struct
     int            jfif;
     int            app14_color_transform; // Adobe APP14 tag
     int            rgb;
+    int            scale; // log2 of the reduction, blocks decode to (8 >> scale) pixels square
+    int            bands; // band output: 1 while the planes hold two MCU rows, 2 once decoded, see stbi__jpeg_decode_bands
+    int            req_comp;
 
     int scan_n, order[4];
     int restart_interval, todo;
 
     // kernels
     void (*idct_block_kernel)(stbi_uc* out, int out_stride, short data[64]);
+    // two horizontally adjacent blocks at once, NULL when that's no faster than two idct_block_kernel calls
+    void (*idct_pair_kernel)(stbi_uc* out, int out_stride, short data0[64], short data1[64]);
     void (*YCbCr_to_RGB_kernel)(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step);
     stbi_uc* (*resample_row_hv_2_kernel)(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs);
 } stbi__jpeg;
@@ -2536,6 +3080,69 @@ static void stbi__idct_block(stbi_uc* out, int out_stride, short data[64])
     }
 }
 
+// reduced-size IDCTs for decoding at 1/2, 1/4 and 1/8 size (stbi_set_jpeg_target_size). An NxN block is the N-point
+// IDCT of the lowest NxN coefficients, scaled like the 8x8 one so a flat block keeps its value:
+// out(x) = 1/2 sum C(u) F(u) cos((2x+1)u pi/2N) per direction, C(0) = 1/sqrt(2). With constants * 2048 that's
+// 1448 = C(0) = cos(pi/4), 1892 = cos(pi/8) and 784 = cos(3pi/8) for N = 4; the column pass keeps one extra bit.
+#define STBI__IDCT_4(x0,x1,x2,x3, f0,f1,f2,f3) \
+    { \
+        int e0 = ((f0) + (f2)) * 1448, e1 = ((f0) - (f2)) * 1448; \
+        int o0 = (f1) * 1892 + (f3) * 784, o1 = (f1) * 784 - (f3) * 1892; \
+        x0 = e0 + o0; x3 = e0 - o0; \
+        x1 = e1 + o1; x2 = e1 - o1; \
+    }
+
+static void stbi__idct_block_4x4(stbi_uc* out, int out_stride, short data[64])
+{
+    int i, x0, x1, x2, x3, v[16], * t;
+    short* d = data;
+
+    // columns
+    for (i = 0; i < 4; ++i, ++d) {
+        if (d[8] == 0 && d[16] == 0 && d[24] == 0) {
+            // flat column, a common case
+            v[i] = v[4 + i] = v[8 + i] = v[12 + i] = (d[0] * 1448 + 1024) >> 11;
+        }
+        else {
+            STBI__IDCT_4(x0, x1, x2, x3, d[0], d[8], d[16], d[24]);
+            v[i] = (x0 + 1024) >> 11;
+            v[4 + i] = (x1 + 1024) >> 11;
+            v[8 + i] = (x2 + 1024) >> 11;
+            v[12 + i] = (x3 + 1024) >> 11;
+        }
+    }
+
+    // rows, undoing the extra bit and the 2048 scale and adding the 128 level shift
+    for (i = 0, t = v; i < 4; ++i, t += 4, out += out_stride) {
+        STBI__IDCT_4(x0, x1, x2, x3, t[0], t[1], t[2], t[3]);
+        out[0] = stbi__clamp(((x0 + 4096) >> 13) + 128);
+        out[1] = stbi__clamp(((x1 + 4096) >> 13) + 128);
+        out[2] = stbi__clamp(((x2 + 4096) >> 13) + 128);
+        out[3] = stbi__clamp(((x3 + 4096) >> 13) + 128);
+    }
+}
+
+#undef STBI__IDCT_4
+
+static void stbi__idct_block_2x2(stbi_uc* out, int out_stride, short data[64])
+{
+    // 1448 = C(0) = cos(pi/4), the only constant of the 2-point IDCT
+    int c0 = ((data[0] + data[8]) * 1448 + 1024) >> 11, c1 = ((data[1] + data[9]) * 1448 + 1024) >> 11;
+    int c2 = ((data[0] - data[8]) * 1448 + 1024) >> 11, c3 = ((data[1] - data[9]) * 1448 + 1024) >> 11;
+    out[0] = stbi__clamp((((c0 + c1) * 1448 + 4096) >> 13) + 128);
+    out[1] = stbi__clamp((((c0 - c1) * 1448 + 4096) >> 13) + 128);
+    out += out_stride;
+    out[0] = stbi__clamp((((c2 + c3) * 1448 + 4096) >> 13) + 128);
+    out[1] = stbi__clamp((((c2 - c3) * 1448 + 4096) >> 13) + 128);
+}
+
+// 1x1 is the block average, the DC coefficient / 8
+static void stbi__idct_block_1x1(stbi_uc* out, int out_stride, short data[64])
+{
+    STBI_NOTUSED(out_stride);
+    out[0] = stbi__clamp(((data[0] + 4) >> 3) + 128);
+}
+
 #ifdef STBI_SSE2
 // sse2 integer IDCT. not the fastest possible implementation but it
 // produces bit-identical results to the generic C version so it's
@@ -2715,21 +3322,218 @@ static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
 #undef dct_pass
 }
 
-#endif // STBI_SSE2
+// AVX2 kernels, picked at runtime in stbi__setup_jpeg when the CPU has them. Each one is the SSE2 kernel with two
+// independent halves side by side in the 128-bit lanes of a 256-bit register, so the results are bit-identical too.
+#include <immintrin.h>
 
-#ifdef STBI_NEON
+#ifdef __GNUC__
+#define STBI__AVX2_TARGET __attribute__((target("avx2")))
+#else
+#define STBI__AVX2_TARGET
+#endif
 
-// NEON integer IDCT. should produce bit-identical
-// results to the generic C version.
-static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
+static int stbi__avx2_available(void)
 {
-    int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
-
-    int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
-    int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
-    int16x4_t rot0_2 = vdup_n_s16(stbi__f2f(0.765366865f));
-    int16x4_t rot1_0 = vdup_n_s16(stbi__f2f(1.175875602f));
-    int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
+#if defined(_MSC_VER) && _MSC_VER >= 1600
+    int info[4];
+    __cpuid(info, 1);
+    // the OS has to save the ymm registers too (OSXSAVE and AVX, then XCR0 bits 1 and 2)
+    if (((info[2] >> 27) & 3) != 3 || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuidex(info, 7, 0);
+    return ((info[1] >> 5) & 1) != 0;
+#elif defined(__GNUC__)
+    return __builtin_cpu_supports("avx2");
+#else
+    return 0;
+#endif
+}
+
+// IDCT of two horizontally adjacent blocks, data0 to the left of data1: block 0 goes through the low lanes, block 1
+// through the high ones, and each output row is a single 16 byte store.
+static STBI__AVX2_TARGET void stbi__idct_pair_avx2(stbi_uc* out, int out_stride, short data0[64], short data1[64])
+{
+    __m256i row0, row1, row2, row3, row4, row5, row6, row7;
+    __m256i tmp;
+
+    // dot product constant: even elems=x, odd elems=y
+#define dct_const(x,y)  _mm256_set1_epi32((int)(((unsigned int)(y) << 16) | ((x) & 0xffff)))
+
+#define dct_rot(out0,out1, x,y,c0,c1) \
+      __m256i c0##lo = _mm256_unpacklo_epi16((x),(y)); \
+      __m256i c0##hi = _mm256_unpackhi_epi16((x),(y)); \
+      __m256i out0##_l = _mm256_madd_epi16(c0##lo, c0); \
+      __m256i out0##_h = _mm256_madd_epi16(c0##hi, c0); \
+      __m256i out1##_l = _mm256_madd_epi16(c0##lo, c1); \
+      __m256i out1##_h = _mm256_madd_epi16(c0##hi, c1)
+
+#define dct_widen(out, in) \
+      __m256i out##_l = _mm256_srai_epi32(_mm256_unpacklo_epi16(_mm256_setzero_si256(), (in)), 4); \
+      __m256i out##_h = _mm256_srai_epi32(_mm256_unpackhi_epi16(_mm256_setzero_si256(), (in)), 4)
+
+#define dct_wadd(out, a, b) \
+      __m256i out##_l = _mm256_add_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_add_epi32(a##_h, b##_h)
+
+#define dct_wsub(out, a, b) \
+      __m256i out##_l = _mm256_sub_epi32(a##_l, b##_l); \
+      __m256i out##_h = _mm256_sub_epi32(a##_h, b##_h)
+
+#define dct_bfly32o(out0, out1, a,b,bias,s) \
+      { \
+         __m256i abiased_l = _mm256_add_epi32(a##_l, bias); \
+         __m256i abiased_h = _mm256_add_epi32(a##_h, bias); \
+         dct_wadd(sum, abiased, b); \
+         dct_wsub(dif, abiased, b); \
+         out0 = _mm256_packs_epi32(_mm256_srai_epi32(sum_l, s), _mm256_srai_epi32(sum_h, s)); \
+         out1 = _mm256_packs_epi32(_mm256_srai_epi32(dif_l, s), _mm256_srai_epi32(dif_h, s)); \
+      }
+
+#define dct_interleave8(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi8(a, b); \
+      b = _mm256_unpackhi_epi8(tmp, b)
+
+#define dct_interleave16(a, b) \
+      tmp = a; \
+      a = _mm256_unpacklo_epi16(a, b); \
+      b = _mm256_unpackhi_epi16(tmp, b)
+
+#define dct_pass(bias,shift) \
+      { \
+         /* even part */ \
+         dct_rot(t2e,t3e, row2,row6, rot0_0,rot0_1); \
+         __m256i sum04 = _mm256_add_epi16(row0, row4); \
+         __m256i dif04 = _mm256_sub_epi16(row0, row4); \
+         dct_widen(t0e, sum04); \
+         dct_widen(t1e, dif04); \
+         dct_wadd(x0, t0e, t3e); \
+         dct_wsub(x3, t0e, t3e); \
+         dct_wadd(x1, t1e, t2e); \
+         dct_wsub(x2, t1e, t2e); \
+         /* odd part */ \
+         dct_rot(y0o,y2o, row7,row3, rot2_0,rot2_1); \
+         dct_rot(y1o,y3o, row5,row1, rot3_0,rot3_1); \
+         __m256i sum17 = _mm256_add_epi16(row1, row7); \
+         __m256i sum35 = _mm256_add_epi16(row3, row5); \
+         dct_rot(y4o,y5o, sum17,sum35, rot1_0,rot1_1); \
+         dct_wadd(x4, y0o, y4o); \
+         dct_wadd(x5, y1o, y5o); \
+         dct_wadd(x6, y2o, y5o); \
+         dct_wadd(x7, y3o, y4o); \
+         dct_bfly32o(row0,row7, x0,x7,bias,shift); \
+         dct_bfly32o(row1,row6, x1,x6,bias,shift); \
+         dct_bfly32o(row2,row5, x2,x5,bias,shift); \
+         dct_bfly32o(row3,row4, x3,x4,bias,shift); \
+      }
+
+#define dct_load(r) \
+      _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_load_si128((const __m128i*) (data0 + (r) * 8))), \
+                              _mm_load_si128((const __m128i*) (data1 + (r) * 8)), 1)
+
+    // rows r and r+1 of both blocks are in the low and high 8 bytes of each lane of p: gather each row in one lane
+#define dct_store(p) \
+      { \
+         __m256i rows = _mm256_permute4x64_epi64(p, 0xd8); \
+         _mm_storeu_si128((__m128i*) out, _mm256_castsi256_si128(rows)); out += out_stride; \
+         _mm_storeu_si128((__m128i*) out, _mm256_extracti128_si256(rows, 1)); out += out_stride; \
+      }
+
+    __m256i rot0_0 = dct_const(stbi__f2f(0.5411961f), stbi__f2f(0.5411961f) + stbi__f2f(-1.847759065f));
+    __m256i rot0_1 = dct_const(stbi__f2f(0.5411961f) + stbi__f2f(0.765366865f), stbi__f2f(0.5411961f));
+    __m256i rot1_0 = dct_const(stbi__f2f(1.175875602f) + stbi__f2f(-0.899976223f), stbi__f2f(1.175875602f));
+    __m256i rot1_1 = dct_const(stbi__f2f(1.175875602f), stbi__f2f(1.175875602f) + stbi__f2f(-2.562915447f));
+    __m256i rot2_0 = dct_const(stbi__f2f(-1.961570560f) + stbi__f2f(0.298631336f), stbi__f2f(-1.961570560f));
+    __m256i rot2_1 = dct_const(stbi__f2f(-1.961570560f), stbi__f2f(-1.961570560f) + stbi__f2f(3.072711026f));
+    __m256i rot3_0 = dct_const(stbi__f2f(-0.390180644f) + stbi__f2f(2.053119869f), stbi__f2f(-0.390180644f));
+    __m256i rot3_1 = dct_const(stbi__f2f(-0.390180644f), stbi__f2f(-0.390180644f) + stbi__f2f(1.501321110f));
+
+    __m256i bias_0 = _mm256_set1_epi32(512);
+    __m256i bias_1 = _mm256_set1_epi32(65536 + (128 << 17));
+
+    row0 = dct_load(0);
+    row1 = dct_load(1);
+    row2 = dct_load(2);
+    row3 = dct_load(3);
+    row4 = dct_load(4);
+    row5 = dct_load(5);
+    row6 = dct_load(6);
+    row7 = dct_load(7);
+
+    // column pass
+    dct_pass(bias_0, 10);
+
+    {
+        // 16bit 8x8 transpose, per lane
+        dct_interleave16(row0, row4);
+        dct_interleave16(row1, row5);
+        dct_interleave16(row2, row6);
+        dct_interleave16(row3, row7);
+
+        dct_interleave16(row0, row2);
+        dct_interleave16(row1, row3);
+        dct_interleave16(row4, row6);
+        dct_interleave16(row5, row7);
+
+        dct_interleave16(row0, row1);
+        dct_interleave16(row2, row3);
+        dct_interleave16(row4, row5);
+        dct_interleave16(row6, row7);
+    }
+
+    // row pass
+    dct_pass(bias_1, 17);
+
+    {
+        __m256i p0 = _mm256_packus_epi16(row0, row1);
+        __m256i p1 = _mm256_packus_epi16(row2, row3);
+        __m256i p2 = _mm256_packus_epi16(row4, row5);
+        __m256i p3 = _mm256_packus_epi16(row6, row7);
+
+        // 8bit 8x8 transpose, per lane
+        dct_interleave8(p0, p2);
+        dct_interleave8(p1, p3);
+
+        dct_interleave8(p0, p1);
+        dct_interleave8(p2, p3);
+
+        dct_interleave8(p0, p2);
+        dct_interleave8(p1, p3);
+
+        dct_store(p0);
+        dct_store(p2);
+        dct_store(p1);
+        dct_store(p3);
+    }
+
+#undef dct_const
+#undef dct_rot
+#undef dct_widen
+#undef dct_wadd
+#undef dct_wsub
+#undef dct_bfly32o
+#undef dct_interleave8
+#undef dct_interleave16
+#undef dct_pass
+#undef dct_load
+#undef dct_store
+}
+
+#endif // STBI_SSE2
+
+#ifdef STBI_NEON
+
+// NEON integer IDCT. should produce bit-identical
+// results to the generic C version.
+static void stbi__idct_simd(stbi_uc* out, int out_stride, short data[64])
+{
+    int16x8_t row0, row1, row2, row3, row4, row5, row6, row7;
+
+    int16x4_t rot0_0 = vdup_n_s16(stbi__f2f(0.5411961f));
+    int16x4_t rot0_1 = vdup_n_s16(stbi__f2f(-1.847759065f));
+    int16x4_t rot0_2 = vdup_n_s16(stbi__f2f(0.765366865f));
+    int16x4_t rot1_0 = vdup_n_s16(stbi__f2f(1.175875602f));
+    int16x4_t rot1_1 = vdup_n_s16(stbi__f2f(-0.899976223f));
     int16x4_t rot1_2 = vdup_n_s16(stbi__f2f(-2.562915447f));
     int16x4_t rot2_0 = vdup_n_s16(stbi__f2f(-1.961570560f));
     int16x4_t rot2_1 = vdup_n_s16(stbi__f2f(-0.390180644f));
@@ -2959,69 +3763,224 @@ static void stbi__jpeg_reset(stbi__jpeg* j)
     // since we don't even allow 1<<30 pixels
 }
 
-static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
+// where the block at pixel (x, y) of component n goes, in a plane of w2 >> z->scale bytes per row
+static stbi_uc* stbi__jpeg_block_out(stbi__jpeg* z, int n, int x, int y)
 {
-    stbi__jpeg_reset(z);
-    if (!z->progressive) {
-        if (z->scan_n == 1) {
-            int i, j;
-            STBI_SIMD_ALIGN(short, data[64]);
-            int n = z->order[0];
-            // non-interleaved data, we just need to process one block at a time,
-            // in trivial scanline order
-            // number of blocks to do just depends on how many actual "pixels" this
-            // component has, independent of interleaved MCU blocking and such
-            int w = (z->img_comp[n].x + 7) >> 3;
-            int h = (z->img_comp[n].y + 7) >> 3;
-            for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
-                    int ha = z->img_comp[n].ha;
-                    if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
-                    // every data block is an MCU, so countdown the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        // if it's NOT a restart, then just bail, so we get corrupt data
-                        // rather than no data
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
+    return z->img_comp[n].data + (z->img_comp[n].w2 >> z->scale) * ((y >> z->scale) - z->img_comp[n].y0) + (x >> z->scale);
+}
+
+// IDCT of the blocks data0 and data1, data1 being the one to the right of data0
+static void stbi__jpeg_idct_pair(stbi__jpeg* z, stbi_uc* out, int out_stride, short data0[64], short data1[64])
+{
+    if (z->idct_pair_kernel) {
+        z->idct_pair_kernel(out, out_stride, data0, data1);
+    } else {
+        z->idct_block_kernel(out, out_stride, data0);
+        z->idct_block_kernel(out + (8 >> z->scale), out_stride, data1);
+    }
+}
+
+// decode MCUs [first, last) of a baseline scan, in scan order. Like the whole scan, this stops early when a restart
+// interval is not followed by a restart marker, and leaves z->todo at 0 then
+static int stbi__jpeg_decode_mcus(stbi__jpeg* z, int first, int last)
+{
+    int m;
+    STBI_SIMD_ALIGN(short, data[2][64]);
+    if (z->scan_n == 1) {
+        int n = z->order[0];
+        // non-interleaved data, we just need to process one block at a time,
+        // in trivial scanline order
+        // number of blocks to do just depends on how many actual "pixels" this
+        // component has, independent of interleaved MCU blocking and such
+        int w = (z->img_comp[n].x + 7) >> 3;
+        int i = first % w, j = first / w;
+        int stride = z->img_comp[n].w2 >> z->scale;
+        int pending = 0; // with a pair kernel, the block left of this one waits in data[0] to be transformed with it
+        for (m = first; m < last; ++m) {
+            int ha = z->img_comp[n].ha;
+            stbi_uc* out = stbi__jpeg_block_out(z, n, i * 8, j * 8);
+            if (!stbi__jpeg_decode_block(z, data[pending], z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            if (pending) {
+                z->idct_pair_kernel(out - 8, stride, data[0], data[1]);
+                pending = 0;
+            } else if (z->idct_pair_kernel && i + 1 < w && m + 1 < last) {
+                pending = 1;
+            } else {
+                z->idct_block_kernel(out, stride, data[0]);
+            }
+            if (++i == w) { i = 0; ++j; }
+            // every data block is an MCU, so countdown the restart interval
+            if (--z->todo <= 0) {
+                if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                // if it's NOT a restart, then just bail, so we get corrupt data
+                // rather than no data
+                if (!STBI__RESTART(z->marker)) {
+                    if (pending) z->idct_block_kernel(out, stride, data[0]);
+                    return 1;
                 }
+                stbi__jpeg_reset(z);
             }
-            return 1;
         }
-        else { // interleaved
-            int i, j, k, x, y;
-            STBI_SIMD_ALIGN(short, data[64]);
-            for (j = 0; j < z->img_mcu_y; ++j) {
-                for (i = 0; i < z->img_mcu_x; ++i) {
-                    // scan an interleaved mcu... process scan_n components in order
-                    for (k = 0; k < z->scan_n; ++k) {
-                        int n = z->order[k];
-                        // scan out an mcu's worth of this component; that's just determined
-                        // by the basic H and V specified for the component
-                        for (y = 0; y < z->img_comp[n].v; ++y) {
-                            for (x = 0; x < z->img_comp[n].h; ++x) {
-                                int x2 = (i * z->img_comp[n].h + x) * 8;
-                                int y2 = (j * z->img_comp[n].v + y) * 8;
-                                int ha = z->img_comp[n].ha;
-                                if (!stbi__jpeg_decode_block(z, data, z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
-                                z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * y2 + x2, z->img_comp[n].w2, data);
-                            }
+    }
+    else { // interleaved
+        int i = first % z->img_mcu_x, j = first / z->img_mcu_x, k, x, y;
+        for (m = first; m < last; ++m) {
+            // scan an interleaved mcu... process scan_n components in order
+            for (k = 0; k < z->scan_n; ++k) {
+                int n = z->order[k];
+                // scan out an mcu's worth of this component; that's just determined
+                // by the basic H and V specified for the component
+                // blocks next to each other in a row of the mcu are transformed in pairs
+                for (y = 0; y < z->img_comp[n].v; ++y) {
+                    for (x = 0; x < z->img_comp[n].h; x += 2) {
+                        int x2 = (i * z->img_comp[n].h + x) * 8;
+                        int y2 = (j * z->img_comp[n].v + y) * 8;
+                        int ha = z->img_comp[n].ha;
+                        int stride = z->img_comp[n].w2 >> z->scale;
+                        stbi_uc* out = stbi__jpeg_block_out(z, n, x2, y2);
+                        if (!stbi__jpeg_decode_block(z, data[0], z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                        if (x + 1 < z->img_comp[n].h) {
+                            if (!stbi__jpeg_decode_block(z, data[1], z->huff_dc + z->img_comp[n].hd, z->huff_ac + ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+                            stbi__jpeg_idct_pair(z, out, stride, data[0], data[1]);
+                        } else {
+                            z->idct_block_kernel(out, stride, data[0]);
                         }
                     }
-                    // after all interleaved components, that's an interleaved MCU,
-                    // so now count down the restart interval
-                    if (--z->todo <= 0) {
-                        if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
-                        if (!STBI__RESTART(z->marker)) return 1;
-                        stbi__jpeg_reset(z);
-                    }
                 }
             }
-            return 1;
+            if (++i == z->img_mcu_x) { i = 0; ++j; }
+            // after all interleaved components, that's an interleaved MCU,
+            // so now count down the restart interval
+            if (--z->todo <= 0) {
+                if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+                if (!STBI__RESTART(z->marker)) return 1;
+                stbi__jpeg_reset(z);
+            }
         }
     }
+    return 1;
+}
+
+// MCUs in the current scan
+static int stbi__jpeg_scan_mcus(stbi__jpeg* z)
+{
+    if (z->scan_n == 1) {
+        int n = z->order[0];
+        return ((z->img_comp[n].x + 7) >> 3) * ((z->img_comp[n].y + 7) >> 3);
+    }
+    return z->img_mcu_x * z->img_mcu_y;
+}
+
+// Parallel decoding of baseline scans with restart markers, see stbi_set_parallel_run. Every restart interval starts
+// with a fresh entropy decoder and DC prediction, so once the markers of a scan in memory are found, runs of intervals
+// are decoded by separate tasks, each on its own copy of the decoder. An interval only counts when it ends at its
+// marker just like it does when decoding serially; if one does not, or there is an error, the scan is decoded again
+// on the calling thread, which reports errors the usual way. Large images are also idct'd (progressive ones) and
+// color converted in strips of rows.
+#define STBI__JPEG_PARALLEL_MIN  (1 << 20)  // decoded bytes, smaller scans and images are not worth it
+#define STBI__JPEG_MAX_TASKS     64
+#define STBI__JPEG_STRIPS        16         // bands of rows transformed and color converted in parallel
+
+typedef struct
+{
+    stbi__jpeg* z;
+    stbi_uc** intervals; // where each restart interval starts in the input
+    int count, mcus, tasks;
+    int ok[STBI__JPEG_MAX_TASKS];
+    stbi__jpeg end;      // the decoder after the last interval, the scan goes on from there
+    stbi_uc* end_buffer;
+} stbi__jpeg_intervals_job;
+
+static void stbi__jpeg_intervals_task(void* data, int index)
+{
+    stbi__jpeg_intervals_job* job = (stbi__jpeg_intervals_job*)data;
+    stbi__jpeg z = *job->z;
+    stbi__context s = *job->z->s;
+    int k, first = (int)((stbi__uint64)job->count * index / job->tasks), last = (int)((stbi__uint64)job->count * (index + 1) / job->tasks);
+    int ok = 1;
+    z.s = &s;
+    for (k = first; k < last && ok; ++k) {
+        int m = k * z.restart_interval;
+        s.img_buffer = job->intervals[k];
+        stbi__jpeg_reset(&z);
+        ok = stbi__jpeg_decode_mcus(&z, m, job->mcus - m < z.restart_interval ? job->mcus : m + z.restart_interval);
+        // every interval but the last has to end by reading the restart marker that starts the next one
+        if (k + 1 < job->count && z.todo <= 0) ok = 0;
+    }
+    if (ok && last == job->count) {
+        job->end = z;
+        job->end_buffer = s.img_buffer;
+    }
+    job->ok[index] = ok;
+}
+
+// Returns 1 when it decoded the scan, 0 if the scan has to be decoded serially.
+static int stbi__jpeg_decode_intervals_parallel(stbi__jpeg* z)
+{
+    stbi__context* s = z->s;
+    stbi__jpeg_intervals_job* job;
+    stbi_uc* p;
+    int i, k, needed, blocks = 0, ok = 1;
+
+    if (!stbi__parallel_run || !z->restart_interval || s->read_from_callbacks) return 0;
+    for (k = 0; k < z->scan_n; ++k)
+        blocks += z->scan_n == 1 ? 1 : z->img_comp[z->order[k]].h * z->img_comp[z->order[k]].v;
+    if ((double)stbi__jpeg_scan_mcus(z) * blocks * 64 < STBI__JPEG_PARALLEL_MIN) return 0;
+    needed = (stbi__jpeg_scan_mcus(z) + z->restart_interval - 1) / z->restart_interval;
+    if (needed < 2) return 0;
+
+    job = (stbi__jpeg_intervals_job*)stbi__malloc(sizeof(*job));
+    if (!job) return 0;
+    job->intervals = (stbi_uc**)stbi__malloc_mad2(needed, sizeof(stbi_uc*), 0);
+    if (!job->intervals) { STBI_FREE(job); return 0; }
+    job->z = z;
+    job->mcus = stbi__jpeg_scan_mcus(z);
+
+    // the scan goes on over restart markers and ends at any other marker, see stbi__grow_buffer_unsafe
+    job->count = 0;
+    job->intervals[job->count++] = p = s->img_buffer;
+    while (job->count < needed) {
+        p = (stbi_uc*)memchr(p, 0xff, s->img_buffer_end - p);
+        if (!p) break;
+        do ++p; while (p < s->img_buffer_end && *p == 0xff); // consume fill bytes
+        if (p == s->img_buffer_end) break;
+        if (*p == 0) continue; // a stuffed 0xff byte of the data
+        if (!STBI__RESTART(*p)) break;
+        job->intervals[job->count++] = ++p;
+    }
+
+    if (job->count < 2) {
+        ok = 0;
+    }
+    else {
+        job->tasks = job->count < STBI__JPEG_MAX_TASKS ? job->count : STBI__JPEG_MAX_TASKS;
+        stbi__parallel_run(stbi__jpeg_intervals_task, job, job->tasks);
+        for (i = 0; i < job->tasks; ++i)
+            ok &= job->ok[i];
+    }
+    if (ok) {
+        // carry on from where the last interval left off, like after decoding all of them here
+        s->img_buffer = job->end_buffer;
+        z->code_buffer = job->end.code_buffer;
+        z->code_bits = job->end.code_bits;
+        z->marker = job->end.marker;
+        z->nomore = job->end.nomore;
+        z->todo = job->end.todo;
+        z->eob_run = job->end.eob_run;
+        for (k = 0; k < 4; ++k)
+            z->img_comp[k].dc_pred = job->end.img_comp[k].dc_pred;
+    }
+    STBI_FREE(job->intervals);
+    STBI_FREE(job);
+    return ok;
+}
+static int stbi__parse_entropy_coded_data(stbi__jpeg* z)
+{
+    stbi__jpeg_reset(z);
+    if (!z->progressive) {
+        if (stbi__jpeg_decode_intervals_parallel(z)) return 1;
+        return stbi__jpeg_decode_mcus(z, 0, stbi__jpeg_scan_mcus(z));
+    }
     else {
         if (z->scan_n == 1) {
             int i, j;
@@ -3094,25 +4053,46 @@ static void stbi__jpeg_dequantize(short* data, stbi__uint16* dequant)
         data[i] *= dequant[i];
 }
 
-static void stbi__jpeg_finish(stbi__jpeg* z)
-{
-    if (z->progressive) {
-        // dequantize and idct the data
-        int i, j, n;
-        for (n = 0; n < z->s->img_n; ++n) {
-            int w = (z->img_comp[n].x + 7) >> 3;
-            int h = (z->img_comp[n].y + 7) >> 3;
-            for (j = 0; j < h; ++j) {
-                for (i = 0; i < w; ++i) {
-                    short* data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
-                    stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
-                    z->idct_block_kernel(z->img_comp[n].data + z->img_comp[n].w2 * j * 8 + i * 8, z->img_comp[n].w2, data);
+// dequantize and idct band 'band' of 'bands' of the block rows of every component
+static void stbi__jpeg_finish_rows(stbi__jpeg* z, int band, int bands)
+{
+    int i, j, n;
+    for (n = 0; n < z->s->img_n; ++n) {
+        int w = (z->img_comp[n].x + 7) >> 3;
+        int h = (z->img_comp[n].y + 7) >> 3;
+        for (j = h * band / bands; j < h * (band + 1) / bands; ++j) {
+            for (i = 0; i < w; i += 2) {
+                short* data = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+                stbi_uc* out = stbi__jpeg_block_out(z, n, i * 8, j * 8);
+                stbi__jpeg_dequantize(data, z->dequant[z->img_comp[n].tq]);
+                if (i + 1 < w) {
+                    // the next block of the row directly follows this one
+                    stbi__jpeg_dequantize(data + 64, z->dequant[z->img_comp[n].tq]);
+                    stbi__jpeg_idct_pair(z, out, z->img_comp[n].w2 >> z->scale, data, data + 64);
+                } else {
+                    z->idct_block_kernel(out, z->img_comp[n].w2 >> z->scale, data);
                 }
             }
         }
     }
 }
 
+static void stbi__jpeg_finish_task(void* data, int index)
+{
+    stbi__jpeg_finish_rows((stbi__jpeg*)data, index, STBI__JPEG_STRIPS);
+}
+
+static void stbi__jpeg_finish(stbi__jpeg* z)
+{
+    if (z->progressive) {
+        // dequantize and idct the data, large images in strips on several threads
+        if (stbi__parallel_run && (double)z->s->img_x * z->s->img_y * z->s->img_n >= STBI__JPEG_PARALLEL_MIN)
+            stbi__parallel_run(stbi__jpeg_finish_task, z, STBI__JPEG_STRIPS);
+        else
+            stbi__jpeg_finish_rows(z, 0, 1);
+    }
+}
+
 static int stbi__process_marker(stbi__jpeg* z, int m)
 {
     int L;
@@ -3281,6 +4261,42 @@ static int stbi__free_jpeg_components(stbi__jpeg* z, int ncomp, int why)
     return why;
 }
 
+// allocate the planes the blocks are transformed into: the whole image, or for band output two MCU rows (of blocks for
+// a single component) and the row above them
+static int stbi__jpeg_alloc_planes(stbi__jpeg* z)
+{
+    int i;
+    for (i = 0; i < z->s->img_n; ++i) {
+        int stride = z->img_comp[i].w2 >> z->scale;
+        STBI_FREE(z->img_comp[i].raw_data);
+        z->img_comp[i].y0 = 0;
+        // a reduced decode only needs the reduced pixels, see stbi__jpeg_block_out
+        if (z->bands)
+            z->img_comp[i].raw_data = stbi__malloc_mad2(stride, 2 * ((z->img_comp[i].v * 8) >> z->scale) + 1, 15);
+        else
+            z->img_comp[i].raw_data = stbi__malloc_mad2(stride, z->img_comp[i].h2 >> z->scale, 15);
+        if (z->img_comp[i].raw_data == NULL)
+            return stbi__free_jpeg_components(z, z->s->img_n, stbi__err("outofmem", "Out of memory"));
+        // align blocks for idct using mmx/sse
+        z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
+        if (z->bands) z->img_comp[i].data += stride;
+    }
+    return 1;
+}
+
+// size of an image dimension decoded at 1 / (1 << scale)
+#define stbi__jpeg_scaled(v, scale)  (((v) + (1u << (scale)) - 1) >> (scale))
+
+// the scale for stbi_set_jpeg_target_size: reduce while the larger side stays at least the target size, at most 1/8
+static int stbi__jpeg_scale(stbi__uint32 x, stbi__uint32 y)
+{
+    int target = stbi__jpeg_target_size, scale = 0;
+    stbi__uint32 size = x > y ? x : y;
+    while (target > 0 && scale < 3 && stbi__jpeg_scaled(size, scale + 1) >= (stbi__uint32)target)
+        ++scale;
+    return scale;
+}
+
 static int stbi__process_frame_header(stbi__jpeg* z, int scan)
 {
     stbi__context* s = z->s;
@@ -3291,6 +4307,7 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
     s->img_x = stbi__get16be(s);   if (s->img_x == 0) return stbi__err("0 width", "Corrupt JPEG"); // JPEG requires
     if (s->img_y > STBI_MAX_DIMENSIONS) return stbi__err("too large", "Very large image (corrupt?)");
     if (s->img_x > STBI_MAX_DIMENSIONS) return stbi__err("too large", "Very large image (corrupt?)");
+    z->scale = stbi__jpeg_scale(s->img_x, s->img_y);
     c = stbi__get8(s);
     if (c != 3 && c != 1 && c != 4) return stbi__err("bad component count", "Corrupt JPEG");
     s->img_n = c;
@@ -3317,6 +4334,11 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
 
     if (!stbi__mad3sizes_valid(s->img_x, s->img_y, s->img_n, 0)) return stbi__err("too large", "Image too large to decode");
 
+    if (z->scale) {
+        z->idct_block_kernel = z->scale == 1 ? stbi__idct_block_4x4 : z->scale == 2 ? stbi__idct_block_2x2 : stbi__idct_block_1x1;
+        z->idct_pair_kernel = NULL;
+    }
+
     for (i = 0; i < s->img_n; ++i) {
         if (z->img_comp[i].h > h_max) h_max = z->img_comp[i].h;
         if (z->img_comp[i].v > v_max) v_max = z->img_comp[i].v;
@@ -3354,11 +4376,6 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         z->img_comp[i].coeff = 0;
         z->img_comp[i].raw_coeff = 0;
         z->img_comp[i].linebuf = NULL;
-        z->img_comp[i].raw_data = stbi__malloc_mad2(z->img_comp[i].w2, z->img_comp[i].h2, 15);
-        if (z->img_comp[i].raw_data == NULL)
-            return stbi__free_jpeg_components(z, i + 1, stbi__err("outofmem", "Out of memory"));
-        // align blocks for idct using mmx/sse
-        z->img_comp[i].data = (stbi_uc*)(((size_t)z->img_comp[i].raw_data + 15) & ~15);
         if (z->progressive) {
             // w2, h2 are multiples of 8 (see above)
             z->img_comp[i].coeff_w = z->img_comp[i].w2 / 8;
@@ -3370,7 +4387,8 @@ static int stbi__process_frame_header(stbi__jpeg* z, int scan)
         }
     }
 
-    return 1;
+    z->bands = s->band && !z->progressive;
+    return stbi__jpeg_alloc_planes(z);
 }
 
 // use comparisons since in some cases we handle more than one case (e.g. SOF)
@@ -3428,6 +4446,8 @@ static stbi_uc stbi__skip_jpeg_junk_at_end(stbi__jpeg* j)
     return STBI__MARKER_none;
 }
 
+static int stbi__jpeg_decode_bands(stbi__jpeg* z);
+
 // decode image to YCbCr format
 static int stbi__decode_jpeg_image(stbi__jpeg* j)
 {
@@ -3442,6 +4462,12 @@ static int stbi__decode_jpeg_image(stbi__jpeg* j)
     while (!stbi__EOI(m)) {
         if (stbi__SOS(m)) {
             if (!stbi__process_scan_header(j)) return 0;
+            if (j->bands) {
+                // a single scan with every component streams, an image in several scans is decoded whole
+                if (j->scan_n == j->s->img_n) return stbi__jpeg_decode_bands(j);
+                j->bands = 0;
+                if (!stbi__jpeg_alloc_planes(j)) return 0;
+            }
             if (!stbi__parse_entropy_coded_data(j)) return 0;
             if (j->marker == STBI__MARKER_none) {
                 j->marker = stbi__skip_jpeg_junk_at_end(j);
@@ -3665,26 +4691,92 @@ static stbi_uc* stbi__resample_row_hv_2_simd(stbi_uc* out, stbi_uc* in_near, stb
 }
 #endif
 
-static stbi_uc* stbi__resample_row_generic(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs)
+#ifdef STBI_SSE2
+// stbi__resample_row_hv_2_simd on 16 pixels at a time
+static STBI__AVX2_TARGET stbi_uc* stbi__resample_row_hv_2_avx2(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs)
 {
-    // resample with nearest-neighbor
-    int i, j;
-    STBI_NOTUSED(in_far);
-    for (i = 0; i < w; ++i)
-        for (j = 0; j < hs; ++j)
-            out[i * hs + j] = in_near[i];
-    return out;
-}
+    int i = 0, t0, t1;
 
-// this is a reduced-precision calculation of YCbCr-to-RGB introduced
-// to make sure the code produces the same results in both SIMD and scalar
-#define stbi__float2fixed(x)  (((int) ((x) * 4096.0f + 0.5f)) << 8)
-static void stbi__YCbCr_to_RGB_row(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step)
-{
-    int i;
-    for (i = 0; i < count; ++i) {
-        int y_fixed = (y[i] << 20) + (1 << 19); // rounding
-        int r, g, b;
+    if (w == 1) {
+        out[0] = out[1] = stbi__div4(3 * in_near[0] + in_far[0] + 2);
+        return out;
+    }
+
+    t1 = 3 * in_near[0] + in_far[0];
+    for (; i < ((w - 1) & ~15); i += 16) {
+        // vertical pass, 3*x + y = 4*x + (y - x)
+        __m256i farw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (in_far + i)));
+        __m256i nearw = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (in_near + i)));
+        __m256i diff = _mm256_sub_epi16(farw, nearw);
+        __m256i nears = _mm256_slli_epi16(nearw, 2);
+        __m256i curr = _mm256_add_epi16(nears, diff); // current row
+
+        // shift the current row by one pixel across the two lanes: alignr shifts within each lane, so it gets the
+        // pixel crossing over from the other lane (or zero) next to it
+        __m256i prv0 = _mm256_alignr_epi8(curr, _mm256_permute2x128_si256(curr, curr, 0x08), 14);
+        __m256i nxt0 = _mm256_alignr_epi8(_mm256_permute2x128_si256(curr, curr, 0x81), curr, 2);
+        __m256i prev = _mm256_insert_epi16(prv0, t1, 0);
+        __m256i next = _mm256_insert_epi16(nxt0, 3 * in_near[i + 16] + in_far[i + 16], 15);
+
+        // horizontal pass, same polyphase filter as the SSE2 version
+        __m256i bias = _mm256_set1_epi16(8);
+        __m256i curs = _mm256_slli_epi16(curr, 2);
+        __m256i prvd = _mm256_sub_epi16(prev, curr);
+        __m256i nxtd = _mm256_sub_epi16(next, curr);
+        __m256i curb = _mm256_add_epi16(curs, bias);
+        __m256i even = _mm256_add_epi16(prvd, curb);
+        __m256i odd = _mm256_add_epi16(nxtd, curb);
+
+        // interleave even and odd pixels, then undo scaling. the low lane holds the output for pixels 0-7, the high
+        // lane for 8-15, so the pack comes out in order
+        __m256i int0 = _mm256_unpacklo_epi16(even, odd);
+        __m256i int1 = _mm256_unpackhi_epi16(even, odd);
+        __m256i de0 = _mm256_srli_epi16(int0, 4);
+        __m256i de1 = _mm256_srli_epi16(int1, 4);
+        _mm256_storeu_si256((__m256i*) (out + i * 2), _mm256_packus_epi16(de0, de1));
+
+        // "previous" value for next iter
+        t1 = 3 * in_near[i + 15] + in_far[i + 15];
+    }
+
+    t0 = t1;
+    t1 = 3 * in_near[i] + in_far[i];
+    out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+
+    for (++i; i < w; ++i) {
+        t0 = t1;
+        t1 = 3 * in_near[i] + in_far[i];
+        out[i * 2 - 1] = stbi__div16(3 * t0 + t1 + 8);
+        out[i * 2] = stbi__div16(3 * t1 + t0 + 8);
+    }
+    out[w * 2 - 1] = stbi__div4(t1 + 2);
+
+    STBI_NOTUSED(hs);
+
+    return out;
+}
+#endif
+
+static stbi_uc* stbi__resample_row_generic(stbi_uc* out, stbi_uc* in_near, stbi_uc* in_far, int w, int hs)
+{
+    // resample with nearest-neighbor
+    int i, j;
+    STBI_NOTUSED(in_far);
+    for (i = 0; i < w; ++i)
+        for (j = 0; j < hs; ++j)
+            out[i * hs + j] = in_near[i];
+    return out;
+}
+
+// this is a reduced-precision calculation of YCbCr-to-RGB introduced
+// to make sure the code produces the same results in both SIMD and scalar
+#define stbi__float2fixed(x)  (((int) ((x) * 4096.0f + 0.5f)) << 8)
+static void stbi__YCbCr_to_RGB_row(stbi_uc* out, const stbi_uc* y, const stbi_uc* pcb, const stbi_uc* pcr, int count, int step)
+{
+    int i;
+    for (i = 0; i < count; ++i) {
+        int y_fixed = (y[i] << 20) + (1 << 19); // rounding
+        int r, g, b;
         int cr = pcr[i] - 128;
         int cb = pcb[i] - 128;
         r = y_fixed + cr * stbi__float2fixed(1.40200f);
@@ -3699,7 +4791,7 @@ static void stbi__YCbCr_to_RGB_row(stbi_uc* out, const stbi_uc* y, const stbi_uc
         out[0] = (stbi_uc)r;
         out[1] = (stbi_uc)g;
         out[2] = (stbi_uc)b;
-        out[3] = 255;
+        if (step == 4) out[3] = 255;
         out += step;
     }
 }
@@ -3833,16 +4925,94 @@ static void stbi__YCbCr_to_RGB_simd(stbi_uc* out, stbi_uc const* y, stbi_uc cons
         out[0] = (stbi_uc)r;
         out[1] = (stbi_uc)g;
         out[2] = (stbi_uc)b;
-        out[3] = 255;
+        if (step == 4) out[3] = 255;
         out += step;
     }
 }
 #endif
 
+#ifdef STBI_SSE2
+// stbi__YCbCr_to_RGB_simd on 16 pixels at a time, for RGB as well as RGBA output. The rest of the row goes to
+// stbi__YCbCr_to_RGB_simd, the arithmetic is the same
+static STBI__AVX2_TARGET void stbi__YCbCr_to_RGB_avx2(stbi_uc* out, stbi_uc const* y, stbi_uc const* pcb, stbi_uc const* pcr, int count, int step)
+{
+    int i = 0;
+
+    if (step == 4 || step == 3) {
+        __m256i signflip = _mm256_set1_epi8(-0x80);
+        __m256i cr_const0 = _mm256_set1_epi16((short)(1.40200f * 4096.0f + 0.5f));
+        __m256i cr_const1 = _mm256_set1_epi16(-(short)(0.71414f * 4096.0f + 0.5f));
+        __m256i cb_const0 = _mm256_set1_epi16(-(short)(0.34414f * 4096.0f + 0.5f));
+        __m256i cb_const1 = _mm256_set1_epi16((short)(1.77200f * 4096.0f + 0.5f));
+        __m256i y_bias = _mm256_set1_epi16(128);
+        __m256i xw = _mm256_set1_epi16(255); // alpha channel
+        // drops the alpha byte of the 4 pixels in each lane, and moves the 12 bytes left of each lane together
+        __m256i rgb_bytes = _mm256_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+                                             0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+        __m256i rgb_dwords = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7);
+
+        for (; i + 15 < count; i += 16) {
+            // load, and unpack to short (y as y << 8 | 128, cr and cb left-shifted by 8 after -128)
+            __m256i yb = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (y + i)));
+            __m256i crb = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (pcr + i)));
+            __m256i cbb = _mm256_cvtepu8_epi16(_mm_loadu_si128((__m128i*) (pcb + i)));
+            __m256i yw = _mm256_or_si256(_mm256_slli_epi16(yb, 8), y_bias);
+            __m256i crw = _mm256_slli_epi16(_mm256_xor_si256(crb, signflip), 8);
+            __m256i cbw = _mm256_slli_epi16(_mm256_xor_si256(cbb, signflip), 8);
+
+            // color transform
+            __m256i yws = _mm256_srli_epi16(yw, 4);
+            __m256i cr0 = _mm256_mulhi_epi16(cr_const0, crw);
+            __m256i cb0 = _mm256_mulhi_epi16(cb_const0, cbw);
+            __m256i cb1 = _mm256_mulhi_epi16(cbw, cb_const1);
+            __m256i cr1 = _mm256_mulhi_epi16(crw, cr_const1);
+            __m256i rws = _mm256_add_epi16(cr0, yws);
+            __m256i gwt = _mm256_add_epi16(cb0, yws);
+            __m256i bws = _mm256_add_epi16(yws, cb1);
+            __m256i gws = _mm256_add_epi16(gwt, cr1);
+
+            // descale
+            __m256i rw = _mm256_srai_epi16(rws, 4);
+            __m256i bw = _mm256_srai_epi16(bws, 4);
+            __m256i gw = _mm256_srai_epi16(gws, 4);
+
+            // back to byte and interleave channels, which works per lane: pixels 0-3 and 8-11 end up in o0, 4-7 and
+            // 12-15 in o1
+            __m256i brb = _mm256_packus_epi16(rw, bw);
+            __m256i gxb = _mm256_packus_epi16(gw, xw);
+            __m256i t0 = _mm256_unpacklo_epi8(brb, gxb);
+            __m256i t1 = _mm256_unpackhi_epi8(brb, gxb);
+            __m256i o0 = _mm256_unpacklo_epi16(t0, t1);
+            __m256i o1 = _mm256_unpackhi_epi16(t0, t1);
+            __m256i lo = _mm256_permute2x128_si256(o0, o1, 0x20); // pixels 0-7
+            __m256i hi = _mm256_permute2x128_si256(o0, o1, 0x31); // pixels 8-15
+
+            if (step == 4) {
+                _mm256_storeu_si256((__m256i*) (out + 0), lo);
+                _mm256_storeu_si256((__m256i*) (out + 32), hi);
+                out += 64;
+            } else {
+                // 24 bytes for 8 pixels at the bottom of each register
+                lo = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(lo, rgb_bytes), rgb_dwords);
+                hi = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(hi, rgb_bytes), rgb_dwords);
+                _mm_storeu_si128((__m128i*) (out + 0), _mm256_castsi256_si128(lo));
+                _mm_storel_epi64((__m128i*) (out + 16), _mm256_extracti128_si256(lo, 1));
+                _mm_storeu_si128((__m128i*) (out + 24), _mm256_castsi256_si128(hi));
+                _mm_storel_epi64((__m128i*) (out + 40), _mm256_extracti128_si256(hi, 1));
+                out += 48;
+            }
+        }
+    }
+
+    stbi__YCbCr_to_RGB_simd(out, y + i, pcb + i, pcr + i, count - i, step);
+}
+#endif
+
 // set up the kernels
 static void stbi__setup_jpeg(stbi__jpeg* j)
 {
     j->idct_block_kernel = stbi__idct_block;
+    j->idct_pair_kernel = NULL;
     j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_row;
     j->resample_row_hv_2_kernel = stbi__resample_row_hv_2;
 
@@ -3851,6 +5021,11 @@ static void stbi__setup_jpeg(stbi__jpeg* j)
         j->idct_block_kernel = stbi__idct_simd;
         j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_simd;
         j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_simd;
+        if (stbi__avx2_available()) {
+            j->idct_pair_kernel = stbi__idct_pair_avx2;
+            j->YCbCr_to_RGB_kernel = stbi__YCbCr_to_RGB_avx2;
+            j->resample_row_hv_2_kernel = stbi__resample_row_hv_2_avx2;
+        }
     }
 #endif
 
@@ -3873,6 +5048,8 @@ typedef struct
     stbi_uc* line0, * line1;
     int hs, vs;   // expansion factor in each axis
     int w_lores; // horizontal pixels pre-expansion
+    int h_lores; // rows pre-expansion
+    int stride;  // bytes from one pre-expansion row to the next
     int ystep;   // how far through vertical expansion we are
     int ypos;    // which pre-expansion row we're on
 } stbi__resample;
@@ -3884,169 +5061,346 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
     return (stbi_uc)((t + (t >> 8)) >> 8);
 }
 
-static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp, int req_comp)
+// move a resampler on to the next output row
+static void stbi__resample_next_row(stbi__resample* r)
 {
-    int n, decode_n, is_rgb;
-    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+    if (++r->ystep >= r->vs) {
+        r->ystep = 0;
+        r->line0 = r->line1;
+        if (++r->ypos < r->h_lores)
+            r->line1 += r->stride;
+    }
+}
 
-    // validate req_comp
-    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+typedef struct
+{
+    stbi__jpeg* z;
+    stbi__resample res_comp[4]; // at the first row
+    stbi_uc* output;
+    stbi_uc* linebufs;          // for each strip, a line buffer per component
+    int direct, n, decode_n, is_rgb, strips;
+} stbi__jpeg_convert_job;
+
+// resample and color-convert the output row the resamplers 'res_comp' are at into 'out' using the line buffers
+// 'linebuf', and move the resamplers on
+static void stbi__jpeg_convert_row(stbi__jpeg_convert_job* job, stbi__resample* res_comp, stbi_uc** linebuf, stbi_uc* out)
+{
+    stbi__jpeg* z = job->z;
+    stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
+    int k, n = job->n;
+    unsigned int i;
+
+    for (k = 0; k < job->decode_n; ++k) {
+        stbi__resample* r = &res_comp[k];
+        int y_bot = r->ystep >= (r->vs >> 1);
+        coutput[k] = r->resample(linebuf[k],
+            y_bot ? r->line1 : r->line0,
+            y_bot ? r->line0 : r->line1,
+            r->w_lores, r->hs);
+        stbi__resample_next_row(r);
+    }
+    if (n >= 3) {
+        stbi_uc* y = coutput[0];
+        if (z->s->img_n == 3) {
+            if (job->is_rgb) {
+                for (i = 0; i < z->s->img_x; ++i) {
+                    out[0] = y[i];
+                    out[1] = coutput[1][i];
+                    out[2] = coutput[2][i];
+                    if (n == 4) out[3] = 255;
+                    out += n;
+                }
+            }
+            else {
+                z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+        }
+        else if (z->s->img_n == 4) {
+            if (z->app14_color_transform == 0) { // CMYK
+                for (i = 0; i < z->s->img_x; ++i) {
+                    stbi_uc m = coutput[3][i];
+                    out[0] = stbi__blinn_8x8(coutput[0][i], m);
+                    out[1] = stbi__blinn_8x8(coutput[1][i], m);
+                    out[2] = stbi__blinn_8x8(coutput[2][i], m);
+                    if (n == 4) out[3] = 255;
+                    out += n;
+                }
+            }
+            else if (z->app14_color_transform == 2) { // YCCK
+                z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+                for (i = 0; i < z->s->img_x; ++i) {
+                    stbi_uc m = coutput[3][i];
+                    out[0] = stbi__blinn_8x8(255 - out[0], m);
+                    out[1] = stbi__blinn_8x8(255 - out[1], m);
+                    out[2] = stbi__blinn_8x8(255 - out[2], m);
+                    out += n;
+                }
+            }
+            else { // YCbCr + alpha?  Ignore the fourth channel for now
+                z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            }
+        }
+        else
+            for (i = 0; i < z->s->img_x; ++i) {
+                out[0] = out[1] = out[2] = y[i];
+                if (n == 4) out[3] = 255; // rows may be packed back to back in the caller's buffer
+                out += n;
+            }
+    }
+    else {
+        if (job->is_rgb) {
+            if (n == 1)
+                for (i = 0; i < z->s->img_x; ++i)
+                    *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+            else {
+                for (i = 0; i < z->s->img_x; ++i, out += 2) {
+                    out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+                    out[1] = 255;
+                }
+            }
+        }
+        else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+            for (i = 0; i < z->s->img_x; ++i) {
+                stbi_uc m = coutput[3][i];
+                stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+                stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+                stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+                out[0] = stbi__compute_y(r, g, b);
+                if (n == 2) out[1] = 255;
+                out += n;
+            }
+        }
+        else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+            for (i = 0; i < z->s->img_x; ++i) {
+                out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+                if (n == 2) out[1] = 255;
+                out += n;
+            }
+        }
+        else {
+            stbi_uc* y = coutput[0];
+            if (n == 1)
+                for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
+            else
+                for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+        }
+    }
+}
 
-    // load a jpeg image from whichever source, but leave in YCbCr format
-    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
+// resample and color-convert output rows [j0, j1) using the line buffers 'linebuf'
+static void stbi__jpeg_convert_rows(stbi__jpeg_convert_job* job, stbi_uc** linebuf, stbi__uint32 j0, stbi__uint32 j1)
+{
+    stbi__resample res_comp[4];
+    stbi__uint32 j;
+    int k;
+
+    memcpy(res_comp, job->res_comp, sizeof(res_comp));
+    // catching up with row j0 is cheap next to converting rows
+    for (j = 0; j < j0; ++j)
+        for (k = 0; k < job->decode_n; ++k)
+            stbi__resample_next_row(&res_comp[k]);
+
+    for (j = j0; j < j1; ++j)
+        stbi__jpeg_convert_row(job, res_comp, linebuf, job->direct ? stbi__out_row(job->z->s, j) : job->output + job->n * job->z->s->img_x * j);
+}
+
+static void stbi__jpeg_convert_task(void* data, int index)
+{
+    stbi__jpeg_convert_job* job = (stbi__jpeg_convert_job*)data;
+    stbi__uint32 y = job->z->s->img_y;
+    stbi_uc* linebuf[4];
+    int k;
+    for (k = 0; k < job->decode_n; ++k)
+        linebuf[k] = job->linebufs + ((size_t)index * job->decode_n + k) * (job->z->s->img_x + 3);
+    stbi__jpeg_convert_rows(job, linebuf, (stbi__uint32)((stbi__uint64)y * index / job->strips), (stbi__uint32)((stbi__uint64)y * (index + 1) / job->strips));
+}
+
+// determine the output components and set up the resamplers at the first row of the planes, once s->img_x and
+// img_y are the size of the output
+static int stbi__jpeg_setup_convert(stbi__jpeg* z, stbi__jpeg_convert_job* job, int req_comp)
+{
+    int k;
 
     // determine actual number of components to generate
-    n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
+    job->n = req_comp ? req_comp : z->s->img_n >= 3 ? 3 : 1;
 
-    is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+    job->is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
 
-    if (z->s->img_n == 3 && n < 3 && !is_rgb)
-        decode_n = 1;
+    if (z->s->img_n == 3 && job->n < 3 && !job->is_rgb)
+        job->decode_n = 1;
     else
-        decode_n = z->s->img_n;
+        job->decode_n = z->s->img_n;
 
     // nothing to do if no components requested; check this now to avoid
     // accessing uninitialized coutput[0] later
-    if (decode_n <= 0) { stbi__cleanup_jpeg(z); return NULL; }
+    if (job->decode_n <= 0) return 0;
+
+    for (k = 0; k < job->decode_n; ++k) {
+        stbi__resample* r = &job->res_comp[k];
+
+        // allocate line buffer big enough for upsampling off the edges
+        // with upsample factor of 4
+        z->img_comp[k].linebuf = (stbi_uc*)stbi__malloc(z->s->img_x + 3);
+        if (!z->img_comp[k].linebuf) return stbi__err("outofmem", "Out of memory");
+
+        r->hs = z->img_h_max / z->img_comp[k].h;
+        r->vs = z->img_v_max / z->img_comp[k].v;
+        r->ystep = r->vs >> 1;
+        r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
+        // after a reduced decode, the planes only hold the reduced pixels
+        r->h_lores = (int)stbi__jpeg_scaled(z->img_comp[k].y, z->scale);
+        r->stride = z->img_comp[k].w2 >> z->scale;
+        r->ypos = 0;
+        r->line0 = r->line1 = z->img_comp[k].data;
+
+        if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+        else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
+        else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
+        else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
+        else                               r->resample = stbi__resample_row_generic;
+    }
+    job->z = z;
+    return 1;
+}
 
-    // resample and color-convert
-    {
-        int k;
-        unsigned int i, j;
-        stbi_uc* output;
-        stbi_uc* coutput[4] = { NULL, NULL, NULL, NULL };
+// Band output (see stbi_load_bands) of a baseline image in a single scan. MCU rows are decoded one at a time into
+// planes that hold two of them and the row above, see stbi__jpeg_alloc_planes. Upsampling the last rows of an MCU row
+// looks at the first row of the next one, so the output rows of an MCU row are converted once the next one is
+// decoded, and then the planes move up by an MCU row.
+static int stbi__jpeg_decode_bands(stbi__jpeg* z)
+{
+    stbi__context* s = z->s;
+    stbi__jpeg_convert_job job;
+    stbi_uc* linebuf[4];
+    stbi_uc* band;
+    int k, m, mcus, mcu_rows, out_rows, filled = 0, band_rows, rows[4];
+    stbi__uint32 j = 0, j_end;
+
+    s->img_x = stbi__jpeg_scaled(s->img_x, z->scale);
+    s->img_y = stbi__jpeg_scaled(s->img_y, z->scale);
+    if (!stbi__jpeg_setup_convert(z, &job, z->req_comp)) return 0;
+    for (k = 0; k < job.decode_n; ++k)
+        linebuf[k] = z->img_comp[k].linebuf;
+    band_rows = (stbi__uint32)s->band_rows < s->img_y ? s->band_rows : (int)s->img_y;
+    band = (stbi_uc*)stbi__malloc_mad3(job.n, s->img_x, band_rows, 0);
+    if (!band) return stbi__err("outofmem", "Out of memory");
+
+    // MCU rows, the MCUs in each and the plane rows each takes up
+    if (z->scan_n == 1) {
+        mcus = (z->img_comp[0].x + 7) >> 3;
+        mcu_rows = (z->img_comp[0].y + 7) >> 3;
+        out_rows = 8 >> z->scale;
+        rows[0] = out_rows;
+    }
+    else {
+        mcus = z->img_mcu_x;
+        mcu_rows = z->img_mcu_y;
+        out_rows = z->img_mcu_h >> z->scale;
+        for (k = 0; k < s->img_n; ++k)
+            rows[k] = (z->img_comp[k].v * 8) >> z->scale;
+    }
+
+    stbi__jpeg_reset(z);
+    for (m = 0; m < mcu_rows; ++m) {
+        // like the whole scan, stop decoding where a restart marker is missing. The MCUs left out are blank then, not
+        // the previous MCU row's still in the planes
+        if (z->restart_interval) {
+            for (k = 0; k < s->img_n; ++k) {
+                int stride = z->img_comp[k].w2 >> z->scale;
+                memset(z->img_comp[k].data + (size_t)(m * rows[k] - z->img_comp[k].y0) * stride, 0, (size_t)rows[k] * stride);
+            }
+        }
+        if (z->todo > 0 && !stbi__jpeg_decode_mcus(z, m * mcus, (m + 1) * mcus)) {
+            STBI_FREE(band);
+            return 0;
+        }
+        if (m == 0) continue;
+
+        // the output rows of the previous MCU row, then move the planes up by an MCU row
+        for (j_end = (stbi__uint32)m * out_rows; j < j_end; ++j) {
+            stbi__jpeg_convert_row(&job, job.res_comp, linebuf, band + (size_t)filled * job.n * s->img_x);
+            if (++filled == band_rows || j + 1 == s->img_y) {
+                if (!stbi__band_out(s, band, filled, job.n)) goto stopped;
+                filled = 0;
+            }
+        }
+        for (k = 0; k < s->img_n; ++k) {
+            int stride = z->img_comp[k].w2 >> z->scale;
+            stbi_uc* data = z->img_comp[k].data;
+            memmove(data - stride, data + (size_t)(rows[k] - 1) * stride, (size_t)(rows[k] + 1) * stride);
+            z->img_comp[k].y0 += rows[k];
+            if (k < job.decode_n) {
+                job.res_comp[k].line0 -= (size_t)rows[k] * stride;
+                job.res_comp[k].line1 -= (size_t)rows[k] * stride;
+            }
+        }
+    }
+    for (; j < s->img_y; ++j) {
+        stbi__jpeg_convert_row(&job, job.res_comp, linebuf, band + (size_t)filled * job.n * s->img_x);
+        if (++filled == band_rows || j + 1 == s->img_y) {
+            if (!stbi__band_out(s, band, filled, job.n)) break;
+            filled = 0;
+        }
+    }
 
-        stbi__resample res_comp[4];
+stopped:
+    STBI_FREE(band);
+    z->bands = 2;
+    return 1;
+}
 
-        for (k = 0; k < decode_n; ++k) {
-            stbi__resample* r = &res_comp[k];
+static stbi_uc* load_jpeg_image(stbi__jpeg* z, int* out_x, int* out_y, int* comp, int req_comp)
+{
+    z->s->img_n = 0; // make stbi__cleanup_jpeg safe
 
-            // allocate line buffer big enough for upsampling off the edges
-            // with upsample factor of 4
-            z->img_comp[k].linebuf = (stbi_uc*)stbi__malloc(z->s->img_x + 3);
-            if (!z->img_comp[k].linebuf) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
+    // validate req_comp
+    if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
+    z->req_comp = req_comp; // band output converts while decoding
 
-            r->hs = z->img_h_max / z->img_comp[k].h;
-            r->vs = z->img_v_max / z->img_comp[k].v;
-            r->ystep = r->vs >> 1;
-            r->w_lores = (z->s->img_x + r->hs - 1) / r->hs;
-            r->ypos = 0;
-            r->line0 = r->line1 = z->img_comp[k].data;
+    // load a jpeg image from whichever source, but leave in YCbCr format
+    if (!stbi__decode_jpeg_image(z)) { stbi__cleanup_jpeg(z); return NULL; }
 
-            if (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-            else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-            else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-            else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-            else                               r->resample = stbi__resample_row_generic;
-        }
+    if (z->bands) {
+        // every row went to the band callback already, unless there was no scan at all
+        stbi__cleanup_jpeg(z);
+        if (z->bands != 2) return stbi__errpuc("no SOS", "Corrupt JPEG");
+        *out_x = z->s->img_x;
+        *out_y = z->s->img_y;
+        if (comp) *comp = z->s->img_n >= 3 ? 3 : 1;
+        return (stbi_uc*)stbi__bands_done(z->s);
+    }
+
+    // after a reduced decode, the rest only deals with the reduced image
+    z->s->img_x = stbi__jpeg_scaled(z->s->img_x, z->scale);
+    z->s->img_y = stbi__jpeg_scaled(z->s->img_y, z->scale);
+
+    // resample and color-convert
+    {
+        int direct, k;
+        stbi_uc* output;
+        stbi__jpeg_convert_job job;
+
+        if (!stbi__jpeg_setup_convert(z, &job, req_comp)) { stbi__cleanup_jpeg(z); return NULL; }
 
         // can't error after this so, this is safe
-        output = (stbi_uc*)stbi__malloc_mad3(n, z->s->img_x, z->s->img_y, 1);
+        direct = stbi__out_direct(z->s, z->s->img_x, z->s->img_y, job.n);
+        output = direct ? z->s->out_buffer : (stbi_uc*)stbi__malloc_mad3(job.n, z->s->img_x, z->s->img_y, 1);
         if (!output) { stbi__cleanup_jpeg(z); return stbi__errpuc("outofmem", "Out of memory"); }
 
-        // now go ahead and resample
-        for (j = 0; j < z->s->img_y; ++j) {
-            stbi_uc* out = output + n * z->s->img_x * j;
-            for (k = 0; k < decode_n; ++k) {
-                stbi__resample* r = &res_comp[k];
-                int y_bot = r->ystep >= (r->vs >> 1);
-                coutput[k] = r->resample(z->img_comp[k].linebuf,
-                    y_bot ? r->line1 : r->line0,
-                    y_bot ? r->line0 : r->line1,
-                    r->w_lores, r->hs);
-                if (++r->ystep >= r->vs) {
-                    r->ystep = 0;
-                    r->line0 = r->line1;
-                    if (++r->ypos < z->img_comp[k].y)
-                        r->line1 += z->img_comp[k].w2;
-                }
-            }
-            if (n >= 3) {
-                stbi_uc* y = coutput[0];
-                if (z->s->img_n == 3) {
-                    if (is_rgb) {
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            out[0] = y[i];
-                            out[1] = coutput[1][i];
-                            out[2] = coutput[2][i];
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else {
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                }
-                else if (z->s->img_n == 4) {
-                    if (z->app14_color_transform == 0) { // CMYK
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                            out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                            out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                            out[3] = 255;
-                            out += n;
-                        }
-                    }
-                    else if (z->app14_color_transform == 2) { // YCCK
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                        for (i = 0; i < z->s->img_x; ++i) {
-                            stbi_uc m = coutput[3][i];
-                            out[0] = stbi__blinn_8x8(255 - out[0], m);
-                            out[1] = stbi__blinn_8x8(255 - out[1], m);
-                            out[2] = stbi__blinn_8x8(255 - out[2], m);
-                            out += n;
-                        }
-                    }
-                    else { // YCbCr + alpha?  Ignore the fourth channel for now
-                        z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                    }
-                }
-                else
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = out[1] = out[2] = y[i];
-                        out[3] = 255; // not used if n==3
-                        out += n;
-                    }
-            }
-            else {
-                if (is_rgb) {
-                    if (n == 1)
-                        for (i = 0; i < z->s->img_x; ++i)
-                            *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                    else {
-                        for (i = 0; i < z->s->img_x; ++i, out += 2) {
-                            out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                            out[1] = 255;
-                        }
-                    }
-                }
-                else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        stbi_uc m = coutput[3][i];
-                        stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                        stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                        stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                        out[0] = stbi__compute_y(r, g, b);
-                        out[1] = 255;
-                        out += n;
-                    }
-                }
-                else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-                    for (i = 0; i < z->s->img_x; ++i) {
-                        out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                        out[1] = 255;
-                        out += n;
-                    }
-                }
-                else {
-                    stbi_uc* y = coutput[0];
-                    if (n == 1)
-                        for (i = 0; i < z->s->img_x; ++i) out[i] = y[i];
-                    else
-                        for (i = 0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-                }
-            }
+        // now go ahead and resample, large images in strips on several threads
+        job.output = output;
+        job.direct = direct;
+        job.strips = stbi__parallel_run && (double)z->s->img_x * z->s->img_y * job.n >= STBI__JPEG_PARALLEL_MIN ? STBI__JPEG_STRIPS : 1;
+        job.linebufs = job.strips > 1 ? (stbi_uc*)stbi__malloc_mad2(job.strips * job.decode_n, z->s->img_x + 3, 0) : NULL;
+        if (job.linebufs) {
+            stbi__parallel_run(stbi__jpeg_convert_task, &job, job.strips);
+            STBI_FREE(job.linebufs);
+        }
+        else {
+            stbi_uc* linebuf[4];
+            for (k = 0; k < job.decode_n; ++k)
+                linebuf[k] = z->img_comp[k].linebuf;
+            stbi__jpeg_convert_rows(&job, linebuf, 0, z->s->img_y);
         }
         stbi__cleanup_jpeg(z);
         *out_x = z->s->img_x;
@@ -4090,8 +5444,8 @@ static int stbi__jpeg_info_raw(stbi__jpeg* j, int* x, int* y, int* comp)
         stbi__rewind(j->s);
         return 0;
     }
-    if (x) *x = j->s->img_x;
-    if (y) *y = j->s->img_y;
+    if (x) *x = (int)stbi__jpeg_scaled(j->s->img_x, j->scale);
+    if (y) *y = (int)stbi__jpeg_scaled(j->s->img_y, j->scale);
     if (comp) *comp = j->s->img_n >= 3 ? 3 : 1;
     return 1;
 }
@@ -4115,6 +5469,7 @@ static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
 //      - all output is written to a single output buffer (can malloc/realloc)
 //    performance
 //      - fast huffman
+//      - 64-bit refills, two literals per table lookup and 8 byte match copies away from the buffer ends
 
 #ifndef STBI_NO_ZLIB
 
@@ -4123,6 +5478,19 @@ static int stbi__jpeg_info(stbi__context* s, int* x, int* y, int* comp)
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
+// literal/length table of stbi__parse_huffman_fast, entries are
+//    bits 0-7   code bits to consume
+//    bits 8-9   kind: one literal, two literals or a length
+//    bits 10-13 extra bits of a length, consumed after the code bits
+//    bits 16-31 the literal(s), first one in the low byte, or the base length
+// 0 means the code is not in the table (longer codes, end of block, invalid codes)
+#define STBI__ZFAST_LITLEN_BITS  11
+#define STBI__ZFAST_LITLEN_MASK  ((1 << STBI__ZFAST_LITLEN_BITS) - 1)
+#define STBI__ZFAST_LITERAL      (1 << 8)
+#define STBI__ZFAST_LITERALS     (2 << 8)
+#define STBI__ZFAST_LENGTH       (3 << 8)
+#define STBI__ZFAST_OUT_MARGIN   (258 + 16) // longest match plus what the 8 byte copies write past its end
+
 // zlib-style huffman encoding
 // (jpegs packs from left, zlib from right, so can't share code)
 typedef struct
@@ -4218,8 +5586,18 @@ typedef struct
     int   z_expandable;
 
     stbi__zhuffman z_length, z_distance;
+    stbi__uint32 fast_litlen[1 << STBI__ZFAST_LITLEN_BITS];
+
+    // incremental decoding, see stbi__zlib_run
+    char* zout_pause;
+    int stop_at_flush;
+    int final_block, in_block;
 } stbi__zbuf;
 
+// results of stbi__zlib_run besides 0 (error) and 1 (end of the stream)
+#define STBI__ZPAUSED   2
+#define STBI__ZFLUSHED  3
+
 stbi_inline static int stbi__zeof(stbi__zbuf* z)
 {
     return (z->zbuffer >= z->zbuffer_end);
@@ -4252,12 +5630,13 @@ stbi_inline static unsigned int stbi__zreceive(stbi__zbuf* z, int n)
     return k;
 }
 
-static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
+// decode a code that is not in the fast table from the low 16 bits of 'bits', returns the symbol or -1
+static int stbi__zhuffman_lookup_slow(stbi__zhuffman* z, unsigned int bits, int* size)
 {
     int b, s, k;
     // not resolved by fast table, so compute it the slow way
     // use jpeg approach, which requires MSbits at top
-    k = stbi__bit_reverse(a->code_buffer, 16);
+    k = stbi__bit_reverse(bits & 0xffff, 16);
     for (s = STBI__ZFAST_BITS + 1; ; ++s)
         if (k < z->maxcode[s])
             break;
@@ -4266,9 +5645,17 @@ static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
     b = (k >> (16 - s)) - z->firstcode[s] + z->firstsymbol[s];
     if (b >= STBI__ZNSYMS) return -1; // some data was corrupt somewhere!
     if (z->size[b] != s) return -1;  // was originally an assert, but report failure instead.
+    *size = s;
+    return z->value[b];
+}
+
+static int stbi__zhuffman_decode_slowpath(stbi__zbuf* a, stbi__zhuffman* z)
+{
+    int s, v = stbi__zhuffman_lookup_slow(z, a->code_buffer, &s);
+    if (v < 0) return -1;
     a->code_buffer >>= s;
     a->num_bits -= s;
-    return z->value[b];
+    return v;
 }
 
 stbi_inline static int stbi__zhuffman_decode(stbi__zbuf* a, stbi__zhuffman* z)
@@ -4339,11 +5726,179 @@ static const int stbi__zdist_base[32] = { 1,2,3,4,5,7,9,13,17,25,33,49,65,97,129
 static const int stbi__zdist_extra[32] =
 { 0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13 };
 
+// Fill fast_litlen from z_length: every code of up to STBI__ZFAST_LITLEN_BITS bits, then, for literals short enough,
+// the literal that follows in the remaining bits of the index.
+static void stbi__zbuild_fast_litlen(stbi__zbuf* a)
+{
+    stbi__zhuffman* z = &a->z_length;
+    stbi__uint32* table = a->fast_litlen;
+    int s, i;
+    memset(a->fast_litlen, 0, sizeof(a->fast_litlen));
+    for (s = 1; s <= STBI__ZFAST_LITLEN_BITS; ++s) {
+        int count = (z->maxcode[s] >> (16 - s)) - z->firstcode[s];
+        for (i = 0; i < count; ++i) {
+            int sym = z->value[z->firstsymbol[s] + i];
+            stbi__uint32 entry;
+            int j;
+            if (sym < 256)
+                entry = ((stbi__uint32)sym << 16) | STBI__ZFAST_LITERAL | s;
+            else if (sym >= 257 && sym < 286)
+                entry = ((stbi__uint32)stbi__zlength_base[sym - 257] << 16) | STBI__ZFAST_LENGTH |
+                        (stbi__zlength_extra[sym - 257] << 10) | s;
+            else
+                continue;
+            for (j = stbi__bit_reverse(z->firstcode[s] + i, s); j < (1 << STBI__ZFAST_LITLEN_BITS); j += 1 << s)
+                table[j] = entry;
+        }
+    }
+    // i >> n < i, so going down the entries read are still single literals
+    for (i = (1 << STBI__ZFAST_LITLEN_BITS) - 1; i >= 0; --i) {
+        stbi__uint32 first = table[i], second;
+        int n = first & 0xff;
+        if ((first & 0x300) != STBI__ZFAST_LITERAL) continue;
+        second = table[i >> n];
+        if ((second & 0x300) == STBI__ZFAST_LITERAL && n + (int)(second & 0xff) <= STBI__ZFAST_LITLEN_BITS)
+            table[i] = (first & 0xff0000) | ((second & 0xff0000) << 8) | STBI__ZFAST_LITERALS | (n + (second & 0xff));
+    }
+}
+
+// compilers turn this into a single load on little-endian targets
+stbi_inline static stbi__uint64 stbi__zload64(stbi_uc const* p)
+{
+    return (stbi__uint64)p[0] | ((stbi__uint64)p[1] << 8) | ((stbi__uint64)p[2] << 16) | ((stbi__uint64)p[3] << 24) |
+           ((stbi__uint64)p[4] << 32) | ((stbi__uint64)p[5] << 40) | ((stbi__uint64)p[6] << 48) | ((stbi__uint64)p[7] << 56);
+}
+
+// Inner loop of stbi__parse_huffman_block for the bulk of a block. While 8 input bytes and STBI__ZFAST_OUT_MARGIN
+// output bytes are left it can skip all bounds checks: one 8 byte load refills the bit buffer to at least 56 bits,
+// enough for a whole length/distance pair or two entries of literals, and matches are copied 8 bytes at a time,
+// overshooting their end.
+// Stops in front of codes fast_litlen does not have (end of block, long codes, invalid codes) and near the end of
+// the buffers, stbi__parse_huffman_block decodes those one at a time.
+static int stbi__parse_huffman_fast(stbi__zbuf* a, char** pzout)
+{
+    stbi_uc* zout = (stbi_uc*)*pzout;
+    stbi_uc* zout_start = (stbi_uc*)a->zout_start;
+    stbi_uc* zout_end = (stbi_uc*)a->zout_end;
+    stbi_uc* in = a->zbuffer;
+    stbi_uc* in_end = a->zbuffer_end;
+    stbi__uint64 bits = a->code_buffer;
+    int num_bits = a->num_bits;
+
+    stbi_uc* zout_last; // the loop runs while zout <= zout_last
+
+    // all bits in code_buffer came from real bytes, not the padding added at the end of the input
+    if (in_end - in < 8 || zout_end - zout < STBI__ZFAST_OUT_MARGIN || a->hit_zeof_once)
+        return 1;
+    zout_last = zout_end - STBI__ZFAST_OUT_MARGIN;
+    if (a->zout_pause) {
+        if (zout >= (stbi_uc*)a->zout_pause) return 1;
+        if ((stbi_uc*)a->zout_pause - 1 < zout_last) zout_last = (stbi_uc*)a->zout_pause - 1;
+    }
+
+    while (in_end - in >= 8 && zout <= zout_last) {
+        stbi__uint32 e;
+        int n, z, len, dist;
+        stbi_uc* p;
+
+        // bits above num_bits are the next input bits already, or zero, so or-ing them in again is harmless
+        bits |= stbi__zload64(in) << num_bits;
+        in += (63 - num_bits) >> 3;
+        num_bits |= 56;
+
+        e = a->fast_litlen[bits & STBI__ZFAST_LITLEN_MASK];
+        n = e & 0xff;
+        if ((e & 0x300) == STBI__ZFAST_LITERAL || (e & 0x300) == STBI__ZFAST_LITERALS) {
+            // the second byte is overwritten later when there is only one literal
+            zout[0] = (stbi_uc)(e >> 16);
+            zout[1] = (stbi_uc)(e >> 24);
+            zout += (e >> 8) & 3;
+            bits >>= n;
+            num_bits -= n;
+            // 56 bits are enough for a second table entry, literals come in long runs
+            e = a->fast_litlen[bits & STBI__ZFAST_LITLEN_MASK];
+            n = e & 0xff;
+            if ((e & 0x300) == STBI__ZFAST_LITERAL || (e & 0x300) == STBI__ZFAST_LITERALS) {
+                zout[0] = (stbi_uc)(e >> 16);
+                zout[1] = (stbi_uc)(e >> 24);
+                zout += (e >> 8) & 3;
+                bits >>= n;
+                num_bits -= n;
+            }
+            continue;
+        }
+        if ((e & 0x300) != STBI__ZFAST_LENGTH)
+            break;
+        bits >>= n;
+        num_bits -= n;
+        n = (e >> 10) & 15;
+        len = (int)(e >> 16) + (int)(bits & ((1u << n) - 1));
+        bits >>= n;
+        num_bits -= n;
+
+        z = a->z_distance.fast[bits & STBI__ZFAST_MASK];
+        if (z) {
+            n = z >> 9;
+            z &= 511;
+        }
+        else {
+            z = stbi__zhuffman_lookup_slow(&a->z_distance, (unsigned int)bits, &n);
+        }
+        if (z < 0 || z >= 30) return stbi__err("bad huffman code", "Corrupt PNG"); // per DEFLATE, distance codes 30 and 31 must not appear in compressed data
+        bits >>= n;
+        num_bits -= n;
+        n = stbi__zdist_extra[z];
+        dist = stbi__zdist_base[z] + (int)(bits & ((1u << n) - 1));
+        bits >>= n;
+        num_bits -= n;
+        if (zout - zout_start < dist) return stbi__err("bad dist", "Corrupt PNG");
+
+        p = zout - dist;
+        if (dist >= 8) {
+            // 8 bytes behind are always written already
+            stbi_uc* end = zout + len;
+            do {
+                memcpy(zout, p, 8);
+                zout += 8;
+                p += 8;
+            } while (zout < end);
+            zout = end;
+        }
+        else if (dist == 1) { // run of one byte; common in images.
+            stbi__uint64 run = p[0] * (stbi__uint64)0x0101010101010101ull;
+            stbi_uc* end = zout + len;
+            do {
+                memcpy(zout, &run, 8);
+                zout += 8;
+            } while (zout < end);
+            zout = end;
+        }
+        else {
+            do *zout++ = *p++; while (--len);
+        }
+    }
+
+    // hand the whole bytes still in the bit buffer back to the input
+    in -= num_bits >> 3;
+    num_bits &= 7;
+    a->zbuffer = in;
+    a->code_buffer = (stbi__uint32)(bits & ((1u << num_bits) - 1));
+    a->num_bits = num_bits;
+    *pzout = (char*)zout;
+    return 1;
+}
+
 static int stbi__parse_huffman_block(stbi__zbuf* a)
 {
     char* zout = a->zout;
     for (;;) {
-        int z = stbi__zhuffman_decode(a, &a->z_length);
+        int z;
+        if (a->zout_pause && zout >= a->zout_pause) {
+            a->zout = zout;
+            return STBI__ZPAUSED;
+        }
+        if (!stbi__parse_huffman_fast(a, &zout)) return 0;
+        z = stbi__zhuffman_decode(a, &a->z_length);
         if (z < 256) {
             if (z < 0) return stbi__err("bad huffman code", "Corrupt PNG"); // error in huffman codes
             if (zout >= a->zout_end) {
@@ -4516,24 +6071,36 @@ Init algorithm:
 }
 */
 
-static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
+static int stbi__zlib_start(stbi__zbuf* a, int parse_header)
 {
-    int final, type;
     if (parse_header)
         if (!stbi__parse_zlib_header(a)) return 0;
     a->num_bits = 0;
     a->code_buffer = 0;
     a->hit_zeof_once = 0;
-    do {
-        final = stbi__zreceive(a, 1);
-        type = stbi__zreceive(a, 2);
-        if (type == 0) {
-            if (!stbi__parse_uncompressed_block(a)) return 0;
-        }
-        else if (type == 3) {
-            return 0;
-        }
-        else {
+    a->final_block = 0;
+    a->in_block = 0;
+    return 1;
+}
+
+// Decode blocks after stbi__zlib_start, and again after it paused. Returns 0 on errors, 1 at the end of the stream,
+// STBI__ZPAUSED once the output reached zout_pause (if set) and, with stop_at_flush, STBI__ZFLUSHED when a stored
+// block ends exactly at zbuffer_end: encoders that flush there let the rest of the stream be decoded on its own.
+static int stbi__zlib_run(stbi__zbuf* a)
+{
+    for (;;) {
+        int type, r;
+        if (!a->in_block) {
+            if (a->final_block) return 1;
+            if (a->zout_pause && a->zout >= a->zout_pause) return STBI__ZPAUSED;
+            a->final_block = stbi__zreceive(a, 1);
+            type = stbi__zreceive(a, 2);
+            if (type == 0) {
+                if (!stbi__parse_uncompressed_block(a)) return 0;
+                if (a->stop_at_flush && a->zbuffer == a->zbuffer_end && !a->final_block) return STBI__ZFLUSHED;
+                continue;
+            }
+            if (type == 3) return 0;
             if (type == 1) {
                 // use fixed code lengths
                 if (!stbi__zbuild_huffman(&a->z_length, stbi__zdefault_length, STBI__ZNSYMS)) return 0;
@@ -4542,10 +6109,19 @@ static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
             else {
                 if (!stbi__compute_huffman_codes(a)) return 0;
             }
-            if (!stbi__parse_huffman_block(a)) return 0;
+            stbi__zbuild_fast_litlen(a);
+            a->in_block = 1;
         }
-    } while (!final);
-    return 1;
+        r = stbi__parse_huffman_block(a);
+        if (r != 1) return r;
+        a->in_block = 0;
+    }
+}
+
+static int stbi__parse_zlib(stbi__zbuf* a, int parse_header)
+{
+    if (!stbi__zlib_start(a, parse_header)) return 0;
+    return stbi__zlib_run(a);
 }
 
 static int stbi__do_zlib(stbi__zbuf* a, char* obuf, int olen, int exp, int parse_header)
@@ -4554,6 +6130,8 @@ static int stbi__do_zlib(stbi__zbuf* a, char* obuf, int olen, int exp, int parse
     a->zout = obuf;
     a->zout_end = obuf + olen;
     a->z_expandable = exp;
+    a->zout_pause = NULL;
+    a->stop_at_flush = 0;
 
     return stbi__parse_zlib(a, parse_header);
 }
@@ -4671,44 +6249,293 @@ static int stbi__check_png_header(stbi__context* s)
     return 1;
 }
 
-typedef struct
+typedef struct
+{
+    stbi__context* s;
+    stbi_uc* idata, * expanded, * out;
+    int depth;
+    int out_direct; // 'out' is the caller's buffer, see stbi_load_into
+    stbi__uint32 out_y0; // the image row at the top of 'out', which holds one band when decoding in bands
+    int bands;      // the image went to the band callback, see stbi__png_load_bands
+} stbi__png;
+
+
+enum {
+    STBI__F_none = 0,
+    STBI__F_sub = 1,
+    STBI__F_up = 2,
+    STBI__F_avg = 3,
+    STBI__F_paeth = 4,
+    // synthetic filter used for first scanline to avoid needing a dummy row of 0s
+    STBI__F_avg_first
+};
+
+static stbi_uc first_row_filter[5] =
+{
+   STBI__F_none,
+   STBI__F_sub,
+   STBI__F_none,
+   STBI__F_avg_first,
+   STBI__F_sub // Paeth with b=c=0 turns out to be equivalent to sub
+};
+
+static int stbi__paeth(int a, int b, int c)
+{
+    // This formulation looks very different from the reference in the PNG spec, but is
+    // actually equivalent and has favorable data dependencies and admits straightforward
+    // generation of branch-free code, which helps performance significantly.
+    int thresh = c * 3 - (a + b);
+    int lo = a < b ? a : b;
+    int hi = a < b ? b : a;
+    int t0 = (hi <= thresh) ? lo : c;
+    int t1 = (thresh <= lo) ? hi : t0;
+    return t1;
+}
+
+// SIMD row unfiltering. Sub, Average and Paeth depend on the pixel to the left, so pixels are still processed one
+// after the other, but all bytes of a 3 or 4 byte pixel at once; Up has no such dependency and runs 16 bytes at a
+// time for any pixel size. Kernels are picked per image in stbi__setup_png_unfilter, NULL entries fall back to the
+// scalar loops in stbi__create_png_image_raw.
+typedef void (*stbi__png_unfilter_kernel)(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp);
+
+#ifdef STBI_SSE2
+#include <smmintrin.h>
+
+#ifdef __GNUC__
+#define STBI__SSE41_TARGET __attribute__((target("sse4.1")))
+#else
+#define STBI__SSE41_TARGET
+#endif
+
+static int stbi__sse41_available(void)
+{
+#if defined(_MSC_VER) && _MSC_VER >= 1400
+    int info[4];
+    __cpuid(info, 1);
+    return ((info[2] >> 19) & 1) != 0;
+#elif defined(__GNUC__)
+    return __builtin_cpu_supports("sse4.1");
+#else
+    return 0;
+#endif
+}
+
+// one pixel in the low 'bpp' bytes, never touching memory past it. 3 byte pixels are assembled in a register: a
+// 4 byte load of 3 bytes just stored on the stack stalls store forwarding.
+static __m128i stbi__png_load_sse2(stbi_uc const* p, int bpp)
+{
+    int v;
+    if (bpp == 4) memcpy(&v, p, 4);
+    else v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return _mm_cvtsi32_si128(v);
+}
+
+static void stbi__png_store_sse2(stbi_uc* p, __m128i pixel, int bpp)
+{
+    int v = _mm_cvtsi128_si32(pixel);
+    if (bpp == 4) {
+        memcpy(p, &v, 4);
+    } else {
+        p[0] = STBI__BYTECAST(v);
+        p[1] = STBI__BYTECAST(v >> 8);
+        p[2] = STBI__BYTECAST(v >> 16);
+    }
+}
+
+static void stbi__unfilter_up_sse2(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    int k = 0;
+    STBI_NOTUSED(bpp);
+    for (; k + 16 <= nk; k += 16) {
+        __m128i r = _mm_loadu_si128((__m128i const*)(raw + k));
+        __m128i b = _mm_loadu_si128((__m128i const*)(prior + k));
+        _mm_storeu_si128((__m128i*)(cur + k), _mm_add_epi8(r, b));
+    }
+    for (; k < nk; ++k)
+        cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+static void stbi__unfilter_sub_sse2(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    __m128i a = _mm_setzero_si128();
+    int k;
+    STBI_NOTUSED(prior);
+    for (k = 0; k < nk; k += bpp) {
+        a = _mm_add_epi8(a, stbi__png_load_sse2(raw + k, bpp));
+        stbi__png_store_sse2(cur + k, a, bpp);
+    }
+}
+
+// floor((a + b) / 2): pavgb rounds up, so take back the carry of odd sums
+static __m128i stbi__png_average_sse2(__m128i a, __m128i b)
+{
+    __m128i odd = _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1));
+    return _mm_sub_epi8(_mm_avg_epu8(a, b), odd);
+}
+
+static void stbi__unfilter_avg_sse2(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    __m128i a = _mm_setzero_si128();
+    int k;
+    for (k = 0; k < nk; k += bpp) {
+        __m128i b = stbi__png_load_sse2(prior + k, bpp);
+        a = _mm_add_epi8(stbi__png_load_sse2(raw + k, bpp), stbi__png_average_sse2(a, b));
+        stbi__png_store_sse2(cur + k, a, bpp);
+    }
+}
+
+static void stbi__unfilter_avg_first_sse2(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    __m128i a = _mm_setzero_si128(), zero = _mm_setzero_si128();
+    int k;
+    STBI_NOTUSED(prior);
+    for (k = 0; k < nk; k += bpp) {
+        a = _mm_add_epi8(stbi__png_load_sse2(raw + k, bpp), stbi__png_average_sse2(a, zero));
+        stbi__png_store_sse2(cur + k, a, bpp);
+    }
+}
+
+// stbi__paeth's branch-free form on 16-bit lanes. Two pblendvb per pixel keep the dependency on the left pixel short
+// enough to beat the scalar loop; plain SSE2 needs and/andnot/or for each select and ends up slower than it, so
+// there is no SSE2 Paeth kernel. 'thresh <= lo' is computed as 'lo > thresh - 1' to save a compare.
+// The first pixel of a row starts with a = c = 0, for which Paeth picks b like the scalar code does.
+STBI__SSE41_TARGET static void stbi__unfilter_paeth_sse41(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    __m128i zero = _mm_setzero_si128(), one = _mm_set1_epi16(1);
+    __m128i a = zero, c = zero;
+    int k;
+    for (k = 0; k < nk; k += bpp) {
+        __m128i b = _mm_unpacklo_epi8(stbi__png_load_sse2(prior + k, bpp), zero);
+        __m128i d = _mm_unpacklo_epi8(stbi__png_load_sse2(raw + k, bpp), zero);
+        __m128i base = _mm_sub_epi16(_mm_add_epi16(c, _mm_add_epi16(c, c)), b); // 3c - b, independent of a
+        __m128i thresh = _mm_sub_epi16(base, a);
+        __m128i below = _mm_sub_epi16(_mm_sub_epi16(base, one), a);
+        __m128i lo = _mm_min_epi16(a, b), hi = _mm_max_epi16(a, b);
+        __m128i t0 = _mm_blendv_epi8(lo, c, _mm_cmpgt_epi16(hi, thresh));
+        __m128i t1 = _mm_blendv_epi8(t0, hi, _mm_cmpgt_epi16(lo, below));
+        // adding bytes wraps modulo 256 and keeps the high byte of every lane 0
+        a = _mm_add_epi8(d, t1);
+        c = b;
+        stbi__png_store_sse2(cur + k, _mm_packus_epi16(a, a), bpp);
+    }
+}
+#endif // STBI_SSE2
+
+#ifdef STBI_NEON
+static uint8x8_t stbi__png_load_neon(stbi_uc const* p, int bpp)
+{
+    stbi__uint32 v;
+    if (bpp == 4) memcpy(&v, p, 4);
+    else v = p[0] | (p[1] << 8) | (p[2] << 16);
+    return vreinterpret_u8_u32(vdup_n_u32(v));
+}
+
+static void stbi__png_store_neon(stbi_uc* p, uint8x8_t pixel, int bpp)
+{
+    stbi__uint32 v = vget_lane_u32(vreinterpret_u32_u8(pixel), 0);
+    if (bpp == 4) {
+        memcpy(p, &v, 4);
+    } else {
+        p[0] = STBI__BYTECAST(v);
+        p[1] = STBI__BYTECAST(v >> 8);
+        p[2] = STBI__BYTECAST(v >> 16);
+    }
+}
+
+static void stbi__unfilter_up_neon(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    int k = 0;
+    STBI_NOTUSED(bpp);
+    for (; k + 16 <= nk; k += 16)
+        vst1q_u8(cur + k, vaddq_u8(vld1q_u8(raw + k), vld1q_u8(prior + k)));
+    for (; k < nk; ++k)
+        cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+}
+
+static void stbi__unfilter_sub_neon(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    int k;
+    STBI_NOTUSED(prior);
+    for (k = 0; k < nk; k += bpp) {
+        a = vadd_u8(a, stbi__png_load_neon(raw + k, bpp));
+        stbi__png_store_neon(cur + k, a, bpp);
+    }
+}
+
+static void stbi__unfilter_avg_neon(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    int k;
+    for (k = 0; k < nk; k += bpp) {
+        // vhadd rounds down, exactly the PNG average
+        a = vadd_u8(stbi__png_load_neon(raw + k, bpp), vhadd_u8(a, stbi__png_load_neon(prior + k, bpp)));
+        stbi__png_store_neon(cur + k, a, bpp);
+    }
+}
+
+static void stbi__unfilter_avg_first_neon(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
+{
+    uint8x8_t a = vdup_n_u8(0);
+    int k;
+    STBI_NOTUSED(prior);
+    for (k = 0; k < nk; k += bpp) {
+        a = vadd_u8(stbi__png_load_neon(raw + k, bpp), vshr_n_u8(a, 1));
+        stbi__png_store_neon(cur + k, a, bpp);
+    }
+}
+
+static void stbi__unfilter_paeth_neon(stbi_uc* cur, stbi_uc const* raw, stbi_uc const* prior, int nk, int bpp)
 {
-    stbi__context* s;
-    stbi_uc* idata, * expanded, * out;
-    int depth;
-} stbi__png;
+    uint8x8_t a = vdup_n_u8(0), c = vdup_n_u8(0);
+    int k;
+    for (k = 0; k < nk; k += bpp) {
+        uint8x8_t b = stbi__png_load_neon(prior + k, bpp);
+        uint16x8_t pa = vabdl_u8(b, c);                                // |p - a|
+        uint16x8_t pb = vabdl_u8(a, c);                                // |p - b|
+        uint16x8_t pc = vabdq_u16(vaddl_u8(a, b), vaddl_u8(c, c));     // |p - c|
+        // ties favor a over b over c
+        uint8x8_t use_a = vmovn_u16(vandq_u16(vcleq_u16(pa, pb), vcleq_u16(pa, pc)));
+        uint8x8_t use_b = vmovn_u16(vcleq_u16(pb, pc));
+        uint8x8_t nearest = vbsl_u8(use_a, a, vbsl_u8(use_b, b, c));
+        a = vadd_u8(stbi__png_load_neon(raw + k, bpp), nearest);
+        c = b;
+        stbi__png_store_neon(cur + k, a, bpp);
+    }
+}
+#endif // STBI_NEON
 
+// fill in the kernels for the pixel size of an image, 'filter_bytes' is 1 for images below 8 bits per channel
+static void stbi__setup_png_unfilter(stbi__png_unfilter_kernel kernels[STBI__F_avg_first + 1], int filter_bytes)
+{
+    int i;
+    for (i = 0; i <= STBI__F_avg_first; ++i)
+        kernels[i] = NULL;
 
-enum {
-    STBI__F_none = 0,
-    STBI__F_sub = 1,
-    STBI__F_up = 2,
-    STBI__F_avg = 3,
-    STBI__F_paeth = 4,
-    // synthetic filter used for first scanline to avoid needing a dummy row of 0s
-    STBI__F_avg_first
-};
+#ifdef STBI_SSE2
+    if (stbi__sse2_available()) {
+        kernels[STBI__F_up] = stbi__unfilter_up_sse2;
+        if (filter_bytes == 3 || filter_bytes == 4) {
+            kernels[STBI__F_sub] = stbi__unfilter_sub_sse2;
+            kernels[STBI__F_avg] = stbi__unfilter_avg_sse2;
+            kernels[STBI__F_avg_first] = stbi__unfilter_avg_first_sse2;
+            if (stbi__sse41_available())
+                kernels[STBI__F_paeth] = stbi__unfilter_paeth_sse41;
+        }
+    }
+#endif
 
-static stbi_uc first_row_filter[5] =
-{
-   STBI__F_none,
-   STBI__F_sub,
-   STBI__F_none,
-   STBI__F_avg_first,
-   STBI__F_sub // Paeth with b=c=0 turns out to be equivalent to sub
-};
+#ifdef STBI_NEON
+    kernels[STBI__F_up] = stbi__unfilter_up_neon;
+    if (filter_bytes == 3 || filter_bytes == 4) {
+        kernels[STBI__F_sub] = stbi__unfilter_sub_neon;
+        kernels[STBI__F_avg] = stbi__unfilter_avg_neon;
+        kernels[STBI__F_avg_first] = stbi__unfilter_avg_first_neon;
+        kernels[STBI__F_paeth] = stbi__unfilter_paeth_neon;
+    }
+#endif
 
-static int stbi__paeth(int a, int b, int c)
-{
-    // This formulation looks very different from the reference in the PNG spec, but is
-    // actually equivalent and has favorable data dependencies and admits straightforward
-    // generation of branch-free code, which helps performance significantly.
-    int thresh = c * 3 - (a + b);
-    int lo = a < b ? a : b;
-    int hi = a < b ? b : a;
-    int t0 = (hi <= thresh) ? lo : c;
-    int t1 = (thresh <= lo) ? hi : t0;
-    return t1;
+    STBI_NOTUSED(filter_bytes);
 }
 
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
@@ -4737,67 +6564,44 @@ static void stbi__create_png_alpha_expand8(stbi_uc* dest, stbi_uc* src, stbi__ui
     }
 }
 
-// create the png data from post-deflated data
-static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+// Unfilter rows [j0, j1) of the decompressed image, 'raw' pointing at the filter byte of row j0, and convert them into
+// a->out. 'filter_buf' holds two rows and carries the previous row from one call to the next; a run can start
+// anywhere on a row whose filter does not look at the previous row. Safe to call for disjoint runs on several threads.
+static int stbi__png_unfilter_rows(stbi__png* a, stbi_uc* raw, stbi_uc* filter_buf, stbi__png_unfilter_kernel* unfilter, int out_n, stbi__uint32 x, stbi__uint32 j0, stbi__uint32 j1, int depth, int color)
 {
     int bytes = (depth == 16 ? 2 : 1);
     stbi__context* s = a->s;
     stbi__uint32 i, j, stride = x * out_n * bytes;
-    stbi__uint32 img_len, img_width_bytes;
-    stbi_uc* filter_buf;
-    int all_ok = 1;
+    stbi__uint32 img_width_bytes = (((s->img_n * x * depth) + 7) >> 3);
     int k;
     int img_n = s->img_n; // copy it into a local for later
-
-    int output_bytes = out_n * bytes;
     int filter_bytes = img_n * bytes;
     int width = x;
 
-    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
-    a->out = (stbi_uc*)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
-    if (!a->out) return stbi__err("outofmem", "Out of memory");
-
-    // note: error exits here don't need to clean up a->out individually,
-    // stbi__do_png always does on error.
-    if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
-    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
-    if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
-    img_len = (img_width_bytes + 1) * y;
-
-    // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
-    // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
-    // so just check for raw_len < img_len always.
-    if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
-
-    // Allocate two scan lines worth of filter workspace buffer.
-    filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2, 0);
-    if (!filter_buf) return stbi__err("outofmem", "Out of memory");
-
     // Filtering for low-bit-depth images
     if (depth < 8) {
         filter_bytes = 1;
         width = img_width_bytes;
     }
 
-    for (j = 0; j < y; ++j) {
+    for (j = j0; j < j1; ++j) {
         // cur/prior filter buffers alternate
         stbi_uc* cur = filter_buf + (j & 1) * img_width_bytes;
         stbi_uc* prior = filter_buf + (~j & 1) * img_width_bytes;
-        stbi_uc* dest = a->out + stride * j;
+        stbi_uc* dest = a->out_direct ? stbi__out_row(s, j) : a->out + stride * (j - a->out_y0);
         int nk = width * filter_bytes;
         int filter = *raw++;
 
         // check filter type
-        if (filter > 4) {
-            all_ok = stbi__err("invalid filter", "Corrupt PNG");
-            break;
-        }
+        if (filter > 4) return stbi__err("invalid filter", "Corrupt PNG");
 
         // if first row, use special filter that doesn't sample previous row
         if (j == 0) filter = first_row_filter[filter];
 
         // perform actual filtering
-        switch (filter) {
+        if (unfilter[filter])
+            unfilter[filter](cur, raw, prior, nk, filter_bytes);
+        else switch (filter) {
         case STBI__F_none:
             memcpy(cur, raw, nk);
             break;
@@ -4903,6 +6707,48 @@ static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 r
         }
     }
 
+    return 1;
+}
+
+// create the png data from post-deflated data
+static int stbi__create_png_image_raw(stbi__png* a, stbi_uc* raw, stbi__uint32 raw_len, int out_n, stbi__uint32 x, stbi__uint32 y, int depth, int color)
+{
+    int bytes = (depth == 16 ? 2 : 1);
+    stbi__context* s = a->s;
+    stbi__uint32 img_len, img_width_bytes;
+    stbi_uc* filter_buf;
+    stbi__png_unfilter_kernel unfilter[STBI__F_avg_first + 1];
+    int all_ok;
+    int img_n = s->img_n; // copy it into a local for later
+
+    int output_bytes = out_n * bytes;
+
+    STBI_ASSERT(out_n == s->img_n || out_n == s->img_n + 1);
+    if (a->out_direct)
+        a->out = s->out_buffer;
+    else
+        a->out = (stbi_uc*)stbi__malloc_mad3(x, y, output_bytes, 0); // extra bytes to write off the end into
+    if (!a->out) return stbi__err("outofmem", "Out of memory");
+
+    // note: error exits here don't need to clean up a->out individually,
+    // stbi__do_png always does on error.
+    if (!stbi__mad3sizes_valid(img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
+    img_width_bytes = (((img_n * x * depth) + 7) >> 3);
+    if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return stbi__err("too large", "Corrupt PNG");
+    img_len = (img_width_bytes + 1) * y;
+
+    // we used to check for exact match between raw_len and img_len on non-interlaced PNGs,
+    // but issue #276 reported a PNG in the wild that had extra data at the end (all zeros),
+    // so just check for raw_len < img_len always.
+    if (raw_len < img_len) return stbi__err("not enough pixels", "Corrupt PNG");
+
+    // Allocate two scan lines worth of filter workspace buffer.
+    filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2, 0);
+    if (!filter_buf) return stbi__err("outofmem", "Out of memory");
+
+    stbi__setup_png_unfilter(unfilter, depth < 8 ? 1 : img_n * bytes);
+    all_ok = stbi__png_unfilter_rows(a, raw, filter_buf, unfilter, out_n, x, 0, y, depth, color);
+
     STBI_FREE(filter_buf);
     if (!all_ok) return 0;
 
@@ -4954,10 +6800,264 @@ static int stbi__create_png_image(stbi__png* a, stbi_uc* image_data, stbi__uint3
     return 1;
 }
 
-static int stbi__compute_transparency(stbi__png* z, stbi_uc tc[3], int out_n)
+// Parallel decoding of large non-interlaced PNGs, see stbi_set_parallel_run. The image is split in one of two ways:
+//   - some encoders flush the deflate stream every so often and never refer back across a flush, so the pieces
+//     between flushes inflate independently. A flush ends in an empty stored block, the bytes 00 00 ff ff, which
+//     are looked for in the IDAT data. Pieces are inflated in parallel, every one checked to end exactly where the
+//     next one starts, then rows are unfiltered in parallel from rows whose filter ignores the row above.
+//   - otherwise inflating and unfiltering are pipelined: each step one task inflates the next part of the stream
+//     while another unfilters the rows that the previous steps completed.
+// If anything goes wrong, including pieces that do refer back, the image is decoded again on the calling thread,
+// which reports errors the usual way. Tasks only ever touch memory allocated here on the calling thread.
+#define STBI__PNG_PARALLEL_MIN    (1 << 20)  // decompressed bytes, smaller images are not worth it
+#define STBI__PNG_PIECE_MIN       (1 << 16)  // compressed bytes in a piece inflated on its own
+#define STBI__PNG_MAX_PIECES      64
+#define STBI__PNG_PROBE_BYTES     (1 << 16)  // inflated from each piece up front, to see whether it refers back
+#define STBI__PNG_MAX_BANDS       16         // runs of rows unfiltered in parallel
+#define STBI__PNG_PIPELINE_STEPS  16
+
+typedef struct
 {
-    stbi__context* s = z->s;
-    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
+    stbi__png* a;
+    stbi_uc* raw;
+    stbi_uc* filter_buf; // two rows per band
+    stbi__png_unfilter_kernel unfilter[STBI__F_avg_first + 1];
+    stbi__uint32 img_width_bytes;
+    stbi__uint32 bands[STBI__PNG_MAX_BANDS + 1]; // band i is rows bands[i] to bands[i+1]
+    int out_n, depth, color;
+    int ok[STBI__PNG_MAX_BANDS];
+} stbi__png_rows_job;
+
+static void stbi__png_rows_task(void* data, int index)
+{
+    stbi__png_rows_job* job = (stbi__png_rows_job*)data;
+    stbi_uc* filter_buf = job->filter_buf + (size_t)index * 2 * job->img_width_bytes;
+    stbi_uc* raw = job->raw + (size_t)job->bands[index] * (job->img_width_bytes + 1);
+    job->ok[index] = stbi__png_unfilter_rows(job->a, raw, filter_buf, job->unfilter, job->out_n, job->a->s->img_x,
+        job->bands[index], job->bands[index + 1], job->depth, job->color);
+}
+
+typedef struct
+{
+    stbi_uc* pieces[STBI__PNG_MAX_PIECES + 1]; // start of every piece, then the end of the stream
+    char* out[STBI__PNG_MAX_PIECES];
+    int out_size[STBI__PNG_MAX_PIECES], out_len[STBI__PNG_MAX_PIECES], ok[STBI__PNG_MAX_PIECES];
+    int count, parse_header;
+} stbi__png_inflate_job;
+
+static void stbi__png_inflate_task(void* data, int index)
+{
+    stbi__png_inflate_job* job = (stbi__png_inflate_job*)data;
+    stbi__zbuf z;
+    int r;
+    z.zbuffer = job->pieces[index];
+    z.zbuffer_end = job->pieces[index + 1];
+    z.zout_start = z.zout = job->out[index];
+    z.zout_end = z.zout_start + job->out_size[index];
+    z.z_expandable = 0;
+    z.zout_pause = NULL;
+    z.stop_at_flush = index + 1 < job->count;
+    r = stbi__zlib_start(&z, index == 0 && job->parse_header) ? stbi__zlib_run(&z) : 0;
+    job->ok[index] = r == (z.stop_at_flush ? STBI__ZFLUSHED : 1);
+    job->out_len[index] = (int)(z.zout - z.zout_start);
+}
+
+typedef struct
+{
+    stbi__zbuf z;
+    int inflate, result; // whether this step inflates, and what stbi__zlib_run returned
+    stbi__png_rows_job* rows;
+} stbi__png_pipeline_job;
+
+static void stbi__png_pipeline_task(void* data, int index)
+{
+    stbi__png_pipeline_job* job = (stbi__png_pipeline_job*)data;
+    if (index == 0 && job->inflate)
+        job->result = stbi__zlib_run(&job->z);
+    else
+        stbi__png_rows_task(job->rows, 0);
+}
+
+// whether the deflate stream at 'start' can be inflated without the data before it, judged by its first bytes
+static int stbi__png_probe_piece(stbi_uc* start, stbi_uc* end, char* buffer)
+{
+    stbi__zbuf z;
+    z.zbuffer = start;
+    z.zbuffer_end = end;
+    z.zout_start = z.zout = buffer;
+    z.zout_end = buffer + 2 * STBI__PNG_PROBE_BYTES + STBI__ZFAST_OUT_MARGIN; // room for a stored block after the pause
+    z.z_expandable = 0;
+    z.zout_pause = buffer + STBI__PNG_PROBE_BYTES;
+    z.stop_at_flush = 0;
+    return stbi__zlib_start(&z, 0) && stbi__zlib_run(&z) != 0;
+}
+
+// split the IDAT data at flushes into pieces of at least STBI__PNG_PIECE_MIN bytes that pass the probe
+static int stbi__png_find_pieces(stbi__png_inflate_job* job, stbi_uc* data, stbi__uint32 len, char* probe_buffer)
+{
+    stbi_uc* end = data + len;
+    stbi_uc* p = data;
+    job->count = 0;
+    job->pieces[job->count++] = data;
+    while (job->count < STBI__PNG_MAX_PIECES && end - p > 4) {
+        stbi_uc* ff = (stbi_uc*)memchr(p + 3, 0xff, end - (p + 3));
+        stbi_uc* start;
+        if (!ff) break;
+        p = ff - 2; // where 00 00 ff ff would start, the next search begins after ff
+        start = p + 4;
+        if (ff + 1 < end && ff[1] == 0xff && ff[-1] == 0 && ff[-2] == 0
+            && start - job->pieces[job->count - 1] >= STBI__PNG_PIECE_MIN && end - start >= STBI__PNG_PIECE_MIN
+            && stbi__png_probe_piece(start, end, probe_buffer)) {
+            job->pieces[job->count++] = start;
+            p = start;
+        }
+    }
+    job->pieces[job->count] = end;
+    return job->count;
+}
+
+// Returns 1 when it decoded the image into a->out, 0 if the image has to be decoded serially.
+static int stbi__create_png_image_parallel(stbi__png* a, stbi__uint32 idata_len, stbi__uint32 raw_len, int out_n, int color, int interlaced, int is_iphone)
+{
+    stbi__context* s = a->s;
+    int depth = a->depth, bytes = (depth == 16 ? 2 : 1);
+    stbi__uint32 x = s->img_x, y = s->img_y, img_width_bytes, img_len, row_bytes, j;
+    stbi__png_rows_job rows;
+    stbi__png_inflate_job* pieces = NULL;
+    stbi__png_pipeline_job* pipeline = NULL;
+    char* probe_buffer = NULL;
+    int i, n, ok = 0;
+
+    if (!stbi__parallel_run || interlaced || raw_len < STBI__PNG_PARALLEL_MIN) return 0;
+    if (!stbi__mad3sizes_valid(s->img_n, x, depth, 7)) return 0;
+    img_width_bytes = (((s->img_n * x * depth) + 7) >> 3);
+    if (!stbi__mad2sizes_valid(img_width_bytes, y, img_width_bytes)) return 0;
+    row_bytes = img_width_bytes + 1;
+    img_len = row_bytes * y;
+    if (img_len > INT_MAX - 2 * STBI__ZFAST_OUT_MARGIN) return 0;
+
+    memset(&rows, 0, sizeof(rows));
+    rows.a = a;
+    rows.img_width_bytes = img_width_bytes;
+    rows.out_n = out_n;
+    rows.depth = depth;
+    rows.color = color;
+    stbi__setup_png_unfilter(rows.unfilter, depth < 8 ? 1 : s->img_n * bytes);
+
+    a->out = a->out_direct ? s->out_buffer : (stbi_uc*)stbi__malloc_mad3(x, y, out_n * bytes, 0);
+    a->expanded = (stbi_uc*)stbi__malloc(img_len + STBI__ZFAST_OUT_MARGIN);
+    rows.filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2 * STBI__PNG_MAX_BANDS, 0);
+    pieces = (stbi__png_inflate_job*)stbi__malloc(sizeof(*pieces));
+    probe_buffer = (char*)stbi__malloc(2 * STBI__PNG_PROBE_BYTES + STBI__ZFAST_OUT_MARGIN);
+    if (!a->out || !a->expanded || !rows.filter_buf || !pieces || !probe_buffer) goto done;
+    rows.raw = a->expanded;
+
+    if (stbi__png_find_pieces(pieces, a->idata, idata_len, probe_buffer) > 1) {
+        stbi__uint32 total = 0;
+        pieces->parse_header = !is_iphone;
+        // the first piece goes straight to its place, the others get room for twice their share plus an even share
+        pieces->out[0] = (char*)a->expanded;
+        pieces->out_size[0] = img_len + STBI__ZFAST_OUT_MARGIN;
+        for (i = 1; i < pieces->count; ++i) {
+            double share = (double)(pieces->pieces[i + 1] - pieces->pieces[i]) / idata_len;
+            double size = img_len * (2 * share + 2.0 / pieces->count) + STBI__ZFAST_OUT_MARGIN;
+            pieces->out_size[i] = size < img_len + STBI__ZFAST_OUT_MARGIN ? (int)size : (int)(img_len + STBI__ZFAST_OUT_MARGIN);
+            pieces->out[i] = (char*)stbi__malloc(pieces->out_size[i]);
+            if (!pieces->out[i]) {
+                pieces->count = i; // free what was allocated
+                goto free_pieces;
+            }
+        }
+        stbi__parallel_run(stbi__png_inflate_task, pieces, pieces->count);
+
+        for (i = 0; i < pieces->count; ++i) {
+            // data past the image is ignored, like create_png_image_raw does
+            int len = pieces->out_len[i] < (int)(img_len - total) ? pieces->out_len[i] : (int)(img_len - total);
+            if (!pieces->ok[i]) goto free_pieces;
+            if (i) memcpy(a->expanded + total, pieces->out[i], len);
+            total += len;
+        }
+        if (total < img_len) goto free_pieces;
+
+        // bands start at rows whose filter ignores the row above
+        n = 1;
+        for (i = 1; i < STBI__PNG_MAX_BANDS; ++i) {
+            j = (stbi__uint32)((stbi__uint64)y * i / STBI__PNG_MAX_BANDS);
+            if (j <= rows.bands[n - 1]) j = rows.bands[n - 1] + 1;
+            while (j < y && a->expanded[(size_t)j * row_bytes] != STBI__F_none && a->expanded[(size_t)j * row_bytes] != STBI__F_sub)
+                ++j;
+            if (j >= y) break;
+            rows.bands[n++] = j;
+        }
+        rows.bands[n] = y;
+        stbi__parallel_run(stbi__png_rows_task, &rows, n);
+        ok = 1;
+        for (i = 0; i < n; ++i)
+            ok &= rows.ok[i];
+
+    free_pieces:
+        for (i = 1; i < pieces->count; ++i)
+            STBI_FREE(pieces->out[i]);
+        goto done;
+    }
+
+    pipeline = (stbi__png_pipeline_job*)stbi__malloc(sizeof(*pipeline));
+    if (!pipeline) goto done;
+    pipeline->z.zbuffer = a->idata;
+    pipeline->z.zbuffer_end = a->idata + idata_len;
+    pipeline->z.zout_start = pipeline->z.zout = (char*)a->expanded;
+    pipeline->z.zout_end = (char*)a->expanded + img_len + STBI__ZFAST_OUT_MARGIN;
+    pipeline->z.z_expandable = 0; // rows are being read from it
+    pipeline->z.stop_at_flush = 0;
+    pipeline->rows = &rows;
+    pipeline->result = STBI__ZPAUSED;
+    if (!stbi__zlib_start(&pipeline->z, !is_iphone)) goto done;
+    {
+        stbi__uint32 done_rows = 0, produced = 0, step = (img_len + STBI__PNG_PIPELINE_STEPS - 1) / STBI__PNG_PIPELINE_STEPS;
+        while (done_rows < y) {
+            stbi__uint32 ready = produced / row_bytes < y ? produced / row_bytes : y;
+            pipeline->inflate = pipeline->result == STBI__ZPAUSED && produced < img_len;
+            if (pipeline->inflate)
+                pipeline->z.zout_pause = (char*)a->expanded + (img_len - produced > step ? produced + step : img_len);
+            rows.bands[0] = done_rows;
+            rows.bands[1] = ready;
+            n = pipeline->inflate + (ready > done_rows);
+            if (n == 0) goto done; // the stream ended early
+            stbi__parallel_run(stbi__png_pipeline_task, pipeline, n);
+            if (ready > done_rows && !rows.ok[0]) goto done;
+            if (pipeline->inflate) {
+                if (pipeline->result == 0) goto done;
+                produced = (stbi__uint32)(pipeline->z.zout - pipeline->z.zout_start);
+            }
+            done_rows = ready;
+        }
+        // the rest of the stream, usually just its end, is still checked like stbi__do_zlib would
+        if (pipeline->result == STBI__ZPAUSED) {
+            pipeline->z.zout_pause = NULL;
+            pipeline->z.z_expandable = 1;
+            pipeline->result = stbi__zlib_run(&pipeline->z);
+            a->expanded = (stbi_uc*)pipeline->z.zout_start;
+        }
+        ok = pipeline->result == 1;
+    }
+
+done:
+    STBI_FREE(pipeline);
+    STBI_FREE(probe_buffer);
+    STBI_FREE(pieces);
+    STBI_FREE(rows.filter_buf);
+    if (!ok) {
+        if (!a->out_direct) STBI_FREE(a->out);
+        a->out = NULL;
+        STBI_FREE(a->expanded);
+        a->expanded = NULL;
+    }
+    return ok;
+}
+
+static int stbi__compute_transparency(stbi__png* z, stbi__uint32 pixel_count, stbi_uc tc[3], int out_n)
+{
+    stbi__uint32 i;
     stbi_uc* p = z->out;
 
     // compute color-based transparency, assuming we've
@@ -4980,10 +7080,9 @@ static int stbi__compute_transparency(stbi__png* z, stbi_uc tc[3], int out_n)
     return 1;
 }
 
-static int stbi__compute_transparency16(stbi__png* z, stbi__uint16 tc[3], int out_n)
+static int stbi__compute_transparency16(stbi__png* z, stbi__uint32 pixel_count, stbi__uint16 tc[3], int out_n)
 {
-    stbi__context* s = z->s;
-    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
+    stbi__uint32 i;
     stbi__uint16* p = (stbi__uint16*)z->out;
 
     // compute color-based transparency, assuming we've
@@ -5006,9 +7105,9 @@ static int stbi__compute_transparency16(stbi__png* z, stbi__uint16 tc[3], int ou
     return 1;
 }
 
-static int stbi__expand_png_palette(stbi__png* a, stbi_uc* palette, int len, int pal_img_n)
+static int stbi__expand_png_palette(stbi__png* a, stbi__uint32 pixel_count, stbi_uc* palette, int len, int pal_img_n)
 {
-    stbi__uint32 i, pixel_count = a->s->img_x * a->s->img_y;
+    stbi__uint32 i;
     stbi_uc* p, * temp_out, * orig = a->out;
 
     p = (stbi_uc*)stbi__malloc_mad2(pixel_count, pal_img_n, 0);
@@ -5084,10 +7183,10 @@ STBIDEF void stbi_convert_iphone_png_to_rgb_thread(int flag_true_if_should_conve
                                 : stbi__de_iphone_flag_global)
 #endif // STBI_THREAD_LOCAL
 
-static void stbi__de_iphone(stbi__png* z)
+static void stbi__de_iphone(stbi__png* z, stbi__uint32 pixel_count)
 {
     stbi__context* s = z->s;
-    stbi__uint32 i, pixel_count = s->img_x * s->img_y;
+    stbi__uint32 i;
     stbi_uc* p = z->out;
 
     if (s->img_out_n == 3) {  // convert bgr to rgb
@@ -5130,6 +7229,129 @@ static void stbi__de_iphone(stbi__png* z)
     }
 }
 
+// Band output (see stbi_load_bands) of a non-interlaced PNG. Instead of inflating the whole image up front, the IDAT
+// data is inflated a band at a time into a window that keeps only the 32K deflate can refer back to besides the band,
+// and each band is unfiltered and converted like stbi__parse_png_file and stbi__do_png convert the whole image.
+#define STBI__ZWINDOW  32768
+
+static int stbi__png_load_bands(stbi__png* z, stbi__uint32 idata_len, int req_comp, int color, int is_iphone, stbi_uc* palette, int pal_len, int pal_img_n, int has_trans, stbi_uc tc[3], stbi__uint16 tc16[3])
+{
+    stbi__context* s = z->s;
+    int depth = z->depth, bytes = (depth == 16 ? 2 : 1), out_n = s->img_out_n, n, r, ok = 0;
+    stbi__uint32 x = s->img_x, y = s->img_y, img_width_bytes, row_bytes, band_rows, rows, j;
+    size_t band_bytes, window;
+    stbi_uc* filter_buf;
+    char* row_start; // where row j starts in the window
+    stbi__png_unfilter_kernel unfilter[STBI__F_avg_first + 1];
+    stbi__zbuf zb;
+
+    if (!stbi__mad3sizes_valid(s->img_n, x, depth, 7)) return stbi__err("too large", "Corrupt PNG");
+    img_width_bytes = (((s->img_n * x * depth) + 7) >> 3);
+    row_bytes = img_width_bytes + 1;
+    band_rows = (stbi__uint32)s->band_rows < y ? (stbi__uint32)s->band_rows : y;
+    // besides the band and what it refers back to, the window has room for inflating past the pause: by a match,
+    // or by a whole stored block when one starts right before it
+    if (!stbi__mad2sizes_valid(row_bytes, band_rows, STBI__ZWINDOW + 65536 + 2 * STBI__ZFAST_OUT_MARGIN)) return stbi__err("too large", "Corrupt PNG");
+    band_bytes = (size_t)row_bytes * band_rows;
+    window = STBI__ZWINDOW + band_bytes + 65536 + 2 * STBI__ZFAST_OUT_MARGIN;
+
+    zb.zout_start = (char*)stbi__malloc(window);
+    filter_buf = (stbi_uc*)stbi__malloc_mad2(img_width_bytes, 2, 0);
+    if (!zb.zout_start || !filter_buf) {
+        stbi__err("outofmem", "Out of memory");
+        goto done;
+    }
+    zb.zbuffer = z->idata;
+    zb.zbuffer_end = z->idata + idata_len;
+    zb.zout = row_start = zb.zout_start;
+    zb.zout_end = zb.zout_start + window;
+    zb.z_expandable = 0;
+    zb.stop_at_flush = 0;
+    if (!stbi__zlib_start(&zb, !is_iphone)) goto done;
+    stbi__setup_png_unfilter(unfilter, depth < 8 ? 1 : s->img_n * bytes);
+    r = STBI__ZPAUSED;
+
+    for (j = 0; j < y; j += rows) {
+        stbi__uint32 count;
+        rows = y - j < band_rows ? y - j : band_rows;
+        if (row_start - zb.zout_start > STBI__ZWINDOW) {
+            // drop what deflate can no longer refer back to
+            char* keep = row_start - STBI__ZWINDOW;
+            memmove(zb.zout_start, keep, zb.zout - keep);
+            zb.zout -= keep - zb.zout_start;
+            row_start = zb.zout_start + STBI__ZWINDOW;
+        }
+        if ((size_t)(zb.zout - row_start) < (size_t)rows * row_bytes && r == STBI__ZPAUSED) {
+            zb.zout_pause = row_start + (size_t)rows * row_bytes;
+            r = stbi__zlib_run(&zb);
+            if (!r) goto done;
+        }
+        if ((size_t)(zb.zout - row_start) < (size_t)rows * row_bytes) {
+            stbi__err("not enough pixels", "Corrupt PNG");
+            goto done;
+        }
+
+        count = x * rows;
+        z->out = (stbi_uc*)stbi__malloc_mad3(x, rows, out_n * bytes, 0);
+        if (!z->out) {
+            stbi__err("outofmem", "Out of memory");
+            goto done;
+        }
+        z->out_y0 = j;
+        if (!stbi__png_unfilter_rows(z, (stbi_uc*)row_start, filter_buf, unfilter, out_n, x, j, j + rows, depth, color)) goto done;
+        row_start += (size_t)rows * row_bytes;
+        if (has_trans) {
+            if (depth == 16)
+                stbi__compute_transparency16(z, count, tc16, out_n);
+            else
+                stbi__compute_transparency(z, count, tc, out_n);
+        }
+        if (is_iphone && stbi__de_iphone_flag && out_n > 2)
+            stbi__de_iphone(z, count);
+        n = out_n;
+        if (pal_img_n) {
+            n = req_comp >= 3 ? req_comp : pal_img_n;
+            if (!stbi__expand_png_palette(z, count, palette, pal_len, n)) goto done;
+        }
+        if (req_comp && req_comp != n) {
+            if (depth == 16)
+                z->out = (stbi_uc*)stbi__convert_format16((stbi__uint16*)z->out, n, req_comp, x, rows);
+            else
+                z->out = stbi__convert_format(z->out, n, req_comp, x, rows);
+            n = req_comp;
+            if (!z->out) goto done;
+        }
+        if (depth == 16) {
+            z->out = stbi__convert_16_to_8((stbi__uint16*)z->out, x, rows, n);
+            if (!z->out) goto done;
+        }
+        if (!stbi__band_out(s, z->out, rows, n)) {
+            ok = 1; // stopped by the callback
+            goto done;
+        }
+        STBI_FREE(z->out);
+        z->out = NULL;
+    }
+
+    // the rest of the stream, usually just its end, is still checked like stbi__do_zlib would
+    while (r == STBI__ZPAUSED) {
+        if (zb.zout - zb.zout_start > STBI__ZWINDOW) {
+            memmove(zb.zout_start, zb.zout - STBI__ZWINDOW, STBI__ZWINDOW);
+            zb.zout = zb.zout_start + STBI__ZWINDOW;
+        }
+        zb.zout_pause = zb.zout + band_bytes;
+        r = stbi__zlib_run(&zb);
+    }
+    ok = r == 1;
+
+done:
+    STBI_FREE(z->out);
+    z->out = NULL;
+    STBI_FREE(filter_buf);
+    STBI_FREE(zb.zout_start);
+    return ok;
+}
+
 #define STBI__PNG_TYPE(a,b,c,d)  (((unsigned) (a) << 24) + ((unsigned) (b) << 16) + ((unsigned) (c) << 8) + (unsigned) (d))
 
 static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
@@ -5144,6 +7366,9 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
     z->expanded = NULL;
     z->idata = NULL;
     z->out = NULL;
+    z->out_direct = 0;
+    z->out_y0 = 0;
+    z->bands = 0;
 
     if (!stbi__check_png_header(s)) return 0;
 
@@ -5264,30 +7489,50 @@ static int stbi__parse_png_file(stbi__png* z, int scan, int req_comp)
             // initial guess for decoded data size to avoid unnecessary reallocs
             bpl = (s->img_x * z->depth + 7) / 8; // bytes per line, per component
             raw_len = bpl * s->img_y * s->img_n /* pixels */ + s->img_y /* filter mode per row */;
-            z->expanded = (stbi_uc*)stbi_zlib_decode_malloc_guesssize_headerflag((char*)z->idata, ioff, raw_len, (int*)&raw_len, !is_iphone);
-            if (z->expanded == NULL) return 0; // zlib should set error
-            STBI_FREE(z->idata); z->idata = NULL;
             if ((req_comp == s->img_n + 1 && req_comp != 3 && !pal_img_n) || has_trans)
                 s->img_out_n = s->img_n + 1;
             else
                 s->img_out_n = s->img_n;
-            if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            if (s->band && !interlace) {
+                if (!stbi__png_load_bands(z, ioff, req_comp, color, is_iphone, palette, pal_len, pal_img_n, has_trans, tc, tc16)) return 0;
+                STBI_FREE(z->idata); z->idata = NULL;
+                z->bands = 1;
+                // the colors of the source like below
+                if (pal_img_n)
+                    s->img_n = pal_img_n;
+                else if (has_trans)
+                    ++s->img_n;
+                stbi__get32be(s);
+                return 1;
+            }
+            // unfilter straight into the caller's buffer when no pass below rewrites the whole image
+            z->out_direct = !interlace && !has_trans && !pal_img_n && !is_iphone && z->depth <= 8
+                && (!req_comp || req_comp == s->img_out_n) && stbi__out_direct(s, s->img_x, s->img_y, s->img_out_n);
+            if (stbi__create_png_image_parallel(z, ioff, raw_len, s->img_out_n, color, interlace, is_iphone)) {
+                STBI_FREE(z->idata); z->idata = NULL;
+            }
+            else {
+                z->expanded = (stbi_uc*)stbi_zlib_decode_malloc_guesssize_headerflag((char*)z->idata, ioff, raw_len, (int*)&raw_len, !is_iphone);
+                if (z->expanded == NULL) return 0; // zlib should set error
+                STBI_FREE(z->idata); z->idata = NULL;
+                if (!stbi__create_png_image(z, z->expanded, raw_len, s->img_out_n, z->depth, color, interlace)) return 0;
+            }
             if (has_trans) {
                 if (z->depth == 16) {
-                    if (!stbi__compute_transparency16(z, tc16, s->img_out_n)) return 0;
+                    if (!stbi__compute_transparency16(z, s->img_x * s->img_y, tc16, s->img_out_n)) return 0;
                 }
                 else {
-                    if (!stbi__compute_transparency(z, tc, s->img_out_n)) return 0;
+                    if (!stbi__compute_transparency(z, s->img_x * s->img_y, tc, s->img_out_n)) return 0;
                 }
             }
             if (is_iphone && stbi__de_iphone_flag && s->img_out_n > 2)
-                stbi__de_iphone(z);
+                stbi__de_iphone(z, s->img_x * s->img_y);
             if (pal_img_n) {
                 // pal_img_n == 3 or 4
                 s->img_n = pal_img_n; // record the actual colors we had
                 s->img_out_n = pal_img_n;
                 if (req_comp >= 3) s->img_out_n = req_comp;
-                if (!stbi__expand_png_palette(z, palette, pal_len, s->img_out_n))
+                if (!stbi__expand_png_palette(z, s->img_x * s->img_y, palette, pal_len, s->img_out_n))
                     return 0;
             }
             else if (has_trans) {
@@ -5327,6 +7572,12 @@ static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, st
     void* result = NULL;
     if (req_comp < 0 || req_comp > 4) return stbi__errpuc("bad req_comp", "Internal error");
     if (stbi__parse_png_file(p, STBI__SCAN_load, req_comp)) {
+        if (p->bands) {
+            *x = p->s->img_x;
+            *y = p->s->img_y;
+            if (n) *n = p->s->img_n;
+            return stbi__bands_done(p->s);
+        }
         if (p->depth <= 8)
             ri->bits_per_channel = 8;
         else if (p->depth == 16)
@@ -5347,6 +7598,7 @@ static void* stbi__do_png(stbi__png* p, int* x, int* y, int* n, int req_comp, st
         *y = p->s->img_y;
         if (n) *n = p->s->img_n;
     }
+    if (p->out_direct) p->out = NULL; // belongs to the caller
     STBI_FREE(p->out);      p->out = NULL;
     STBI_FREE(p->expanded); p->expanded = NULL;
     STBI_FREE(p->idata);    p->idata = NULL;
@@ -7521,8 +9773,7 @@ static int stbi__psd_is16(stbi__context* s)
         stbi__rewind(s);
         return 0;
     }
-    STBI_NOTUSED(stbi__get32be(s));
-    STBI_NOTUSED(stbi__get32be(s));
+    stbi__skip(s, 8); // height and width; STBI_NOTUSED would not read them where it is sizeof
     depth = stbi__get16be(s);
     if (depth != 16) {
         stbi__rewind(s);
@@ -7801,6 +10052,80 @@ static int stbi__is_16_main(stbi__context* s)
     return 0;
 }
 
+static int stbi__probe_main(stbi__context* s, stbi_image_info* info)
+{
+    stbi_uc sig[4];
+    int i, *x = &info->x, *y = &info->y, *comp = &info->channels;
+    for (i = 0; i < 4; ++i)
+        sig[i] = stbi__get8(s);
+    stbi__rewind(s);
+    info->bits_per_channel = 8;
+
+    // the same tests as stbi__info_main, but only the one whose signature matches
+#ifndef STBI_NO_JPEG
+    if (sig[0] == 0xff && stbi__jpeg_info(s, x, y, comp)) { info->format = "jpeg"; return 1; }
+#endif
+
+#ifndef STBI_NO_PNG
+    if (sig[0] == 0x89 && sig[1] == 'P' && sig[2] == 'N' && sig[3] == 'G') {
+        stbi__png p;
+        p.s = s;
+        if (stbi__png_info_raw(&p, x, y, comp)) {
+            if (p.depth == 16) info->bits_per_channel = 16;
+            info->format = "png";
+            return 1;
+        }
+    }
+#endif
+
+#ifndef STBI_NO_GIF
+    if (sig[0] == 'G' && sig[1] == 'I' && sig[2] == 'F' && sig[3] == '8' && stbi__gif_info(s, x, y, comp)) { info->format = "gif"; return 1; }
+#endif
+
+#ifndef STBI_NO_BMP
+    if (sig[0] == 'B' && sig[1] == 'M' && stbi__bmp_info(s, x, y, comp)) { info->format = "bmp"; return 1; }
+#endif
+
+#ifndef STBI_NO_PSD
+    if (sig[0] == '8' && sig[1] == 'B' && sig[2] == 'P' && sig[3] == 'S' && stbi__psd_info(s, x, y, comp)) {
+        stbi__rewind(s);
+        if (stbi__psd_is16(s)) info->bits_per_channel = 16;
+        info->format = "psd";
+        return 1;
+    }
+#endif
+
+#ifndef STBI_NO_PIC
+    if (sig[0] == 0x53 && sig[1] == 0x80 && sig[2] == 0xF6 && sig[3] == 0x34 && stbi__pic_info(s, x, y, comp)) { info->format = "pic"; return 1; }
+#endif
+
+#ifndef STBI_NO_PNM
+    if (sig[0] == 'P' && (sig[1] == '5' || sig[1] == '6')) {
+        int bits = stbi__pnm_info(s, x, y, comp);
+        if (bits) {
+            info->bits_per_channel = bits;
+            info->format = "pnm";
+            return 1;
+        }
+    }
+#endif
+
+#ifndef STBI_NO_HDR
+    if (sig[0] == '#' && sig[1] == '?' && stbi__hdr_info(s, x, y, comp)) {
+        info->bits_per_channel = 32;
+        info->format = "hdr";
+        return 1;
+    }
+#endif
+
+    // no signature, or a broken header behind one, which stbi__info_main tries as TGA too
+#ifndef STBI_NO_TGA
+    stbi__rewind(s);
+    if (stbi__tga_info(s, x, y, comp)) { info->format = "tga"; return 1; }
+#endif
+    return stbi__err("unknown image type", "Image not of any known type, or corrupt");
+}
+
 #ifndef STBI_NO_STDIO
 STBIDEF int stbi_info(char const* filename, int* x, int* y, int* comp)
 {
@@ -7843,6 +10168,27 @@ STBIDEF int stbi_is_16_bit_from_file(FILE* f)
     fseek(f, pos, SEEK_SET);
     return r;
 }
+
+STBIDEF int stbi_probe(char const* filename, stbi_image_info* info)
+{
+    FILE* f = stbi__fopen(filename, "rb");
+    int result;
+    if (!f) return stbi__err("can't fopen", "Unable to open file");
+    result = stbi_probe_from_file(f, info);
+    fclose(f);
+    return result;
+}
+
+STBIDEF int stbi_probe_from_file(FILE* f, stbi_image_info* info)
+{
+    int r;
+    stbi__context s;
+    long pos = ftell(f);
+    stbi__start_file(&s, f);
+    r = stbi__probe_main(&s, info);
+    fseek(f, pos, SEEK_SET);
+    return r;
+}
 #endif // !STBI_NO_STDIO
 
 STBIDEF int stbi_info_from_memory(stbi_uc const* buffer, int len, int* x, int* y, int* comp)
@@ -7873,6 +10219,20 @@ STBIDEF int stbi_is_16_bit_from_callbacks(stbi_io_callbacks const* c, void* user
     return stbi__is_16_main(&s);
 }
 
+STBIDEF int stbi_probe_from_memory(stbi_uc const* buffer, int len, stbi_image_info* info)
+{
+    stbi__context s;
+    stbi__start_mem(&s, buffer, len);
+    return stbi__probe_main(&s, info);
+}
+
+STBIDEF int stbi_probe_from_callbacks(stbi_io_callbacks const* c, void* user, stbi_image_info* info)
+{
+    stbi__context s;
+    stbi__start_callbacks(&s, (stbi_io_callbacks*)c, user);
+    return stbi__probe_main(&s, info);
+}
+
 #endif // STB_IMAGE_IMPLEMENTATION
 
 /*
@@ -0,0 +1,121 @@
+#ifndef TASK_POOL_HPP
+#define TASK_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "stb_image.hpp"
+
+/* Helper threads for the tasks stb_image splits large decodes into. stb_image creates no threads, it hands the tasks
+ * of one decode step to the function set with `stbi_set_parallel_run` and waits for them:
+ *   stbi_set_parallel_run(TaskPool::run);
+ * The thread that decodes works on its own tasks too, so a decode never waits for helpers that are busy with another
+ * image, and on a single core (no helpers) everything simply runs on the decoding thread. */
+class TaskPool {
+public:
+  explicit TaskPool(unsigned int helperCount) {
+    for (unsigned int i = 0; i < helperCount; i++)
+      helpers.emplace_back(&TaskPool::helperLoop, this);
+  }
+
+  ~TaskPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeHelpers.notify_all();
+    for (std::thread &helper : helpers)
+      helper.join();
+  }
+
+  TaskPool(const TaskPool &) = delete;
+  TaskPool &operator=(const TaskPool &) = delete;
+
+  // The pool behind `run`, one helper per core besides the decoding thread.
+  static TaskPool &shared() {
+    static TaskPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+  }
+
+  // A `stbi_parallel_run`: runs task(data, 0) .. task(data, count - 1) on the shared pool, returns once all are done.
+  static void run(stbi_parallel_task *task, void *data, int count) { shared().execute(task, data, count); }
+
+  void execute(stbi_parallel_task *task, void *data, int count) {
+    if (count <= 1 || helpers.empty()) {
+      for (int i = 0; i < count; i++)
+        task(data, i);
+      return;
+    }
+
+    Batch batch(task, data, count);
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      batches.push_back(&batch);
+    }
+    wakeHelpers.notify_all();
+
+    int ran = work(batch);
+    std::unique_lock<std::mutex> lock(mutex);
+    batch.finished += ran;
+    // Helpers only join a batch while it is queued, so once it is gone and they left, it can go out of scope.
+    batchDone.wait(lock, [&batch] { return batch.finished == batch.count && batch.workers == 0; });
+    batches.erase(std::remove(batches.begin(), batches.end(), &batch), batches.end());
+  }
+
+private:
+  struct Batch {
+    Batch(stbi_parallel_task *task, void *data, int count) : task(task), data(data), count(count) {}
+
+    stbi_parallel_task *task;
+    void *data;
+    int count;
+    std::atomic<int> next{0}; // first task nobody took yet
+    int finished = 0;         // tasks done, guarded by the mutex like `workers`
+    int workers = 0;          // helpers working on the batch
+  };
+
+  std::vector<std::thread> helpers;
+  std::deque<Batch *> batches;
+  std::mutex mutex;
+  std::condition_variable wakeHelpers, batchDone;
+  bool stopping = false;
+
+  // Take tasks of the batch until there are none left, returns how many this thread ran.
+  static int work(Batch &batch) {
+    int ran = 0;
+    for (int i = batch.next++; i < batch.count; i = batch.next++) {
+      batch.task(batch.data, i);
+      ran++;
+    }
+    return ran;
+  }
+
+  void helperLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    for (;;) {
+      wakeHelpers.wait(lock, [this] { return stopping || !batches.empty(); });
+      if (stopping)
+        return;
+      Batch *batch = batches.front();
+      if (batch->next >= batch->count) {
+        // Every task is taken, the decoding thread removes the batch once they are done.
+        batches.pop_front();
+        continue;
+      }
+      batch->workers++;
+      lock.unlock();
+      int ran = work(*batch);
+      lock.lock();
+      batch->finished += ran;
+      batch->workers--;
+      batchDone.notify_all();
+    }
+  }
+};
+
+#endif
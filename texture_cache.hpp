@@ -0,0 +1,112 @@
+#ifndef TEXTURE_CACHE_HPP
+#define TEXTURE_CACHE_HPP
+
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "texture_loader.hpp"
+
+/* Hands out shared textures, so an image that is used by many materials is decoded and uploaded only once.
+ * Textures are keyed by path and decode parameters: the same file flipped and unflipped, or a JPEG decoded at full
+ * and at reduced size (`jpegTargetSize`), are two textures.
+ * The cache keeps every texture it loaded, up to `BudgetBytes` of GPU memory. Above that, textures nobody else holds
+ * a handle to are released, least recently requested first. Textures still in use are never released, so the budget
+ * can be exceeded when the scene itself needs more. */
+class TextureCache {
+public:
+  struct Statistics {
+    unsigned int hits = 0;      // requests served by an already loaded or loading texture
+    unsigned int misses = 0;    // requests that started a new load
+    unsigned int evictions = 0; // textures released to stay within the budget
+    size_t residentBytes = 0;   // GPU memory of the textures in the cache
+  };
+
+  TextureLoader loader;
+  size_t BudgetBytes;
+
+  explicit TextureCache(size_t budgetBytes = size_t(256) << 20) : BudgetBytes(budgetBytes) {}
+
+  TextureCache(const TextureCache &) = delete;
+  TextureCache &operator=(const TextureCache &) = delete;
+
+  std::shared_ptr<AsyncTexture> acquire(const std::string &path, const TextureParameters &parameters = {}) {
+    Key key = {path, parameters};
+    auto found = entries.find(key);
+    if (found != entries.end()) {
+      statistics.hits++;
+      // Most recently used textures are at the front.
+      recency.splice(recency.begin(), recency, found->second.recency);
+      return found->second.texture;
+    }
+
+    statistics.misses++;
+    recency.push_front(key);
+    Entry &entry = entries[key];
+    entry.texture = loader.load(path, parameters);
+    entry.recency = recency.begin();
+    return entry.texture;
+  }
+
+  // Stream pending textures and release unused ones above the budget, call once per frame.
+  void update() {
+    loader.update();
+    evict();
+  }
+
+  const Statistics &stats() {
+    statistics.residentBytes = residentBytes();
+    return statistics;
+  }
+
+private:
+  struct Key {
+    std::string path;
+    TextureParameters parameters;
+
+    bool operator<(const Key &other) const {
+      const TextureParameters &a = parameters, &b = other.parameters;
+      const MipmapOptions &am = a.mipmaps, &bm = b.mipmaps;
+      return std::tie(path, a.flipVertically, a.jpegTargetSize, a.wrap, a.minFilter, a.magFilter, a.cpuMipmaps,
+                      am.filter, am.gammaCorrect, am.alphaCoverageReference) <
+             std::tie(other.path, b.flipVertically, b.jpegTargetSize, b.wrap, b.minFilter, b.magFilter, b.cpuMipmaps,
+                      bm.filter, bm.gammaCorrect, bm.alphaCoverageReference);
+    }
+  };
+
+  struct Entry {
+    std::shared_ptr<AsyncTexture> texture;
+    std::list<Key>::iterator recency;
+  };
+
+  std::map<Key, Entry> entries;
+  std::list<Key> recency;
+  Statistics statistics;
+
+  size_t residentBytes() const {
+    size_t bytes = 0;
+    for (const auto &entry : entries)
+      bytes += entry.second.texture->bytes;
+    return bytes;
+  }
+
+  void evict() {
+    size_t bytes = residentBytes();
+    // Walk from the least recently used end, skipping textures that are still referenced or loading.
+    for (auto key = recency.end(); bytes > BudgetBytes && key != recency.begin();) {
+      --key;
+      auto entry = entries.find(*key);
+      const std::shared_ptr<AsyncTexture> &texture = entry->second.texture;
+      if (texture.use_count() > 1 || !(texture->resident || texture->failed))
+        continue;
+      bytes -= texture->bytes;
+      statistics.evictions++;
+      entries.erase(entry);
+      key = recency.erase(key);
+    }
+  }
+};
+
+#endif
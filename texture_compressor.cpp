@@ -0,0 +1,127 @@
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "bc_encoder.hpp"
+#include "compressed_texture.hpp"
+#include "mipmap.hpp"
+#include "stb_image.hpp"
+
+/* Offline texture compressor: bakes a PNG/JPEG (anything stb_image reads) into a block compressed KTX2 or DDS file
+ * with a full mip chain, which the texture loader uploads as is.
+ * Usage: LearnOpenGLTextureCompressor input.png output.ktx2|output.dds [--format bc1|bc3|bc7] [--srgb]
+ *                                     [--no-mipmaps] [--no-flip] [--kaiser] [--no-gamma] [--alpha-coverage 0.5]
+ * Mipmaps are generated by `generateMipChain` before compression, see mipmap.hpp for the filter options.
+ * Images are flipped vertically by default, like the loader does for uncompressed images, since compressed blocks
+ * cannot be flipped cheaply at load time. */
+
+struct CompressorOptions {
+  const char *inputPath = NULL;
+  const char *outputPath = NULL;
+  BlockFormat format = BC7;
+  bool srgb = false;     // store as sRGB, the GPU then decodes to linear when sampling
+  bool mipmaps = true;
+  bool flip = true;      // bottom row first, what OpenGL expects
+  MipmapOptions mipmapOptions;
+};
+
+bool parseOptions(int argc, char *argv[], CompressorOptions &options);
+bool endsWith(const std::string &text, const std::string &suffix);
+
+int main(int argc, char *argv[]) {
+  CompressorOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    std::cerr << "Usage: " << argv[0]
+              << " input.png output.ktx2|output.dds [--format bc1|bc3|bc7] [--srgb] [--no-mipmaps] [--no-flip]"
+              << " [--kaiser] [--no-gamma] [--alpha-coverage reference]" << std::endl;
+    return -1;
+  }
+
+  stbi_set_flip_vertically_on_load(options.flip);
+  int width, height, channels;
+  unsigned char *pixels = stbi_load(options.inputPath, &width, &height, &channels, 4);
+  if (!pixels) {
+    std::cerr << "Failed to load " << options.inputPath << ": " << stbi_failure_reason() << std::endl;
+    return -1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  MipChain mips = generateMipChain(pixels, width, height, 4, options.mipmapOptions, options.mipmaps ? 0 : 1);
+  stbi_image_free(pixels);
+
+  CompressedImage image;
+  image.format = options.format;
+  image.srgb = options.srgb;
+  image.width = width;
+  image.height = height;
+  for (const MipLevel &mip : mips.levels) {
+    CompressedLevel compressed = {mip.width, mip.height, image.data.size(),
+                                  compressedLevelSize(options.format, mip.width, mip.height)};
+    image.data.resize(image.data.size() + compressed.size);
+    compressImage(options.format, mips.data.data() + mip.offset, mip.width, mip.height,
+                  image.data.data() + compressed.offset);
+    image.levels.push_back(compressed);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::string outputPath = options.outputPath;
+  std::vector<unsigned char> file = endsWith(outputPath, ".dds") ? encodeDDS(image) : encodeKTX2(image);
+  std::ofstream out(outputPath, std::ios::binary);
+  out.write(reinterpret_cast<const char *>(file.data()), file.size());
+  if (!out) {
+    std::cerr << "Failed to write " << outputPath << std::endl;
+    return -1;
+  }
+
+  // Compared with what the loader would otherwise upload: 8 bits per channel plus a third for the mip chain.
+  const char *formatNames[] = {"BC1", "BC3", "BC7"};
+  double uncompressed = static_cast<double>(width) * height * channels * (options.mipmaps ? 4.0 / 3.0 : 1.0);
+  std::cout << options.inputPath << ": " << width << "x" << height << ", " << image.levels.size() << " levels, "
+            << formatNames[options.format] << (options.srgb ? " sRGB" : "") << ", " << image.data.size()
+            << " bytes (" << uncompressed / image.data.size() << "x smaller), encoded in " << seconds << " s"
+            << std::endl;
+  return 0;
+}
+
+bool parseOptions(int argc, char *argv[], CompressorOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+      std::string format = argv[++i];
+      if (format == "bc1")
+        options.format = BC1;
+      else if (format == "bc3")
+        options.format = BC3;
+      else if (format == "bc7")
+        options.format = BC7;
+      else
+        return false;
+    } else if (strcmp(argv[i], "--srgb") == 0) {
+      options.srgb = true;
+    } else if (strcmp(argv[i], "--no-mipmaps") == 0) {
+      options.mipmaps = false;
+    } else if (strcmp(argv[i], "--no-flip") == 0) {
+      options.flip = false;
+    } else if (strcmp(argv[i], "--kaiser") == 0) {
+      options.mipmapOptions.filter = KAISER_FILTER;
+    } else if (strcmp(argv[i], "--no-gamma") == 0) {
+      options.mipmapOptions.gammaCorrect = false;
+    } else if (strcmp(argv[i], "--alpha-coverage") == 0 && i + 1 < argc) {
+      options.mipmapOptions.alphaCoverageReference = static_cast<float>(atof(argv[++i]));
+    } else if (!options.inputPath) {
+      options.inputPath = argv[i];
+    } else if (!options.outputPath) {
+      options.outputPath = argv[i];
+    } else {
+      return false;
+    }
+  }
+  return options.inputPath && options.outputPath;
+}
+
+bool endsWith(const std::string &text, const std::string &suffix) {
+  return text.size() >= suffix.size() && text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
@@ -0,0 +1,377 @@
+#ifndef TEXTURE_LOADER_HPP
+#define TEXTURE_LOADER_HPP
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "compressed_texture.hpp"
+#include "gl_resources.hpp"
+#include "image_arena.hpp"
+#include "mipmap.hpp"
+#include "stb_image.hpp"
+#include "task_pool.hpp"
+
+// Sampling state applied to a texture once it is created.
+struct TextureParameters {
+  bool flipVertically = true; // OpenGL expects the first row at the bottom, images store it at the top
+  GLenum wrap = GL_REPEAT;
+  GLenum minFilter = GL_LINEAR;
+  GLenum magFilter = GL_LINEAR;
+  // Build the mip chain on the decoding thread (see mipmap.hpp) instead of with glGenerateTextureMipmap.
+  bool cpuMipmaps = true;
+  MipmapOptions mipmaps;
+  // For previews and low detail levels: JPEGs are decoded at 1/2, 1/4 or 1/8 size as long as their larger side stays
+  // at least this many pixels, which is much faster than decoding everything and dropping the top mip levels.
+  // 0 loads the full image.
+  int jpegTargetSize = 0;
+};
+
+/* A texture that is loaded in the background.
+ * Until all of its pixels are on the GPU `ID()` returns the loader's placeholder, so it can be bound every frame
+ * from the start and the image simply shows up once it is ready. */
+class AsyncTexture {
+public:
+  Texture2D texture;
+  bool resident = false; // all levels uploaded, `texture` can be sampled
+  bool failed = false;   // decoding failed, the placeholder stays
+  size_t bytes = 0;      // GPU memory of all levels, known once decoding finished
+  ImageArenaStatistics decodeAllocations; // made by stb_image while decoding, see image_arena.hpp
+
+  unsigned int ID() const { return resident ? texture.ID : placeholder; }
+
+private:
+  friend class TextureLoader;
+  unsigned int placeholder = 0;
+};
+
+/* Loads textures without blocking the render loop.
+ * `load` only queues the file: a pool of worker threads decodes images in parallel, and `update`, called once per
+ * frame on the GL thread, copies decoded rows of every mip level into a persistently mapped pixel buffer object and
+ * lets the driver transfer them into the texture from there. Each call uploads at most `bytesPerFrame`, large images
+ * are spread over several frames instead of causing a hitch. The staging buffer is split into regions guarded by
+ * fences the same way as `UniformRingBuffer`, so we never overwrite rows the GPU has not read yet.
+ * KTX2 and DDS files are not decoded at all: their precompressed mip chain is uploaded level by level, in rows of
+ * 4x4 blocks, and stays compressed on the GPU. `TextureParameters::flipVertically` does not apply to them, the
+ * texture compressor tool stores them flipped already.
+ * Requires a current OpenGL context when constructed, and `update` has to be called on that context's thread. */
+class TextureLoader {
+public:
+  static const int REGION_COUNT = 3;
+
+  explicit TextureLoader(size_t bytesPerFrame = 1 << 20, unsigned int workerCount = 0)
+      : BytesPerFrame(bytesPerFrame) {
+    createPlaceholder();
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    staging = Buffer(BytesPerFrame * REGION_COUNT, NULL, flags);
+    mapped = static_cast<unsigned char *>(glMapNamedBufferRange(staging.ID, 0, BytesPerFrame * REGION_COUNT, flags));
+
+    if (workerCount == 0)
+      workerCount = std::max(1u, std::thread::hardware_concurrency());
+    // A large atlas alone would keep one worker busy for a long time, its decode is spread over the cores instead.
+    stbi_set_parallel_run(TaskPool::run);
+    for (unsigned int i = 0; i < workerCount; i++)
+      workers.emplace_back(&TextureLoader::workerLoop, this);
+  }
+
+  ~TextureLoader() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wakeWorkers.notify_all();
+    for (std::thread &worker : workers)
+      worker.join();
+
+    for (GLsync &fence : fences)
+      if (fence)
+        glDeleteSync(fence);
+    glUnmapNamedBuffer(staging.ID);
+  }
+
+  TextureLoader(const TextureLoader &) = delete;
+  TextureLoader &operator=(const TextureLoader &) = delete;
+
+  // Queue an image file, the returned texture shows the placeholder until it is loaded.
+  std::shared_ptr<AsyncTexture> load(const std::string &path, const TextureParameters &parameters = {}) {
+    auto texture = std::make_shared<AsyncTexture>();
+    texture->placeholder = placeholder.ID;
+
+    Job job;
+    job.target = texture;
+    job.path = path;
+    job.parameters = parameters;
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      queued.push_back(std::move(job));
+      pendingCount++;
+    }
+    wakeWorkers.notify_one();
+    return texture;
+  }
+
+  // Upload the next slice of decoded rows, call once per frame.
+  void update() { upload(BytesPerFrame); }
+
+  // Block until every queued texture is resident (or failed), e.g. before measuring frame times.
+  void finish() {
+    while (pending() > 0) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        decodeDone.wait(lock, [this] { return !decoded.empty() || !uploading.empty() || pendingCount == 0; });
+      }
+      upload(SIZE_MAX);
+    }
+  }
+
+  // Textures queued but not resident yet.
+  int pending() {
+    std::lock_guard<std::mutex> lock(mutex);
+    return pendingCount;
+  }
+
+  const size_t BytesPerFrame;
+
+private:
+  struct Job {
+    std::shared_ptr<AsyncTexture> target;
+    std::string path;
+    TextureParameters parameters;
+    // Decoded image, only level 0 unless the mipmaps are generated on the CPU.
+    MipChain mips;
+    // KTX2 or DDS file, uploaded as is instead of `mips`.
+    bool compressed = false;
+    CompressedImage image;
+    ImageArenaStatistics decodeAllocations;
+    int level = 0;        // being uploaded
+    int rowsUploaded = 0; // of the current level, in rows of blocks for compressed images
+
+    int levelCount() const { return static_cast<int>(compressed ? image.levels.size() : mips.levels.size()); }
+  };
+
+  Texture2D placeholder;
+  std::vector<std::thread> workers;
+
+  // Shared with the workers, guarded by `mutex`.
+  std::mutex mutex;
+  std::condition_variable wakeWorkers, decodeDone;
+  std::deque<Job> queued, decoded;
+  int pendingCount = 0;
+  bool stopping = false;
+
+  // Only touched on the GL thread.
+  std::deque<Job> uploading;
+  Buffer staging;
+  unsigned char *mapped = NULL;
+  int region = 0;
+  GLsync fences[REGION_COUNT] = {};
+
+  // Grey checkerboard, small enough to upload synchronously.
+  void createPlaceholder() {
+    const unsigned char pixels[] = {96, 96, 96, 255, 160, 160, 160, 255, 160, 160, 160, 255, 96, 96, 96, 255};
+    placeholder = Texture2D(GL_RGBA8, 2, 2, 1);
+    placeholder.upload(0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+    placeholder.setWrap(GL_REPEAT);
+    placeholder.setFilter(GL_NEAREST, GL_NEAREST);
+  }
+
+  void workerLoop() {
+    for (;;) {
+      Job job;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wakeWorkers.wait(lock, [this] { return stopping || !queued.empty(); });
+        if (stopping)
+          return;
+        job = std::move(queued.front());
+        queued.pop_front();
+      }
+
+      if (isCompressedTexturePath(job.path)) {
+        job.compressed = true;
+        std::string error;
+        if (!loadCompressedImage(job.path.c_str(), job.image, error)) {
+          std::cout << "Failed to load texture " << job.path << ": " << error << std::endl;
+          job.image.levels.clear();
+        }
+      } else {
+        // The flip flag and target size are per thread, so workers with different settings do not race on the
+        // global ones.
+        stbi_set_flip_vertically_on_load_thread(job.parameters.flipVertically);
+        stbi_set_jpeg_target_size_thread(job.parameters.jpegTargetSize);
+        // stb_image's temporary buffers come from this thread's arena and are all released at the end of the block.
+        ImageArenaScope arena;
+        // The file is mapped instead of copied into a buffer, and decoded from memory: stb_image only splits a JPEG
+        // at its restart markers then.
+        int fileSize = 0;
+        const stbi_uc *file = stbi_map_file(job.path.c_str(), &fileSize);
+        int width, height, channels;
+        bool loaded = file && stbi_info_from_memory(file, fileSize, &width, &height, &channels) != 0;
+        if (loaded) {
+          // Decode straight into level 0 of the mip chain instead of letting stb_image allocate the image and
+          // copying it over. Generating the other levels here keeps that work off the GL thread too.
+          job.mips = allocateMipChain(width, height, channels, job.parameters.cpuMipmaps ? 0 : 1);
+          loaded = stbi_load_into_from_memory(file, fileSize, job.mips.data.data(), job.mips.levels[0].size, 0, &width,
+                                              &height, &channels, channels) != 0;
+        }
+        stbi_unmap_file(file, fileSize);
+        job.decodeAllocations = arena.stats();
+        if (loaded) {
+          generateMipLevels(job.mips, job.parameters.mipmaps);
+        } else {
+          std::cout << "Failed to load texture " << job.path << ": " << stbi_failure_reason() << std::endl;
+          job.mips = MipChain();
+        }
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        decoded.push_back(std::move(job));
+      }
+      decodeDone.notify_all();
+    }
+  }
+
+  void upload(size_t budget) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      while (!decoded.empty()) {
+        uploading.push_back(std::move(decoded.front()));
+        decoded.pop_front();
+      }
+    }
+
+    size_t uploaded = 0;
+    while (!uploading.empty() && uploaded < budget) {
+      Job &job = uploading.front();
+      if (job.levelCount() == 0) {
+        job.target->failed = true;
+        complete();
+        continue;
+      }
+      if (job.target->texture.ID == 0)
+        createTexture(job);
+
+      uploaded += uploadSlice(job, budget - uploaded);
+      if (job.level == job.levelCount()) {
+        // Compressed files bring their own mip chain.
+        if (!job.compressed && !job.parameters.cpuMipmaps)
+          job.target->texture.generateMipmaps();
+        job.target->resident = true;
+        complete();
+      }
+    }
+  }
+
+  void createTexture(Job &job) {
+    const GLenum internalFormats[] = {GL_R8, GL_RG8, GL_RGB8, GL_RGBA8};
+    Texture2D &texture = job.target->texture;
+    job.target->decodeAllocations = job.decodeAllocations;
+    if (job.compressed) {
+      const CompressedImage &image = job.image;
+      texture = Texture2D(glInternalFormat(image.format, image.srgb), image.width, image.height,
+                          static_cast<int>(image.levels.size()));
+      job.target->bytes = image.data.size();
+    } else {
+      int width = job.mips.levels[0].width, height = job.mips.levels[0].height, channels = job.mips.channels;
+      texture = Texture2D(internalFormats[channels - 1], width, height);
+      // Estimate from the channel count, drivers may pad RGB8 to 4 bytes per texel.
+      for (int level = 0; level < texture.Levels; level++)
+        job.target->bytes +=
+            static_cast<size_t>(std::max(1, width >> level)) * std::max(1, height >> level) * channels;
+    }
+    texture.setWrap(job.parameters.wrap);
+    texture.setFilter(job.parameters.minFilter, job.parameters.magFilter);
+  }
+
+  /* Copy as many rows of the current level as fit into the budget and the next staging region, returns the number
+   * of bytes uploaded. Rows are rows of texels, or rows of 4x4 blocks for compressed images. */
+  size_t uploadSlice(Job &job, size_t budget) {
+    int level = job.level, levelHeight, rowHeight;
+    size_t rowBytes;
+    const unsigned char *levelData;
+    if (job.compressed) {
+      const CompressedLevel &compressed = job.image.levels[level];
+      levelHeight = compressed.height;
+      rowHeight = 4;
+      rowBytes = compressedLevelSize(job.image.format, compressed.width, 1);
+      levelData = job.image.data.data() + compressed.offset;
+    } else {
+      const MipLevel &mip = job.mips.levels[level];
+      levelHeight = mip.height;
+      rowHeight = 1;
+      rowBytes = static_cast<size_t>(mip.width) * job.mips.channels;
+      levelData = job.mips.data.data() + mip.offset;
+    }
+    int remainingRows = (levelHeight + rowHeight - 1) / rowHeight - job.rowsUploaded;
+    const unsigned char *rows = levelData + job.rowsUploaded * rowBytes;
+
+    // Always make progress, even when the budget left this frame is smaller than a row.
+    int rowCount = static_cast<int>(std::min(std::min(budget, BytesPerFrame) / rowBytes, size_t(remainingRows)));
+    rowCount = std::max(rowCount, 1);
+    size_t size = rowCount * rowBytes;
+
+    // A single row that does not fit into a region is uploaded straight from client memory.
+    bool staged = rowBytes <= BytesPerFrame;
+    const void *pixels = rows;
+    if (staged) {
+      waitForRegion(region);
+      size_t offset = region * BytesPerFrame;
+      memcpy(mapped + offset, rows, size);
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging.ID);
+      pixels = reinterpret_cast<const void *>(offset);
+    }
+
+    int y = job.rowsUploaded * rowHeight, height = std::min(rowCount * rowHeight, levelHeight - y);
+    Texture2D &texture = job.target->texture;
+    if (job.compressed) {
+      GLenum format = glInternalFormat(job.image.format, job.image.srgb);
+      texture.uploadCompressedRows(level, y, height, format, static_cast<GLsizei>(size), pixels);
+    } else {
+      const GLenum formats[] = {GL_RED, GL_RG, GL_RGB, GL_RGBA};
+      texture.uploadRows(level, y, height, formats[job.mips.channels - 1], GL_UNSIGNED_BYTE, pixels);
+    }
+
+    if (staged) {
+      glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+      fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+      region = (region + 1) % REGION_COUNT;
+    }
+
+    job.rowsUploaded += rowCount;
+    if (rowCount == remainingRows) {
+      job.level++;
+      job.rowsUploaded = 0;
+    }
+    return size;
+  }
+
+  void complete() {
+    uploading.pop_front();
+    std::lock_guard<std::mutex> lock(mutex);
+    pendingCount--;
+  }
+
+  void waitForRegion(int index) {
+    if (!fences[index])
+      return;
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fences[index], waitFlags, 1000000) == GL_TIMEOUT_EXPIRED)
+      waitFlags = 0;
+    glDeleteSync(fences[index]);
+    fences[index] = 0;
+  }
+};
+
+#endif
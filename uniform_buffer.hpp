@@ -0,0 +1,72 @@
+#ifndef UNIFORM_BUFFER_HPP
+#define UNIFORM_BUFFER_HPP
+
+#include <cstring>
+
+#include <glad/glad.h>
+
+/* Uniform buffer that is written once per frame and shared by every program that declares the block.
+ * The buffer is split into `RegionCount` regions and stays mapped for its whole lifetime (persistent mapping), so
+ * writing the data is a plain memcpy with no driver call. While the GPU may still read the region of an earlier
+ * frame we write the next one, and a fence per region keeps us from overwriting data that is still in use.
+ * `T` has to match the std140 layout of the block in the shaders. */
+template <typename T, int RegionCount = 3> class UniformRingBuffer {
+public:
+  unsigned int ID = 0;
+  unsigned int Binding;
+
+  explicit UniformRingBuffer(unsigned int binding) : Binding(binding) {
+    // Each bound range has to start at a multiple of the uniform buffer offset alignment.
+    int alignment = 256;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    regionSize = (sizeof(T) + alignment - 1) / alignment * alignment;
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &ID);
+    glNamedBufferStorage(ID, regionSize * RegionCount, NULL, flags);
+    mapped = static_cast<unsigned char *>(glMapNamedBufferRange(ID, 0, regionSize * RegionCount, flags));
+  }
+
+  ~UniformRingBuffer() {
+    for (GLsync &fence : fences)
+      if (fence)
+        glDeleteSync(fence);
+    glUnmapNamedBuffer(ID);
+    glDeleteBuffers(1, &ID);
+  }
+
+  UniformRingBuffer(const UniformRingBuffer &) = delete;
+  UniformRingBuffer &operator=(const UniformRingBuffer &) = delete;
+
+  // Copy this frame's data into the next free region and bind it to the block binding point.
+  void write(const T &data) {
+    waitForRegion(region);
+    memcpy(mapped + region * regionSize, &data, sizeof(T));
+    glBindBufferRange(GL_UNIFORM_BUFFER, Binding, ID, region * regionSize, sizeof(T));
+  }
+
+  // Call after the last draw that reads this frame's data.
+  void fence() {
+    fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    region = (region + 1) % RegionCount;
+  }
+
+private:
+  unsigned char *mapped = NULL;
+  GLsizeiptr regionSize = 0;
+  int region = 0;
+  GLsync fences[RegionCount] = {};
+
+  void waitForRegion(int index) {
+    if (!fences[index])
+      return;
+    // Usually already signaled, we only block when the CPU is more than `RegionCount` frames ahead of the GPU.
+    GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+    while (glClientWaitSync(fences[index], waitFlags, 1000000) == GL_TIMEOUT_EXPIRED)
+      waitFlags = 0;
+    glDeleteSync(fences[index]);
+    fences[index] = 0;
+  }
+};
+
+#endif